@@ -0,0 +1,67 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+/** Benchmark helper with minimal per-byte overhead, built on raw read(2)/write(2).
+ *
+ *  Usage: echo_sink <mode> [size]
+ *    echo          Copies stdin to stdout until EOF.
+ *    sink          Reads stdin until EOF and discards it.
+ *    produce <n>   Writes n bytes to stdout.
+ *    exit          Exits immediately.
+ */
+
+namespace {
+
+constexpr std::size_t chunk_size = 1 << 16;
+
+bool write_all(const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(STDOUT_FILENO, data, size);
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <echo|sink|produce <n>|exit>\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string mode = argv[1];
+    std::vector<char> buf(chunk_size, 'x');
+    if (mode == "echo" || mode == "sink") {
+        while (true) {
+            ssize_t n = ::read(STDIN_FILENO, buf.data(), buf.size());
+            if (n == 0)
+                return EXIT_SUCCESS;
+            if (n < 0)
+                return EXIT_FAILURE;
+            if (mode == "echo" && !write_all(buf.data(), n))
+                return EXIT_FAILURE;
+        }
+    } else if (mode == "produce" && argc > 2) {
+        std::size_t size = std::stoull(argv[2]);
+        while (size > 0) {
+            std::size_t n = std::min(size, buf.size());
+            if (!write_all(buf.data(), n))
+                return EXIT_FAILURE;
+            size -= n;
+        }
+        return EXIT_SUCCESS;
+    } else if (mode == "exit") {
+        return EXIT_SUCCESS;
+    }
+
+    std::cerr << "Unknown mode: " << mode << "\n";
+    return EXIT_FAILURE;
+}
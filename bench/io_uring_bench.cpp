@@ -0,0 +1,126 @@
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "subprocess/io_uring.h"
+#include "subprocess/popen.h"
+
+/** Compares the blocking `File` path and the io_uring backend on capturing the output of a child.
+ *
+ *  Usage: io_uring_bench [--size <bytes>] [--repeat <n>]
+ *
+ *  One JSON object is printed per backend and run, with the wall time, the CPU time of
+ *  the parent and the number of I/O system calls (read/write counters of the calling thread
+ *  plus io_uring_enter calls), also normalized per GiB.
+ */
+
+namespace {
+
+constexpr double gib = 1024.0 * 1024.0 * 1024.0;
+
+struct Counters {
+    double      cpu;
+    std::size_t syscalls;
+};
+
+Counters sample() {
+    ::rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+               + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+    std::size_t syscalls = subprocess::IoUring::total_enter_count();
+    std::ifstream io("/proc/thread-self/io");
+    std::string key;
+    std::size_t value;
+    while (io >> key >> value) {
+        if (key == "syscr:" || key == "syscw:")
+            syscalls += value;
+    }
+    return {cpu, syscalls};
+}
+
+/** Child mode: writes `size` bytes to stdout. */
+int produce(std::size_t size) {
+    std::string chunk(1 << 16, 'x');
+    while (size > 0) {
+        std::size_t n = std::min(size, chunk.size());
+        ssize_t written = ::write(STDOUT_FILENO, chunk.data(), n);
+        if (written <= 0)
+            return 1;
+        size -= written;
+    }
+    return 0;
+}
+
+void run(const char* name, subprocess::IOBackend backend, std::size_t size) {
+    subprocess::set_io_backend(backend);
+
+    auto before     = sample();
+    auto start_time = std::chrono::steady_clock::now();
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/proc/self/exe", "--produce", std::to_string(size)),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+    ));
+    /** The blocking path drains stdout with File::read_all() before waiting, since the
+     *  blocking Popen::communicate() only reads once the process has exited. */
+    std::optional<subprocess::Bytes> std_out_data;
+    if (backend == subprocess::IOBackend::BLOCKING) {
+        p.std_in().value()->close();
+        std_out_data = p.std_out().value()->read_all();
+        p.wait();
+    } else {
+        std_out_data = p.communicate(subprocess::Bytes()).first;
+    }
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start_time;
+    auto after = sample();
+
+    double      gibs     = size / gib;
+    double      cpu      = after.cpu - before.cpu;
+    std::size_t syscalls = after.syscalls - before.syscalls;
+    std::cout << "{\"backend\": \"" << name << "\""
+              << ", \"bytes\": " << std_out_data.value().size()
+              << ", \"wall_s\": " << wall.count()
+              << ", \"cpu_s\": " << cpu
+              << ", \"syscalls\": " << syscalls
+              << ", \"syscalls_per_gib\": " << syscalls / gibs
+              << ", \"cpu_s_per_gib\": " << cpu / gibs
+              << ", \"gib_per_s\": " << gibs / wall.count()
+              << "}" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::size_t size   = 1ul << 30;
+    int         repeat = 3;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--produce" && i + 1 < argc) {
+            return produce(std::stoul(argv[++i]));
+        } else if (arg == "--size" && i + 1 < argc) {
+            size = std::stoul(argv[++i]);
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--size <bytes>] [--repeat <n>]\n";
+            return 1;
+        }
+    }
+
+    if (!subprocess::IoUring::is_supported())
+        std::cerr << "io_uring is not supported; the io_uring runs fall back to the blocking path.\n";
+
+    for (int i = 0; i < repeat; ++i) {
+        run("blocking", subprocess::IOBackend::BLOCKING, size);
+        run("io_uring", subprocess::IOBackend::IO_URING, size);
+    }
+    return 0;
+}
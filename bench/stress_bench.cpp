@@ -0,0 +1,398 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "subprocess/exception.h"
+#include "subprocess/popen.h"
+#include "internal.h"
+
+/** Keeps thousands of children alive at once and checks that the parent stays within its limits.
+ *
+ *  Usage: stress_bench [--min <n>] [--max <n>] [--factor <n>] [--max-threads <n>] [--max-rss-mb <n>]
+ *
+ *  Concurrency ramps from `--min` to `--max` children, multiplied by `--factor` at each step.
+ *  Every child has its stdin, stdout and stderr piped: it reads its stdin until EOF, sleeps for
+ *  a varying delay, then writes a varying amount of output to stdout and stderr. All children of
+ *  a step are spawned before any is reaped, and a single thread drains their pipes with epoll
+ *  and reaps them through their pidfd.
+ *
+ *  A JSON object is printed per sample (`--interval-ms`) with the thread count, open descriptors,
+ *  RSS, live children and the spawn, reap and output rates since the previous sample, and one per
+ *  step with its totals, spawn rate and reaping latency. The exit status is non-zero if a step
+ *  loses output, a child fails, the thread count or RSS exceeds its limit, or descriptors or
+ *  children are left behind once a step is over.
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t max_output = 1 << 18;
+constexpr std::size_t chunk_size = 1 << 16;
+
+/** Child mode: reads stdin until EOF, sleeps for `delay_ms`, then writes to stdout and stderr. */
+int child(std::size_t out_size, std::size_t err_size, int delay_ms) {
+    char buf[4096];
+    while (::read(STDIN_FILENO, buf, sizeof(buf)) > 0) {}
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+
+    std::string chunk(chunk_size, 'x');
+    for (auto [fd, size] : {std::pair{STDOUT_FILENO, out_size}, std::pair{STDERR_FILENO, err_size}}) {
+        while (size > 0) {
+            ssize_t written = ::write(fd, chunk.data(), std::min(size, chunk.size()));
+            if (written <= 0)
+                return 1;
+            size -= written;
+        }
+    }
+    return 0;
+}
+
+/** Process-wide resources, read from procfs. */
+struct Resources {
+    long threads = 0;
+    long fds     = 0;
+    long rss_kb  = 0;
+};
+
+Resources sample_resources() {
+    Resources resources;
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    long value;
+    while (status >> key) {
+        if (key == "Threads:" && status >> value)
+            resources.threads = value;
+        else if (key == "VmRSS:" && status >> value)
+            resources.rss_kb = value;
+        else
+            status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    if (DIR* dir = ::opendir("/proc/self/fd")) {
+        while (auto entry = ::readdir(dir))
+            resources.fds += entry->d_name[0] != '.';
+        ::closedir(dir);
+        --resources.fds; /** The descriptor of the directory itself. */
+    }
+    return resources;
+}
+
+/** Counters shared between the driving thread and the sampling thread. */
+struct Progress {
+    std::atomic<std::size_t> spawned{0};
+    std::atomic<std::size_t> reaped{0};
+    std::atomic<std::size_t> alive{0};
+    std::atomic<std::size_t> bytes{0};
+};
+
+/** Prints a sample every `interval` until stopped, and tracks the peaks of the process. */
+class Sampler {
+public:
+    Sampler(const Progress& progress, std::chrono::milliseconds interval) : progress_(progress), interval_(interval) {
+        thread_ = std::thread([this] { run(); });
+    }
+    ~Sampler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        stop_.notify_one();
+        thread_.join();
+    }
+
+    Resources peak() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return peak_;
+    }
+
+private:
+    void run() {
+        auto        last_time = Clock::now();
+        std::size_t last[3]   = {0, 0, 0};
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_.wait_for(lock, interval_, [this] { return stopped_; })) {
+            auto resources = sample_resources();
+            peak_.threads  = std::max(peak_.threads, resources.threads);
+            peak_.fds      = std::max(peak_.fds, resources.fds);
+            peak_.rss_kb   = std::max(peak_.rss_kb, resources.rss_kb);
+
+            auto        now     = Clock::now();
+            double      elapsed = std::chrono::duration<double>(now - last_time).count();
+            std::size_t current[3] = {progress_.spawned, progress_.reaped, progress_.bytes};
+            std::cout << "{\"sample\": true"
+                      << ", \"threads\": " << resources.threads
+                      << ", \"fds\": " << resources.fds
+                      << ", \"rss_kb\": " << resources.rss_kb
+                      << ", \"alive\": " << progress_.alive
+                      << ", \"spawns_per_s\": " << (current[0] - last[0]) / elapsed
+                      << ", \"reaps_per_s\": " << (current[1] - last[1]) / elapsed
+                      << ", \"mib_per_s\": " << (current[2] - last[2]) / elapsed / (1 << 20)
+                      << "}" << std::endl;
+            std::copy(current, current + 3, last);
+            last_time = now;
+        }
+    }
+
+    const Progress&           progress_;
+    std::chrono::milliseconds interval_;
+    mutable std::mutex        mutex_;
+    std::condition_variable   stop_;
+    bool                      stopped_ = false;
+    Resources                 peak_;
+    std::thread               thread_;
+};
+
+/** A child of a step, with the output it owes and the state of its pipes. */
+struct Child {
+    std::unique_ptr<subprocess::Popen>       popen;
+    std::shared_ptr<subprocess::IStreamable> pipes[2];
+    std::size_t                              expected   = 0;
+    std::size_t                              received   = 0;
+    int                                      open_pipes = 2;
+    int                                      pidfd      = -1;
+    Clock::time_point                        exited;
+};
+
+/** Tags of epoll events: the index of the child, times 3, plus the stream (0: pidfd, 1: stdout, 2: stderr). */
+std::uint64_t tag(std::size_t index, int stream) { return index * 3 + stream; }
+
+struct StepResult {
+    std::size_t children   = 0;
+    std::size_t failures   = 0;
+    std::size_t lost_bytes = 0;
+    double      spawn_s    = 0;
+    double      total_s    = 0;
+    double      reap_p50   = 0;
+    double      reap_max   = 0;
+};
+
+/** Spawns `count` children, drains them and reaps them. Throws on a system error. */
+StepResult run_step(std::size_t count, Progress& progress) {
+    int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+        throw subprocess::OSError(errno, std::generic_category(), "Failed to create epoll instance");
+    auto watch = [epoll_fd](int fd, std::uint64_t data) {
+        ::epoll_event event{};
+        event.events   = EPOLLIN;
+        event.data.u64 = data;
+        if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+            throw subprocess::OSError(errno, std::generic_category(), "Failed to watch a descriptor");
+    };
+
+    StepResult result;
+    result.children = count;
+    std::vector<Child> children(count);
+    auto start_time = Clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+        auto& c          = children[i];
+        std::size_t out  = (i * 7919) % max_output;
+        std::size_t err  = (i * 104729) % (max_output / 16);
+        c.expected       = out + err;
+        c.popen          = std::make_unique<subprocess::Popen>(subprocess::PopenConfig(
+            subprocess::types::args_t("/proc/self/exe", "--child", std::to_string(out), std::to_string(err), std::to_string(i % 50)),
+            subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+            subprocess::types::std_out_t(subprocess::types::IOOption::PIPE).set_non_blocking(),
+            subprocess::types::std_err_t(subprocess::types::IOOption::PIPE).set_non_blocking()
+        ));
+        progress.spawned++;
+        progress.alive++;
+
+        auto std_in = c.popen->std_in().value();
+        std::string request = "request " + std::to_string(i) + "\n";
+        std_in->write(subprocess::Bytes(request.begin(), request.end()), request.size());
+        std_in->close();
+
+        c.pipes[0] = c.popen->std_out().value();
+        c.pipes[1] = c.popen->std_err().value();
+        watch(c.pipes[0]->fileno(), tag(i, 1));
+        watch(c.pipes[1]->fileno(), tag(i, 2));
+        c.pidfd = subprocess::internal::pidfd_open(c.popen->pid());
+        if (c.pidfd == -1)
+            throw subprocess::OSError(errno, std::generic_category(), "Failed to open pidfd");
+        watch(c.pidfd, tag(i, 0));
+    }
+    result.spawn_s = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    std::vector<double> reap_latencies;
+    std::size_t         remaining = count;
+    std::vector<::epoll_event> events(1024);
+    while (remaining > 0) {
+        int ready = ::epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+        if (ready == -1) {
+            if (errno == EINTR)
+                continue;
+            throw subprocess::OSError(errno, std::generic_category(), "Failed to wait for events");
+        }
+        for (int e = 0; e < ready; ++e) {
+            auto& c      = children[events[e].data.u64 / 3];
+            int   stream = events[e].data.u64 % 3;
+            if (stream == 0) {
+                /** A pidfd stays readable once the child has exited: it is only watched until then. */
+                c.exited = Clock::now();
+                ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c.pidfd, nullptr);
+            } else if (auto chunk = c.pipes[stream - 1]->read_some(chunk_size)) {
+                c.received     += chunk->size();
+                progress.bytes += chunk->size();
+                if (chunk->empty()) {
+                    c.pipes[stream - 1]->close();
+                    --c.open_pipes;
+                }
+            }
+            /** Reaped once the child has exited and both pipes are drained, so no output is lost. */
+            if (c.pidfd != -1 && c.exited != Clock::time_point() && c.open_pipes == 0) {
+                auto returncode = c.popen->poll();
+                if (!returncode)
+                    continue;
+                reap_latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - c.exited).count());
+                result.failures   += returncode.value() != 0;
+                result.lost_bytes += c.expected - std::min(c.expected, c.received);
+                ::close(c.pidfd);
+                c.pidfd = -1;
+                c.popen.reset();
+                progress.reaped++;
+                progress.alive--;
+                --remaining;
+            }
+        }
+    }
+    ::close(epoll_fd);
+
+    result.total_s = std::chrono::duration<double>(Clock::now() - start_time).count();
+    std::sort(reap_latencies.begin(), reap_latencies.end());
+    if (!reap_latencies.empty()) {
+        result.reap_p50 = reap_latencies[reap_latencies.size() / 2];
+        result.reap_max = reap_latencies.back();
+    }
+    return result;
+}
+
+/** Raises the soft limit of descriptors to the hard limit; returns the resulting soft limit. */
+::rlim_t raise_fd_limit() {
+    ::rlimit limit{};
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    return limit.rlim_cur;
+}
+
+/** True if a child of this process is still running or unreaped. */
+bool has_children() {
+    ::siginfo_t info{};
+    return ::waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::size_t min_children = 100;
+    std::size_t max_children = 10000;
+    std::size_t factor       = 10;
+    long        max_threads  = 16;
+    long        max_rss_mb   = 2048;
+    long        interval_ms  = 500;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--child" && i + 3 < argc) {
+            return child(std::stoul(argv[i + 1]), std::stoul(argv[i + 2]), std::stoi(argv[i + 3]));
+        } else if (arg == "--min" && i + 1 < argc) {
+            min_children = std::stoul(argv[++i]);
+        } else if (arg == "--max" && i + 1 < argc) {
+            max_children = std::stoul(argv[++i]);
+        } else if (arg == "--factor" && i + 1 < argc) {
+            factor = std::max(std::stoul(argv[++i]), 2ul);
+        } else if (arg == "--max-threads" && i + 1 < argc) {
+            max_threads = std::stol(argv[++i]);
+        } else if (arg == "--max-rss-mb" && i + 1 < argc) {
+            max_rss_mb = std::stol(argv[++i]);
+        } else if (arg == "--interval-ms" && i + 1 < argc) {
+            interval_ms = std::stol(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--min <n>] [--max <n>] [--factor <n>]"
+                      << " [--max-threads <n>] [--max-rss-mb <n>] [--interval-ms <n>]\n";
+            return 1;
+        }
+    }
+
+    /** Each child holds three pipe ends, the exec pipe and a pidfd in the parent while it is alive. */
+    ::rlim_t fd_limit = raise_fd_limit();
+    std::size_t fd_cap = fd_limit > 64 ? (fd_limit - 64) / 5 : 0;
+    if (max_children > fd_cap) {
+        std::cerr << "RLIMIT_NOFILE allows " << fd_cap << " children at once; capping the ramp.\n";
+        max_children = fd_cap;
+    }
+
+    Progress progress;
+    auto     baseline = sample_resources();
+    bool     failed   = false;
+    auto     fail     = [&](const std::string& reason) {
+        std::cerr << "FAIL: " << reason << "\n";
+        failed = true;
+    };
+
+    std::vector<std::size_t> steps;
+    for (std::size_t count = min_children; count < max_children; count *= factor)
+        steps.push_back(count);
+    steps.push_back(max_children);
+
+    for (auto count : steps) {
+        StepResult result;
+        Resources  peak;
+        {
+            Sampler sampler(progress, std::chrono::milliseconds(interval_ms));
+            result = run_step(count, progress);
+            peak   = sampler.peak();
+        }
+        auto after = sample_resources();
+        peak.threads = std::max(peak.threads, after.threads);
+        peak.rss_kb  = std::max(peak.rss_kb, after.rss_kb);
+        std::cout << "{\"step\": true"
+                  << ", \"children\": " << result.children
+                  << ", \"failures\": " << result.failures
+                  << ", \"lost_bytes\": " << result.lost_bytes
+                  << ", \"spawns_per_s\": " << result.children / result.spawn_s
+                  << ", \"total_s\": " << result.total_s
+                  << ", \"reap_p50_ms\": " << result.reap_p50
+                  << ", \"reap_max_ms\": " << result.reap_max
+                  << ", \"peak_threads\": " << peak.threads
+                  << ", \"peak_fds\": " << peak.fds
+                  << ", \"peak_rss_kb\": " << peak.rss_kb
+                  << ", \"fds_after\": " << after.fds
+                  << "}" << std::endl;
+
+        std::string step = "step of " + std::to_string(count) + " children: ";
+        if (result.failures > 0)
+            fail(step + std::to_string(result.failures) + " children failed");
+        if (result.lost_bytes > 0)
+            fail(step + std::to_string(result.lost_bytes) + " bytes of output lost");
+        /** The sampling thread comes on top of the threads of the library. */
+        if (peak.threads > max_threads + 1)
+            fail(step + "peak of " + std::to_string(peak.threads) + " threads");
+        if (peak.rss_kb > max_rss_mb * 1024)
+            fail(step + "peak RSS of " + std::to_string(peak.rss_kb / 1024) + " MiB");
+        if (after.fds > baseline.fds)
+            fail(step + std::to_string(after.fds - baseline.fds) + " descriptors leaked");
+        if (has_children())
+            fail(step + "children left unreaped");
+        if (failed)
+            break;
+    }
+    return failed ? 1 : 0;
+}
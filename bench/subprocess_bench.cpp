@@ -0,0 +1,302 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "subprocess/async.h"
+#include "subprocess/command.h"
+#include "subprocess/coprocess.h"
+#include "subprocess/pool.h"
+#include "subprocess/popen.h"
+#include "subprocess/streamable.h"
+#include "subprocess/transform.h"
+
+/** Performance baseline of the library, built on Google Benchmark.
+ *
+ *  Children are instances of the echo_sink helper, which moves data with raw read(2)/write(2)
+ *  so that the parent side dominates the measurements. Results are printed in JSON with
+ *  `--benchmark_format=json` or written with `--benchmark_out=<file>`; see the README for
+ *  comparing two builds.
+ */
+
+namespace {
+
+const char* helper = SUBPROCESS_BENCH_HELPER;
+
+std::size_t resident_bytes() {
+    std::size_t size = 0, resident = 0;
+    if (FILE* fp = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(fp, "%zu %zu", &size, &resident) != 2)
+            resident = 0;
+        std::fclose(fp);
+    }
+    return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+/** Scratch file for the File/IStream/OStream benchmarks, removed at exit. */
+std::filesystem::path scratch_file(std::size_t size) {
+    static std::filesystem::path path = std::filesystem::temp_directory_path() / ("subprocess_bench_" + std::to_string(::getpid()));
+    static struct Remove {
+        ~Remove() { std::filesystem::remove(path); }
+    } remove;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::vector<char> chunk(1 << 16, 'x');
+    for (std::size_t written = 0; written < size; written += chunk.size())
+        out.write(chunk.data(), std::min(chunk.size(), size - written));
+    return path;
+}
+
+/** Time of the Popen constructor (fork until exec) against the parent's resident set. */
+void BM_Spawn(benchmark::State& state) {
+    std::vector<char> ballast(static_cast<std::size_t>(state.range(0)) << 20, 1);
+    benchmark::DoNotOptimize(ballast.data());
+
+    for (auto _ : state) {
+        auto start_time = std::chrono::steady_clock::now();
+        subprocess::Popen p(subprocess::PopenConfig(subprocess::types::args_t(helper, "exit")));
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        state.SetIterationTime(elapsed.count());
+        p.wait();
+    }
+    state.counters["rss_mib"] = static_cast<double>(resident_bytes()) / (1 << 20);
+}
+BENCHMARK(BM_Spawn)->Arg(0)->Arg(64)->Arg(512)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+/** Same as BM_Spawn/0, from a CommandTemplate prepared once. */
+void BM_CommandSpawn(benchmark::State& state) {
+    subprocess::CommandTemplate command(subprocess::PopenConfig(subprocess::types::args_t(helper, "{0}")));
+    for (auto _ : state) {
+        auto start_time = std::chrono::steady_clock::now();
+        subprocess::Popen p = command.spawn({"exit"});
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        state.SetIterationTime(elapsed.count());
+        p.wait();
+    }
+}
+BENCHMARK(BM_CommandSpawn)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+/** Time for wait() to notice a child that has already exited. */
+void BM_WaitLatency(benchmark::State& state) {
+    for (auto _ : state) {
+        subprocess::Popen p(subprocess::PopenConfig(subprocess::types::args_t(helper, "exit")));
+        ::siginfo_t info{};
+        ::waitid(P_PID, p.pid(), &info, WEXITED | WNOWAIT);
+
+        auto start_time = std::chrono::steady_clock::now();
+        p.wait();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        state.SetIterationTime(elapsed.count());
+    }
+}
+BENCHMARK(BM_WaitLatency)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+/** communicate() of a payload to a child that discards it. */
+void BM_Communicate(benchmark::State& state) {
+    subprocess::Bytes input(state.range(0), 'x');
+    for (auto _ : state) {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t(helper, "sink"),
+            subprocess::types::std_in_t(subprocess::types::IOOption::PIPE)
+        ));
+        p.communicate(input);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Communicate)->RangeMultiplier(32)->Range(1 << 10, 1 << 30)->Unit(benchmark::kMillisecond);
+
+/** async_communicate() of a payload echoed back by the child. */
+void BM_CommunicateEcho(benchmark::State& state) {
+    subprocess::EventLoop loop;
+    subprocess::Bytes input(state.range(0), 'x');
+    for (auto _ : state) {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t(helper, "echo"),
+            subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+            subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+        ));
+        auto output = loop.run_until_complete(p.async_communicate(input));
+        benchmark::DoNotOptimize(output);
+    }
+    state.SetBytesProcessed(2 * state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CommunicateEcho)->RangeMultiplier(32)->Range(1 << 10, 1 << 25)->Unit(benchmark::kMillisecond);
+
+void BM_FileRead(benchmark::State& state) {
+    auto path = scratch_file(state.range(0));
+    for (auto _ : state) {
+        subprocess::File file(std::fopen(path.c_str(), "r"));
+        benchmark::DoNotOptimize(file.read(state.range(0)));
+        file.close();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FileRead)->RangeMultiplier(64)->Range(1 << 10, 1 << 28)->Unit(benchmark::kMicrosecond);
+
+void BM_IStreamRead(benchmark::State& state) {
+    auto path = scratch_file(state.range(0));
+    for (auto _ : state) {
+        std::ifstream in(path, std::ios::binary);
+        subprocess::IStream stream(&in);
+        benchmark::DoNotOptimize(stream.read(state.range(0)));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IStreamRead)->RangeMultiplier(64)->Range(1 << 10, 1 << 28)->Unit(benchmark::kMicrosecond);
+
+void BM_FileWrite(benchmark::State& state) {
+    auto path = scratch_file(0);
+    subprocess::Bytes buf(state.range(0), 'x');
+    for (auto _ : state) {
+        subprocess::File file(std::fopen(path.c_str(), "w"));
+        benchmark::DoNotOptimize(file.write(buf, buf.size()));
+        file.close();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FileWrite)->RangeMultiplier(64)->Range(1 << 10, 1 << 28)->Unit(benchmark::kMicrosecond);
+
+void BM_OStreamWrite(benchmark::State& state) {
+    auto path = scratch_file(0);
+    subprocess::Bytes buf(state.range(0), 'x');
+    for (auto _ : state) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        subprocess::OStream stream(&out);
+        benchmark::DoNotOptimize(stream.write(buf, buf.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_OStreamWrite)->RangeMultiplier(64)->Range(1 << 10, 1 << 28)->Unit(benchmark::kMicrosecond);
+
+/** Throughput of a chain of line-based transforms writing to /dev/null. */
+void BM_TransformChain(benchmark::State& state) {
+    std::string text;
+    while (text.size() < static_cast<std::size_t>(state.range(0)))
+        text += "line " + std::to_string(text.size()) + "\n";
+    subprocess::Bytes buf(text.begin(), text.end());
+    auto sink = std::make_shared<subprocess::File>(std::fopen("/dev/null", "w"));
+    for (auto _ : state) {
+        subprocess::TransformChain chain(sink);
+        chain.add(std::make_shared<subprocess::LineTransform>())
+             .add(std::make_shared<subprocess::PrefixTransform>("[job] "));
+        benchmark::DoNotOptimize(chain.write(buf, buf.size()));
+        chain.close();
+    }
+    sink->close();
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_TransformChain)->RangeMultiplier(64)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMicrosecond);
+
+/** read_all() of a child's output of unknown size, growing its buffer by doubling. */
+void BM_ReadAll(benchmark::State& state) {
+    for (auto _ : state) {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t(helper, "produce", std::to_string(state.range(0))),
+            subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+        ));
+        benchmark::DoNotOptimize(p.std_out().value()->read_all());
+        p.wait();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReadAll)->RangeMultiplier(32)->Range(1 << 10, 1 << 30)->Unit(benchmark::kMillisecond);
+
+/** Baseline for BM_ReadAll: the same output read into a buffer sized upfront. */
+void BM_ReadKnownSize(benchmark::State& state) {
+    for (auto _ : state) {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t(helper, "produce", std::to_string(state.range(0))),
+            subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+        ));
+        benchmark::DoNotOptimize(p.std_out().value()->read(state.range(0)));
+        p.wait();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReadKnownSize)->RangeMultiplier(32)->Range(1 << 10, 1 << 30)->Unit(benchmark::kMillisecond);
+
+/** The same output read through a PipeIStream, as iostream-based parsers would. */
+void BM_PipeIStreamRead(benchmark::State& state) {
+    std::vector<char> buf(1 << 16);
+    for (auto _ : state) {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t(helper, "produce", std::to_string(state.range(0))),
+            subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+        ));
+        subprocess::PipeIStream out(*p.std_out().value());
+        while (out.read(buf.data(), buf.size()) || out.gcount() > 0)
+            benchmark::DoNotOptimize(buf.data());
+        p.wait();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PipeIStreamRead)->RangeMultiplier(32)->Range(1 << 10, 1 << 30)->Unit(benchmark::kMillisecond);
+
+/** run() capturing a child's output, with its buffer pre-sized from the capture_output_t hint. */
+void BM_RunCapture(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(subprocess::run(
+            subprocess::types::args_t(helper, "produce", std::to_string(state.range(0))),
+            subprocess::types::capture_output_t(true, state.range(0))
+        ));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RunCapture)->RangeMultiplier(32)->Range(1 << 10, 1 << 30)->Unit(benchmark::kMillisecond);
+
+/** Throughput of a ProcessPool with the given number of workers running short jobs. */
+void BM_PoolThroughput(benchmark::State& state) {
+    constexpr int jobs_per_iteration = 256;
+    subprocess::ProcessPool pool(state.range(0));
+    for (auto _ : state) {
+        std::vector<subprocess::ProcessPool::Job> jobs;
+        jobs.reserve(jobs_per_iteration);
+        for (int i = 0; i < jobs_per_iteration; ++i)
+            jobs.push_back(pool.submit(subprocess::PopenConfig(subprocess::types::args_t(helper, "exit"))));
+        for (auto& job : jobs)
+            benchmark::DoNotOptimize(job.result.get());
+    }
+    state.counters["jobs_per_second"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * jobs_per_iteration), benchmark::Counter::kIsRate
+    );
+}
+BENCHMARK(BM_PoolThroughput)->RangeMultiplier(4)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+/** Round trip of one request to a Coprocess echoing it back, to compare with spawning per request. */
+void BM_CoprocessRequest(benchmark::State& state) {
+    subprocess::Coprocess worker(subprocess::PopenConfig(subprocess::types::args_t(helper, "echo")));
+    subprocess::Bytes request(state.range(0), 'x');
+    for (auto _ : state)
+        benchmark::DoNotOptimize(worker.request(request));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CoprocessRequest)->Arg(64)->Arg(1 << 16)->Unit(benchmark::kMicrosecond);
+
+/** Requests kept in flight up to the back-pressure limit given as argument. */
+void BM_CoprocessPipelined(benchmark::State& state) {
+    constexpr int requests_per_iteration = 1024;
+    subprocess::Coprocess worker(
+        subprocess::PopenConfig(subprocess::types::args_t(helper, "echo")),
+        subprocess::Framing::LENGTH_PREFIXED, state.range(0)
+    );
+    subprocess::Bytes request(64, 'x');
+    std::vector<std::future<subprocess::Bytes>> responses(requests_per_iteration);
+    for (auto _ : state) {
+        for (auto& response : responses)
+            response = worker.send(request);
+        for (auto& response : responses)
+            benchmark::DoNotOptimize(response.get());
+    }
+    state.SetItemsProcessed(state.iterations() * requests_per_iteration);
+}
+BENCHMARK(BM_CoprocessPipelined)->Arg(1)->Arg(16)->Arg(256)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -1,5 +1,13 @@
+#include "subprocess/async.h"
 #include "subprocess/bytes.h"
+#include "subprocess/command.h"
+#include "subprocess/coprocess.h"
+#include "subprocess/deadline.h"
 #include "subprocess/exception.h"
+#include "subprocess/io_uring.h"
+#include "subprocess/pool.h"
 #include "subprocess/popen.h"
+#include "subprocess/stats.h"
 #include "subprocess/streamable.h"
+#include "subprocess/transform.h"
 #include "subprocess/types.h"
\ No newline at end of file
@@ -0,0 +1,304 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace subprocess {
+
+template<typename T = void>
+class Task;
+
+/* ===================================== Details ===================================== */
+
+namespace detail {
+
+/** @brief Resumes the awaiting coroutine (if any) once a task finishes. */
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        auto continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter        final_suspend() noexcept { return {}; }
+    void                unhandled_exception() noexcept { exception = std::current_exception(); }
+
+    std::coroutine_handle<> continuation = nullptr;
+    std::exception_ptr      exception    = nullptr;
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    template<typename U>
+    void return_value(U&& value) { result.emplace(std::forward<U>(value)); }
+    T    take() { return std::move(*result); }
+
+    std::optional<T> result;
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    void return_void() noexcept {}
+    void take() noexcept {}
+};
+
+/** @brief Fire-and-forget coroutine used to drive tasks that nobody awaits. */
+struct Detached {
+    struct promise_type {
+        Detached            get_return_object() noexcept { return {}; }
+        std::suspend_never  initial_suspend() noexcept { return {}; }
+        std::suspend_never  final_suspend() noexcept { return {}; }
+        void                return_void() noexcept {}
+        void                unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+/** @brief Countdown awaited by a single coroutine until `count` arrivals happened. */
+class Latch {
+public:
+    explicit Latch(std::size_t count) : count_(count + 1) {}
+
+    void arrive() noexcept {
+        if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            waiter_.resume();
+    }
+
+    bool await_ready() const noexcept { return count_.load(std::memory_order_acquire) == 1; }
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+        waiter_ = handle;
+        return count_.fetch_sub(1, std::memory_order_acq_rel) > 1;
+    }
+    void await_resume() const noexcept {}
+
+private:
+    std::atomic<std::size_t> count_;
+    std::coroutine_handle<>  waiter_;
+};
+
+} // namespace detail
+
+/* ===================================== Task ===================================== */
+
+/** @brief A lazily started coroutine producing a value of type `T`.
+ *
+ *  The coroutine body does not run until the task is awaited (or handed to
+ *  EventLoop::spawn / EventLoop::run_until_complete). Exceptions thrown by the
+ *  body are rethrown to the awaiting coroutine.
+ */
+template<typename T>
+class Task {
+public:
+    struct promise_type : detail::Promise<T> {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    ~Task() { if (handle_) handle_.destroy(); }
+    Task() : handle_(nullptr) {}
+    Task(const Task& other)                = delete;
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    Task& operator=(const Task& other)     = delete;
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    bool done() const noexcept { return !handle_ || handle_.done(); }
+
+    bool                    await_ready() const noexcept { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T                       await_resume() { return result(); }
+
+    /** @brief Returns an awaitable that completes with the task without consuming its result. */
+    auto when_ready() noexcept {
+        struct Awaiter {
+            handle_type             handle;
+            bool                    await_ready() const noexcept { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            void                    await_resume() const noexcept {}
+        };
+        return Awaiter{handle_};
+    }
+
+    /** @brief Retrieves the result of a finished task, rethrowing its exception if any. */
+    T result() {
+        auto& promise = handle_.promise();
+        if (promise.exception)
+            std::rethrow_exception(promise.exception);
+        return promise.take();
+    }
+
+private:
+    explicit Task(handle_type handle) : handle_(handle) {}
+
+    handle_type handle_;
+};
+
+/** @brief Awaits all given tasks concurrently and returns their results as a tuple. */
+template<typename... Ts>
+Task<std::tuple<Ts...>> when_all(Task<Ts>... tasks) {
+    detail::Latch latch(sizeof...(Ts));
+    auto drive = []<typename T>(Task<T>& task, detail::Latch& latch) -> detail::Detached {
+        co_await task.when_ready();
+        latch.arrive();
+    };
+    (drive(tasks, latch), ...);
+    co_await latch;
+    co_return std::tuple<Ts...>{tasks.result()...};
+}
+
+/* ===================================== EventLoop ===================================== */
+
+/** @brief Minimal single-threaded scheduler driving coroutines with epoll.
+ *
+ *  Coroutines suspend on readiness of a file descriptor or on the exit of a process
+ *  (observed through a pidfd, or by periodic `waitid` polling on kernels without
+ *  pidfd support). Any number of pipes and processes can be multiplexed on the thread
+ *  calling run(), and several loops can run on different threads.
+ *
+ *  Integration with external executors:
+ *  - set_executor() routes every resumption through a user callback (e.g. a thread pool).
+ *  - fileno() exposes the epoll descriptor so that a foreign reactor can watch it and
+ *    call run_once(0) when it becomes readable.
+ *
+ *  @note Registrations and post() are thread-safe; run() and run_once() must be called
+ *        from one thread at a time.
+ */
+class EventLoop {
+public:
+    using Executor = std::function<void(std::coroutine_handle<>)>;
+
+    ~EventLoop();
+    EventLoop();
+    EventLoop(const EventLoop& other)                = delete;
+    EventLoop(EventLoop&& other) noexcept            = delete;
+
+    EventLoop& operator=(const EventLoop& other)     = delete;
+    EventLoop& operator=(EventLoop&& other) noexcept = delete;
+
+    /** @brief Returns the loop running on the calling thread, or the process-wide default loop. */
+    static EventLoop& current();
+
+    /** @brief Returns the epoll file descriptor, readable whenever run_once() has work to do. */
+    int         fileno() const;
+    /** @brief Routes resumptions through `executor` instead of resuming them inline. */
+    void        set_executor(Executor executor);
+
+    /** @brief Schedules a task on this loop without waiting for it.
+     *  Exceptions escaping the task are rethrown by run(). */
+    void        spawn(Task<void> task);
+    /** @brief Runs the loop until `task` finishes and returns its result. */
+    template<typename T>
+    T           run_until_complete(Task<T> task);
+    /** @brief Runs the loop until every spawned task has finished. */
+    void        run();
+    /** @brief Waits for events at most `timeout` seconds (negative: indefinitely) and dispatches them.
+     *  @return The number of resumed coroutines. */
+    std::size_t run_once(double timeout = -1);
+
+    /** @brief Resumes `handle` on the next iteration of the loop. Thread-safe. */
+    void        post(std::coroutine_handle<> handle);
+
+    /** @brief Awaitable that reschedules the awaiting coroutine onto this loop. */
+    auto schedule() {
+        struct Awaiter {
+            EventLoop& loop;
+            bool       await_ready() const noexcept { return false; }
+            void       await_suspend(std::coroutine_handle<> handle) { loop.post(handle); }
+            void       await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+    /** @brief Awaitable completing once `fd` is readable, at EOF or in error. */
+    auto readable(int fd) { return FdAwaiter{*this, fd, false}; }
+    /** @brief Awaitable completing once `fd` is writable or in error. */
+    auto writable(int fd) { return FdAwaiter{*this, fd, true};  }
+    /** @brief Awaitable completing once the child `pid` has exited. The child is not reaped. */
+    auto exited(::pid_t pid) {
+        struct Awaiter {
+            EventLoop& loop;
+            ::pid_t    pid;
+            bool       await_ready() const noexcept { return false; }
+            bool       await_suspend(std::coroutine_handle<> handle) { return loop.watch_process(pid, handle); }
+            void       await_resume() const noexcept {}
+        };
+        return Awaiter{*this, pid};
+    }
+
+private:
+    struct FdAwaiter {
+        EventLoop& loop;
+        int        fd;
+        bool       write;
+        bool       await_ready() const noexcept { return false; }
+        bool       await_suspend(std::coroutine_handle<> handle) { return loop.watch(fd, write, handle); }
+        void       await_resume() const noexcept {}
+    };
+
+    struct Watch {
+        std::coroutine_handle<> reader = nullptr;
+        std::coroutine_handle<> writer = nullptr;
+    };
+
+    /** Returns false if `fd` cannot be polled (e.g. a regular file), meaning it is always ready. */
+    bool watch(int fd, bool write, std::coroutine_handle<> handle);
+    /** Returns false if the process has already exited. */
+    bool watch_process(::pid_t pid, std::coroutine_handle<> handle);
+    void rearm(int fd, const Watch& watch);
+    void dispatch(std::coroutine_handle<> handle);
+
+    int                                               epoll_fd_;
+    int                                               event_fd_;
+    std::mutex                                        mutex_;
+    std::deque<std::coroutine_handle<>>               ready_;
+    std::unordered_map<int, Watch>                    watches_;
+    std::unordered_map<int, std::coroutine_handle<>>  pidfds_;
+    std::vector<std::pair<::pid_t, std::coroutine_handle<>>> polled_;
+    Executor                                          executor_;
+    std::atomic<std::size_t>                          pending_;
+    std::exception_ptr                                error_;
+};
+
+template<typename T>
+T EventLoop::run_until_complete(Task<T> task) {
+    bool done = false;
+    spawn([](Task<T>& task, bool& done) -> Task<void> {
+        co_await task.when_ready();
+        done = true;
+    }(task, done));
+    while (!done)
+        run_once();
+    return task.result();
+}
+
+} // namespace subprocess
+
+#endif
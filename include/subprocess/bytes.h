@@ -50,6 +50,42 @@ private:
     std::vector<value_type> bytes_;
 };
 
+/** @brief A read-only, memory-mapped view of a whole file.
+ *
+ *  The file is mapped once at construction; no data is copied. Files created with 
+ *  `memfd_create(MFD_ALLOW_SEALING)` are sealed against writes, growth and shrinking first, 
+ *  so that the view cannot change afterwards.
+ */
+class MappedBytes {
+public:
+    using value_type = Bytes::value_type;
+    using size_type  = Bytes::size_type;
+
+    ~MappedBytes();
+    /** @throws OSError If the file cannot be inspected or mapped. */
+    explicit MappedBytes(int fd);
+    MappedBytes(const MappedBytes& other)                = delete;
+    MappedBytes(MappedBytes&& other) noexcept;
+
+    MappedBytes&      operator=(const MappedBytes& other)     = delete;
+    MappedBytes&      operator=(MappedBytes&& other) noexcept;
+
+    const value_type& operator[](size_type n) const;
+
+    size_type         size() const;
+    bool              empty() const;
+
+    const value_type* data() const;
+    const value_type* begin() const;
+    const value_type* end() const;
+    /** @brief Copies the mapped data into a Bytes. */
+    Bytes             to_bytes() const;
+
+private:
+    const value_type* data_;
+    size_type         size_;
+};
+
 }
 
 #endif
\ No newline at end of file
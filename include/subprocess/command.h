@@ -0,0 +1,96 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "subprocess/popen.h"
+
+namespace subprocess {
+
+namespace detail {
+
+/** @brief Immutable spawn plan shared by a CommandTemplate and the processes it spawned. */
+struct CommandPlan {
+    /** How a standard stream is recreated for each spawn. */
+    enum class Redirect { NONE, PIPE, STDOUT, SHARED };
+
+    struct Stream {
+        Redirect                     redirect     = Redirect::NONE;
+        bool                         non_blocking = false;
+        /** Streams duplicated in every child with Redirect::SHARED. */
+        std::shared_ptr<IStreamable> source;
+        std::shared_ptr<OStreamable> destination;
+    };
+
+    /** Returns a configuration with fresh pipes, without args. */
+    PopenConfig instantiate() const;
+
+    /** Arguments as given, placeholders included. */
+    std::vector<std::string>                         args;
+    /** Resolved path of the program. */
+    std::string                                      executable;
+    /** `argv` with placeholders set to nullptr, terminated by nullptr. */
+    std::vector<char*>                               argv;
+    /** Pairs of (index in argv, index of the value). */
+    std::vector<std::pair<std::size_t, std::size_t>> holes;
+    std::size_t                                      arity = 0;
+
+    Stream                                           streams[3];
+    types::bufsize_t                                 bufsize    = types::bufsize_t(-1);
+    types::preexec_fn_t                              preexec_fn = types::preexec_fn_t(nullptr);
+    types::rlimit_t                                  rlimit;
+    types::sched_t                                   sched;
+    types::pass_fds_t                                pass_fds;
+};
+
+} // namespace detail
+
+/** @brief A command prepared once and spawned many times.
+ *
+ *  A PopenConfig is consumed by a single spawn. A CommandTemplate instead validates it once,
+ *  resolves the program against `PATH` and builds the `argv` array upfront. Each spawn then
+ *  only fills in the placeholders and opens fresh pipes: no string is copied or parsed.
+ *
+ *  An argument that is exactly `{N}` is a placeholder for the N-th value given to spawn();
+ *  N must be below the number of arguments.
+ *  The standard streams may be NONE, PIPE, DEVNULL, STDOUT (stderr only) or a file descriptor,
+ *  which is then shared by every spawned process, offset included. Streams that need a thread
+ *  of the parent (`std::istream`, `std::ostream`) or a capture_t are rejected, and so are the
+ *  pipes of a pass_fds_t: its plain file descriptors are shared like the standard streams.
+ *
+ *  @code
+ *  CommandTemplate gzip(PopenConfig(args_t("gzip", "-c", "{0}"), std_out_t(IOOption::PIPE)));
+ *  for (auto& file : files) {
+ *      Popen p = gzip.spawn({file});
+ *      auto [std_out_data, std_err_data] = p.communicate(Bytes());
+ *  }
+ *  @endcode
+ */
+class CommandTemplate {
+public:
+    /** @throws std::invalid_argument If `config` is incomplete, a placeholder is out of range or one
+     *          of its streams cannot be reused.
+     *  @throws OSError If the program cannot be found or is not executable. */
+    explicit CommandTemplate(PopenConfig&& config);
+
+    /** @brief Spawns the command with `values` substituted for its placeholders. Thread-safe.
+     *  @throws std::invalid_argument If the number of values does not match placeholders(). */
+    Popen              spawn(std::vector<std::string> values = {}) const;
+
+    /** @brief Number of values expected by spawn(). */
+    std::size_t        placeholders() const;
+    /** @brief Resolved path of the program. */
+    const std::string& executable() const;
+
+private:
+    friend class Popen;
+
+    std::shared_ptr<const detail::CommandPlan> plan_;
+};
+
+} // namespace subprocess
+
+#endif
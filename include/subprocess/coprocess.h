@@ -0,0 +1,117 @@
+#ifndef COPROCESS_H
+#define COPROCESS_H
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "subprocess/bytes.h"
+#include "subprocess/popen.h"
+#include "subprocess/streamable.h"
+
+namespace subprocess {
+
+/** @brief How messages are delimited on the pipes of a Coprocess. */
+enum class Framing {
+    /** Each message is preceded by its size as a 4-byte big-endian unsigned integer. */
+    LENGTH_PREFIXED,
+    /** Each message is terminated by '\n', which messages must not contain. */
+    NEWLINE
+};
+
+/** @brief A long-running child serving requests over its stdin and stdout.
+ *
+ *  The child is started once and exchanges framed messages with the parent: each request
+ *  written to its stdin is answered by one response on its stdout, in the same order. Requests
+ *  can be pipelined: send() returns as soon as the request is written, and a reader thread
+ *  matches responses to the oldest outstanding request.
+ *
+ *  Back-pressure: at most `max_in_flight` requests are outstanding; send() blocks until a
+ *  response frees a slot (and, like any write to a pipe, while the child is not reading).
+ *
+ *  @code
+ *  Coprocess worker(PopenConfig(args_t("/usr/bin/my-worker")), Framing::NEWLINE);
+ *  auto first  = worker.send(request1);
+ *  auto second = worker.send(request2);
+ *  Bytes response1 = first.get();
+ *  @endcode
+ */
+class Coprocess {
+public:
+    /** Closes the coprocess, killing the child if it does not exit within 5 seconds of EOF. */
+    ~Coprocess();
+    /** @brief Starts the child.
+     *
+     *  The stdin and stdout of `config` are replaced with pipes owned by the coprocess, unless 
+     *  stdin is a socketpair (see socketpair_t): the child then talks over a single socket.
+     *
+     *  @param config        Configuration of the child.
+     *  @param framing       Framing of requests and responses.
+     *  @param max_in_flight Maximum number of requests awaiting a response (at least 1).
+     */
+    Coprocess(PopenConfig&& config, Framing framing = Framing::LENGTH_PREFIXED, std::size_t max_in_flight = 64);
+    Coprocess(const Coprocess& other)                = delete;
+    Coprocess(Coprocess&& other) noexcept            = delete;
+
+    Coprocess& operator=(const Coprocess& other)     = delete;
+    Coprocess& operator=(Coprocess&& other) noexcept = delete;
+
+    /** @brief Writes a request and returns the future of its response. Thread-safe.
+     *
+     *  The future holds std::runtime_error if the child closes its stdout before responding.
+     *  @throws std::invalid_argument If `message` cannot be framed.
+     *  @throws std::runtime_error If the coprocess is closed or the child has exited.
+     */
+    std::future<Bytes> send(const Bytes& message);
+    /** @brief Sends a request and waits for its response. */
+    Bytes              request(const Bytes& message);
+
+    /** @brief Closes the stdin of the child and waits for it to exit.
+     *
+     *  Outstanding requests still receive their responses.
+     *  @param timeout Maximum time to wait in seconds (default: -1, meaning wait indefinitely).
+     *  @return The returncode of the child.
+     *  @throws TimeoutExpired If the child does not exit within the timeout.
+     */
+    std::optional<int> close(double timeout = -1);
+
+    /** @brief Number of requests awaiting a response. */
+    std::size_t        in_flight() const;
+    Popen&             popen();
+
+private:
+    static PopenConfig&& with_pipes(PopenConfig& config);
+
+    Bytes                frame(const Bytes& message) const;
+    /** Returns std::nullopt at EOF. */
+    std::optional<Bytes> read_frame();
+    void                 read_responses();
+
+    Popen                           popen_;
+    Framing                         framing_;
+    std::size_t                     max_in_flight_;
+    std::shared_ptr<OStreamable>    writer_;
+    std::shared_ptr<IStreamable>    reader_;
+
+    std::mutex                      write_mutex_;
+    mutable std::mutex              mutex_;
+    std::condition_variable         not_full_;
+    std::deque<std::promise<Bytes>> pending_;
+    /** Set once no more responses can arrive. */
+    std::exception_ptr              error_;
+    bool                            closed_ = false;
+
+    /** Data read past the last newline-delimited response, from `line_start_`. */
+    std::string                     lines_;
+    std::size_t                     line_start_ = 0;
+    std::thread                     reader_thread_;
+};
+
+} // namespace subprocess
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "subprocess/popen.h"
+
+namespace subprocess {
+
+/** @brief Enforces deadlines on many children from a single thread.
+ *
+ *  Deadlines are kept in a hashed timer wheel advanced by a periodic `timerfd`, which is
+ *  disarmed while no deadline is pending. When a deadline expires, the child is sent SIGTERM;
+ *  if it is still running after its grace period, it is sent SIGKILL. Each deadline takes a
+ *  fixed-size slot, and adding or cancelling one is O(1).
+ *
+ *  The manager only signals children: reaping them is left to their owner (e.g. Popen::wait()).
+ *  A child that has already exited, or that is not a child of this process, is never signaled.
+ *  Signals go through a pidfd opened by add(), so a deadline outliving its process cannot hit
+ *  a recycled pid; on kernels without pidfd (before 5.3), they fall back to kill(2), and a pid
+ *  reaped and recycled between the check and the signal may still be hit.
+ *
+ *  @code
+ *  DeadlineManager deadlines;
+ *  Popen p(PopenConfig(args_t("make")));
+ *  auto id = deadlines.add(p, std::chrono::seconds(30));
+ *  p.wait();
+ *  deadlines.cancel(id);
+ *  @endcode
+ */
+class DeadlineManager {
+public:
+    using DeadlineId = std::uint64_t;
+    using Clock      = std::chrono::steady_clock;
+
+    /** @brief A signal sent by the manager. */
+    struct Escalation {
+        DeadlineId        id;
+        ::pid_t           pid;
+        /** SIGTERM once the deadline expired, SIGKILL once the grace period expired. */
+        int               signal;
+        Clock::time_point time;
+    };
+
+    /** Stops the manager; pending deadlines are dropped. */
+    ~DeadlineManager();
+    /** @param tick  Resolution of the deadlines.
+     *  @param slots Number of slots of the wheel; deadlines further than `slots` ticks
+     *               share slots with closer ones and are skipped until their turn.
+     *  @param grace Default time between SIGTERM and SIGKILL.
+     *  @throws std::invalid_argument If `tick` is not positive or `slots` is 0.
+     *  @throws OSError If the timerfd cannot be created.
+     */
+    explicit DeadlineManager(
+        std::chrono::milliseconds tick  = std::chrono::milliseconds(10),
+        std::size_t               slots = 512,
+        std::chrono::milliseconds grace = std::chrono::seconds(5)
+    );
+    DeadlineManager(const DeadlineManager& other)                = delete;
+    DeadlineManager(DeadlineManager&& other) noexcept            = delete;
+
+    DeadlineManager& operator=(const DeadlineManager& other)     = delete;
+    DeadlineManager& operator=(DeadlineManager&& other) noexcept = delete;
+
+    /** @brief Starts a deadline of `timeout` for the child `pid`. Thread-safe.
+     *
+     *  The child is signaled between `timeout` and `timeout` plus one tick from now.
+     *  @param grace Time between SIGTERM and SIGKILL; a zero grace period sends SIGKILL directly.
+     *  @throws OSError If the timer cannot be armed for the first pending deadline.
+     */
+    DeadlineId  add(::pid_t pid, std::chrono::milliseconds timeout, std::chrono::milliseconds grace);
+    DeadlineId  add(::pid_t pid, std::chrono::milliseconds timeout);
+    DeadlineId  add(const Popen& popen, std::chrono::milliseconds timeout);
+    /** @brief Cancels a deadline, including a pending SIGKILL. Thread-safe.
+     *  @return false if the deadline has completed or is unknown. */
+    bool        cancel(DeadlineId id);
+
+    /** @brief Returns the signals sent since the last call, oldest first. */
+    std::vector<Escalation> take_escalations();
+    /** @brief Number of deadlines awaiting expiry or a pending SIGKILL. */
+    std::size_t size() const;
+
+private:
+    static constexpr std::uint32_t npos = UINT32_MAX;
+
+    struct Entry {
+        ::pid_t                   pid        = 0;
+        /** Owned while the entry is active, -1 if pidfd_open(2) failed. */
+        int                       pidfd      = -1;
+        std::uint32_t             generation = 0;
+        std::uint64_t             expiry     = 0;
+        std::chrono::milliseconds grace      = std::chrono::milliseconds(0);
+        /** Links in the slot's list while pending, in the free list otherwise. */
+        std::uint32_t             prev       = npos;
+        std::uint32_t             next       = npos;
+        bool                      terminated = false;
+        bool                      active     = false;
+    };
+
+    void          run();
+    /** Advances the wheel by one tick and fires the expired deadlines. */
+    void          advance();
+    void          schedule(std::uint32_t index, std::uint64_t ticks);
+    void          unlink(std::uint32_t index);
+    void          release(std::uint32_t index);
+    std::uint64_t to_ticks(std::chrono::milliseconds duration) const;
+    /** @return false, with errno set, if the timerfd cannot be set. */
+    bool          set_timer(bool armed);
+
+    std::chrono::milliseconds  tick_;
+    std::chrono::milliseconds  grace_;
+    int                        timer_fd_;
+    int                        event_fd_;
+
+    mutable std::mutex         mutex_;
+    std::vector<Entry>         entries_;
+    /** Head of the list of each slot. */
+    std::vector<std::uint32_t> slots_;
+    std::uint32_t              free_     = npos;
+    std::uint64_t              now_      = 0;
+    std::size_t                size_     = 0;
+    bool                       armed_    = false;
+    std::vector<Escalation>    escalations_;
+    std::thread                thread_;
+};
+
+} // namespace subprocess
+
+#endif
@@ -4,8 +4,13 @@
 #include <exception>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
+#include <string>
 #include <system_error>
+#include <vector>
+
+#include "subprocess/bytes.h"
 
 namespace subprocess {
 
@@ -52,6 +57,31 @@ public:
     : std::runtime_error(msg + " Timed out after " + std::to_string(timeout.count()) +" seconds.") {}
 };
 
+/** @brief C++ version of Python's CalledProcessError, raised by run() when `check` is set
+ *  and the process exits with a non-zero returncode. */
+class CalledProcessError : public std::runtime_error {
+public:
+    CalledProcessError(
+        int                      returncode,
+        std::vector<std::string> args,
+        std::optional<Bytes>     std_out = std::nullopt,
+        std::optional<Bytes>     std_err = std::nullopt
+    ) : std::runtime_error("Command '" + (args.empty() ? std::string() : args.front()) + 
+                           "' returned non-zero exit status " + std::to_string(returncode) + "."),
+        returncode(returncode), args(std::move(args)), std_out(std::move(std_out)), std_err(std::move(std_err)) {}
+
+    int                      returncode;
+    std::vector<std::string> args;
+    std::optional<Bytes>     std_out;
+    std::optional<Bytes>     std_err;
+};
+
+/** @brief Raised by the result of a job that was cancelled before it started, see ProcessPool::cancel(). */
+class CancelledError : public std::runtime_error {
+public:
+    CancelledError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
 }
 
 #endif
\ No newline at end of file
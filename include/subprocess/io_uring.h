@@ -0,0 +1,108 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include <signal.h>
+#include <sys/types.h>
+
+#include "subprocess/bytes.h"
+
+namespace subprocess {
+
+class File;
+
+/** @brief Selects how pipe transfers in communicate() and Popen::communicate() are performed.
+ *
+ *  - `BLOCKING` : Blocking `FILE*` reads and writes (default).
+ *  - `IO_URING` : Batched reads and writes submitted through io_uring. Falls back to
+ *                 `BLOCKING` when the kernel does not support io_uring.
+ *  - `AUTO`     : `IO_URING` when supported, `BLOCKING` otherwise.
+ */
+enum class IOBackend { BLOCKING, IO_URING, AUTO };
+
+/** @brief Sets the process-wide I/O backend. */
+void      set_io_backend(IOBackend backend);
+/** @brief Returns the effective I/O backend, never `AUTO`. */
+IOBackend io_backend();
+
+/** @brief Minimal io_uring instance built on raw system calls.
+ *
+ *  Requests are queued with the prep functions and handed to the kernel in a single
+ *  `io_uring_enter` by submit(). Each request carries a `user_data` tag that is
+ *  returned with its completion.
+ */
+class IoUring {
+public:
+    struct Completion {
+        std::uint64_t user_data;
+        int           res;
+    };
+
+    ~IoUring();
+    explicit IoUring(unsigned entries = 64);
+    IoUring(const IoUring& other)                = delete;
+    IoUring(IoUring&& other) noexcept            = delete;
+
+    IoUring& operator=(const IoUring& other)     = delete;
+    IoUring& operator=(IoUring&& other) noexcept = delete;
+
+    /** @brief Returns true if the running kernel allows creating an io_uring instance. */
+    static bool is_supported();
+    /** @brief Returns true if `IORING_OP_WAITID` is available (Linux 6.7 and later). */
+    static bool is_waitid_supported();
+
+    void        prep_read(int fd, void* buf, unsigned size, std::uint64_t user_data);
+    void        prep_write(int fd, const void* buf, unsigned size, std::uint64_t user_data);
+    /** @brief Waits for the exit of `pid` without reaping it (`WEXITED | WNOWAIT`). */
+    void        prep_waitid(::pid_t pid, ::siginfo_t* info, std::uint64_t user_data);
+    /** @brief Completes with `-ETIME` once `timeout` has elapsed. */
+    void        prep_timeout(std::chrono::nanoseconds timeout, std::uint64_t user_data);
+    void        prep_cancel(std::uint64_t target, std::uint64_t user_data);
+
+    /** @brief Submits queued requests and waits for at least `wait_nr` completions.
+     *  @throws OSError If `io_uring_enter` fails. */
+    void        submit(unsigned wait_nr = 0);
+    /** @brief Pops the next available completion, if any. */
+    std::optional<Completion> peek();
+
+    /** @brief Returns the number of `io_uring_enter` calls made by this instance. */
+    std::size_t        enter_count() const;
+    /** @brief Returns the number of `io_uring_enter` calls made by all instances in the process. */
+    static std::size_t total_enter_count();
+
+private:
+    struct Ring;
+
+    void*       next_sqe();
+
+    std::unique_ptr<Ring> ring_;
+};
+
+/** @brief Copies everything from `in` to `out` with pipelined io_uring reads and writes.
+ *  @return The number of bytes written. */
+Bytes::size_type io_uring_transfer(File& in, File& out);
+
+/** @brief Multiplexes the stdin, stdout and stderr pipes of `pid` on a single io_uring.
+ *
+ *  Writes `input` to `std_in` (closing it afterwards) while draining `std_out` and
+ *  `std_err` until EOF. The exit of the process is awaited in the same ring when
+ *  `IORING_OP_WAITID` is available; the process is never reaped here.
+ *
+ *  @return True if the exit of the process was observed.
+ *  @throws TimeoutExpired If `timeout` (seconds, negative for none) elapses first.
+ */
+bool io_uring_communicate(
+    ::pid_t pid,
+    File* std_in,  const Bytes& input,
+    File* std_out, Bytes& std_out_data,
+    File* std_err, Bytes& std_err_data,
+    double timeout
+);
+
+} // namespace subprocess
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <csignal>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "subprocess/async.h"
+#include "subprocess/bytes.h"
+#include "subprocess/popen.h"
+
+namespace subprocess {
+
+/** @brief Runs jobs described by a PopenConfig with at most `max_workers` children at a time.
+ *
+ *  Jobs are queued by priority (higher first, FIFO among equal priorities) and dispatched by a
+ *  thread of the pool running an EventLoop: a slot is refilled as soon as a child exits, which
+ *  the loop observes through a pidfd. Each job is run like Popen::async_communicate(), so its
+ *  output is captured when stdout or stderr is set to PIPE.
+ *
+ *  @code
+ *  ProcessPool pool(8);
+ *  auto job = pool.submit(PopenConfig(args_t("gzip", "-c", file), std_out_t(IOOption::PIPE)));
+ *  CompletedProcess result = job.result.get();
+ *  @endcode
+ */
+class ProcessPool {
+public:
+    using JobId = std::uint64_t;
+
+    struct Job {
+        JobId                         id;
+        /** Holds the CompletedProcess, the exception that prevented the job from running,
+         *  or CancelledError if the job was cancelled before it started. */
+        std::future<CompletedProcess> result;
+    };
+
+    /** Waits for every queued and running job, see shutdown(). */
+    ~ProcessPool();
+    /** @param max_workers Maximum number of children running at a time (default: number of CPUs). */
+    explicit ProcessPool(std::size_t max_workers = std::thread::hardware_concurrency());
+    ProcessPool(const ProcessPool& other)                = delete;
+    ProcessPool(ProcessPool&& other) noexcept            = delete;
+
+    ProcessPool& operator=(const ProcessPool& other)     = delete;
+    ProcessPool& operator=(ProcessPool&& other) noexcept = delete;
+
+    /** @brief Queues a job. Thread-safe.
+     *
+     *  @param config   Configuration of the process.
+     *  @param input    Data fed to stdin, which must then be a PIPE.
+     *  @param priority Jobs with a higher priority are started first.
+     *  @throws std::runtime_error If the pool has been shut down.
+     */
+    Job         submit(PopenConfig&& config, Bytes input = Bytes(), int priority = 0);
+    /** @brief Cancels a job. Thread-safe.
+     *
+     *  A queued job is removed and its result set to CancelledError. A running job is sent
+     *  `signal` and completes with the resulting returncode.
+     *  @return false if the job has already completed (or is unknown).
+     */
+    bool        cancel(JobId id, int signal = SIGTERM);
+    /** @brief Stops accepting jobs and waits until the queued and running ones have completed.
+     *  @param cancel_pending Cancels the queued jobs instead of running them. */
+    void        shutdown(bool cancel_pending = false);
+
+    std::size_t max_workers() const;
+    /** @brief Number of jobs waiting for a free slot. */
+    std::size_t queued() const;
+    /** @brief Number of jobs whose process is running. */
+    std::size_t running() const;
+
+private:
+    struct Entry {
+        JobId                          id;
+        int                            priority;
+        PopenConfig                    config;
+        Bytes                          input;
+        std::promise<CompletedProcess> promise;
+        Popen*                         popen  = nullptr;
+        /** Signal requested by cancel() for a running job, 0 if none. */
+        int                            signal = 0;
+    };
+    /** Higher priority first, then submission order. */
+    using QueueKey = std::pair<int, JobId>;
+    using Queue    = std::map<QueueKey, std::shared_ptr<Entry>>;
+
+    void             run();
+    void             dispatch();
+    detail::Detached execute(std::shared_ptr<Entry> entry);
+    /** Runs dispatch() on the loop's thread. */
+    detail::Detached wake();
+    /** Sends the signal requested by cancel(), once the process of `entry` is running. */
+    void             signal_if_cancelled(Entry& entry);
+
+    std::size_t                                        max_workers_;
+    EventLoop                                          loop_;
+    mutable std::mutex                                 mutex_;
+    Queue                                              queue_;
+    std::unordered_map<JobId, Queue::iterator>         queued_;
+    std::unordered_map<JobId, std::shared_ptr<Entry>>  running_;
+    JobId                                              next_id_  = 0;
+    bool                                               stopping_ = false;
+    std::thread                                        dispatcher_;
+};
+
+} // namespace subprocess
+
+#endif
@@ -1,16 +1,24 @@
 #ifndef POPEN_H
 #define POPEN_H
 
+#include <array>
+#include <chrono>
+#include <memory>
 #include <optional>
 
 #include <sys/resource.h>
 
+#include "subprocess/async.h"
 #include "subprocess/bytes.h"
+#include "subprocess/stats.h"
 #include "subprocess/streamable.h"
 #include "subprocess/types.h"
 
 namespace subprocess {
 
+class CommandTemplate;
+namespace detail { struct CommandPlan; }
+
 /** @brief Configuration class for process spawning.
  *
  *  Supports a flexible constructor that allows parameters in any order, similar to Python.
@@ -19,13 +27,15 @@ namespace subprocess {
  *  @note Ensure that not to use the same configuration for multiple process spawns due to its internal state.
  *        The recommended way to use this class is by passing a temporary object as an argument to Popen constructor.
  *
- *  @todo Implement reset() method to allow reusing the configuration.
+ *  @see CommandTemplate to spawn the same command many times.
  */
 class PopenConfig {
 public:
+    PopenConfig() = default;
     template<typename... Params>
     PopenConfig(Params&&... params) { set_value(std::forward<Params>(params)...); }
     template<typename Param, typename... Params>
+        requires (sizeof...(Params) > 0)
     void set_value(Param&& param, Params&&... params) {
         set_value(std::forward<Param>(param));
         set_value(std::forward<Params>(params)...);
@@ -42,6 +52,12 @@ public:
     void set_value(types::std_err_t&& std_err);
     void set_value(const types::preexec_fn_t& preexec_fn);
     void set_value(types::preexec_fn_t&& preexec_fn);
+    void set_value(const types::rlimit_t& rlimit);
+    void set_value(types::rlimit_t&& rlimit);
+    void set_value(const types::sched_t& sched);
+    void set_value(types::sched_t&& sched);
+    void set_value(const types::pass_fds_t& pass_fds);
+    void set_value(types::pass_fds_t&& pass_fds);
 
     void validate();
 
@@ -52,16 +68,67 @@ public:
     std::optional<types::std_in_t>     std_in     = types::std_in_t(types::IOOption::NONE); 
     std::optional<types::std_out_t>    std_out    = types::std_out_t(types::IOOption::NONE);
     std::optional<types::std_err_t>    std_err    = types::std_err_t(types::IOOption::NONE);
-    std::optional<types::preexec_fn_t> preexec_fn = types::preexec_fn_t([] {});
+    std::optional<types::preexec_fn_t> preexec_fn = types::preexec_fn_t(nullptr);
+    std::optional<types::rlimit_t>     rlimit     = types::rlimit_t();
+    std::optional<types::sched_t>      sched      = types::sched_t();
+    std::optional<types::pass_fds_t>   pass_fds   = types::pass_fds_t();
+};
+
+/** @brief A process that has finished running, as returned by run() and ProcessPool. */
+struct CompletedProcess {
+    std::vector<std::string> args;
+    int                      returncode;
+    /** Captured stdout, std::nullopt if stdout was not a PIPE. */
+    std::optional<Bytes>     std_out;
+    /** Captured stderr, std::nullopt if stderr was not a PIPE. */
+    std::optional<Bytes>     std_err;
+    std::optional<::rusage>  usage;
 };
 
-// TODO
-class RunConfig : public PopenConfig {};
+/** @brief Configuration of run(): a PopenConfig with the options of Python's subprocess.run().
+ *
+ *  - `input_t`: data fed to stdin, which must then be left unset.
+ *  - `capture_output_t`: sets stdout and stderr to PIPE, which must then be left unset.
+ *  - `check_t`: throws CalledProcessError on a non-zero returncode.
+ *  - `timeout_t`: kills the process and throws TimeoutExpired once it expires.
+ */
+class RunConfig : public PopenConfig {
+public:
+    RunConfig() = default;
+    template<typename... Params>
+    RunConfig(Params&&... params) { set_value(std::forward<Params>(params)...); }
+    template<typename Param, typename... Params>
+        requires (sizeof...(Params) > 0)
+    void set_value(Param&& param, Params&&... params) {
+        set_value(std::forward<Param>(param));
+        set_value(std::forward<Params>(params)...);
+    }
+    using PopenConfig::set_value;
+    void set_value(const types::input_t& input);
+    void set_value(types::input_t&& input);
+    void set_value(const types::capture_output_t& capture_output);
+    void set_value(types::capture_output_t&& capture_output);
+    void set_value(const types::check_t& check);
+    void set_value(types::check_t&& check);
+    void set_value(const types::timeout_t& timeout);
+    void set_value(types::timeout_t&& timeout);
+
+    /** @throws std::invalid_argument If `input` or `capture_output` conflict with the standard streams. */
+    void validate();
+
+    std::optional<types::input_t>          input          = types::input_t();
+    std::optional<types::capture_output_t> capture_output = types::capture_output_t(false);
+    std::optional<types::check_t>          check          = types::check_t(false);
+    std::optional<types::timeout_t>        timeout        = types::timeout_t(-1);
+};
 
 class Popen {
 public:
-    ~Popen()                                 = default;
+    /** Records stats() to StatsAggregator::global() if it is enabled. */
+    ~Popen();
     Popen(PopenConfig&& config);
+    /** @brief Spawns a prepared command; see CommandTemplate::spawn(). */
+    Popen(const CommandTemplate& command, std::vector<std::string> values);
     Popen(const Popen& other)                = delete;
     Popen(Popen&& other) noexcept            = delete;
 
@@ -81,6 +148,24 @@ public:
     std::optional<std::shared_ptr<IStreamable>> std_out();
     /** If the stderr was set to PIPE, this returns a readable stream. Otherwise, this returns std::nullopt */
     std::optional<std::shared_ptr<IStreamable>> std_err();
+    /** If the stdout was set to a capture_t, waits for the process and returns a read-only mapping of the captured output.
+     *  Otherwise, this returns std::nullopt */
+    std::optional<MappedBytes>                  captured_std_out();
+    /** If the stderr was set to a capture_t, waits for the process and returns a read-only mapping of the captured output.
+     *  Otherwise, this returns std::nullopt */
+    std::optional<MappedBytes>                  captured_std_err();
+    /** If the stdout was set to a tail_t, returns the buffer holding its tail, which can be read at any time. 
+     *  Otherwise, this returns std::nullopt */
+    std::optional<std::shared_ptr<TailBuffer>>  tail_std_out();
+    /** If the stderr was set to a tail_t, returns the buffer holding its tail, which can be read at any time. 
+     *  Otherwise, this returns std::nullopt */
+    std::optional<std::shared_ptr<TailBuffer>>  tail_std_err();
+    /** Performance telemetry of the process: spawn latencies, per-stream I/O through the parent's pipe ends and, 
+     *  once the process has been reaped, wall time. Recorded to StatsAggregator::global() on destruction, if enabled. */
+    ProcessStats                                stats() const;
+    /** Capacities in bytes of the stdin, stdout and stderr pipes, std::nullopt for streams without an open pipe.
+     *  Reflects the growth of adaptive pipes (see bufsize_t). */
+    std::array<std::optional<int>, 3>           pipe_sizes() const;
 
     /** @brief Checks if the process has exited.
      *
@@ -119,21 +204,67 @@ public:
     std::pair<
         std::optional<Bytes>, 
         std::optional<Bytes>> communicate(const Bytes& input, double timeout = -1);
+
+    /** @brief Asynchronous counterpart of wait().
+     *
+     *  Suspends the awaiting coroutine on EventLoop::current() until the process exits,
+     *  without occupying a thread. The exit is observed through a pidfd when available.
+     */
+    Task<std::optional<int>>  async_wait();
+    /** @brief Asynchronous counterpart of communicate().
+     *
+     *  Feeds `input` to stdin while stdout and stderr are drained concurrently, so the
+     *  exchange cannot deadlock on full pipes. Completes once the process has exited.
+     *
+     *  @param input Data to send to the process. Must be empty if stdin is not a pipe.
+     */
+    Task<std::pair<
+        std::optional<Bytes>,
+        std::optional<Bytes>>>    async_communicate(Bytes input = Bytes());
     void                      send_signal(int signal); 
     void                      terminate();
     void                      kill();
 
 private:
+    /** Forks and executes `path` with `argv`, redirecting the streams of `config_`. */
+    void                      spawn(const char* path, char* const argv[]);
+    /** Records fork_to_exec_ if the child has executed its program since the last check, without blocking. */
+    void                      check_exec() const;
     void                      comm_wait();
     void                      set_returncode(int status);
 
     PopenConfig                   config_;
+    /** Set for processes spawned from a CommandTemplate, whose args are not in `config_`. */
+    std::shared_ptr<const detail::CommandPlan> command_;
+    std::vector<std::string>      values_;
     ::pid_t                       pid_;
     std::optional<::rusage>       usage_;
     std::optional<int>            returncode_;
     std::future<Bytes::size_type> comm_results[3];
+
+    std::chrono::steady_clock::time_point                spawn_time_;
+    /** Read end of the pipe closed on exec, until its EOF is observed; updated by the const stats(). */
+    mutable int                                          exec_fd_ = -1;
+    mutable std::optional<std::chrono::steady_clock::duration> fork_to_exec_;
+    std::optional<std::chrono::steady_clock::time_point> exit_time_;
+    std::shared_ptr<IOCounters>                          counters_[3];
 };
 
+/** @brief Runs a process to completion, like Python's subprocess.run().
+ *
+ *  Once the process is spawned, the output of the stdout and stderr pipes is drained and the 
+ *  exit of the process (through a pidfd when available) is awaited by a single `poll` loop on
+ *  the calling thread. The stdout buffer is sized from the hint of capture_output_t. Input is
+ *  passed through a sealed memfd instead of being fed by the parent.
+ *
+ *  @return The returncode, the output of the streams set to PIPE and the resource usage.
+ *  @throws TimeoutExpired If the timeout expires; the process is then killed and reaped.
+ *  @throws CalledProcessError If `check` is set and the returncode is non-zero.
+ */
+CompletedProcess run(RunConfig&& config);
+template<typename... Params>
+CompletedProcess run(Params&&... params) { return run(RunConfig(std::forward<Params>(params)...)); }
+
 } // namespace subprocess
 
 #endif
\ No newline at end of file
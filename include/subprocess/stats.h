@@ -0,0 +1,116 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace subprocess {
+
+/** @brief Live I/O counters of one pipe, updated by File as it reads or writes.
+ *
+ *  Counters are atomic, so they can be read while a forwarding thread or a coroutine
+ *  is still transferring data.
+ */
+class IOCounters {
+public:
+    /** @brief Records one operation of `bytes` bytes that made `calls` I/O system calls
+     *  and spent `blocked` waiting for the pipe. */
+    void record(std::uint64_t bytes, std::uint64_t calls, std::chrono::nanoseconds blocked);
+
+    std::atomic<std::uint64_t> bytes      = 0;
+    std::atomic<std::uint64_t> io_calls   = 0;
+    std::atomic<std::int64_t>  blocked_ns = 0;
+    /** `steady_clock` time of the first byte transferred, in nanoseconds since its epoch (-1 if none). */
+    std::atomic<std::int64_t>  first_byte_ns = -1;
+};
+
+/** @brief Snapshot of the I/O of one stream of a process. */
+struct StreamStats {
+    /** Bytes read (stdout, stderr) or written (stdin) by the parent. */
+    std::uint64_t            bytes    = 0;
+    /** Read and write operations that reached the descriptor. For `FILE*` based transfers,
+     *  a call that cannot be served from the stdio buffer counts once. */
+    std::uint64_t            io_calls = 0;
+    /** Time spent in blocking reads and writes, waiting on an empty or full pipe. */
+    std::chrono::nanoseconds blocked  = std::chrono::nanoseconds(0);
+};
+
+/** @brief Performance telemetry of a process, see Popen::stats(). */
+struct ProcessStats {
+    /** Time from fork() until the child executed the program (or failed to), std::nullopt until 
+     *  the parent has observed it. The parent does not wait for the exec: it is observed without 
+     *  blocking by stats(), poll() and wait(), so the value is an upper bound, as close as the 
+     *  first of these calls after the exec. */
+    std::optional<std::chrono::nanoseconds> fork_to_exec;
+    /** Time from the spawn until the parent read the first byte of stdout or stderr. */
+    std::optional<std::chrono::nanoseconds> first_output;
+    /** Time from the spawn until the process was reaped, std::nullopt while it runs. */
+    std::optional<std::chrono::nanoseconds> wall_time;
+    StreamStats                             std_in;
+    StreamStats                             std_out;
+    StreamStats                             std_err;
+};
+
+/** @brief Latency histogram with power-of-two nanosecond buckets. */
+class Histogram {
+public:
+    static constexpr std::size_t bucket_count = 64;
+
+    void          record(std::chrono::nanoseconds value);
+    std::uint64_t count() const;
+    /** @brief Returns an upper bound of the given quantile (0 to 1), from the bucket bounds. */
+    std::chrono::nanoseconds quantile(double q) const;
+    std::string   to_json() const;
+
+private:
+    std::array<std::uint64_t, bucket_count> buckets_ = {};
+    std::uint64_t                           count_   = 0;
+    std::int64_t                            sum_ns_  = 0;
+    std::int64_t                            max_ns_  = 0;
+};
+
+/** @brief Process-wide aggregate of the ProcessStats of every reaped process.
+ *
+ *  Once enabled, Popen records the stats of a process on destruction. Counters are summed per 
+ *  stream, latencies go to histograms. Aggregation is off by default, so that processes do not 
+ *  contend on the lock of the aggregator unless telemetry was asked for.
+ */
+class StatsAggregator {
+public:
+    /** @brief Returns the aggregator that Popen reports to. */
+    static StatsAggregator& global();
+
+    /** @brief Starts or stops the recording of processes destroyed from now on. */
+    void         enable(bool enabled = true);
+    bool         is_enabled() const;
+
+    void         record(const ProcessStats& stats);
+    void         reset();
+    /** @brief Dumps the counters and histograms as a JSON object. */
+    std::string  to_json() const;
+
+    std::uint64_t processes() const;
+    Histogram     fork_to_exec() const;
+    Histogram     first_output() const;
+    Histogram     wall_time() const;
+    /** @brief Returns the summed stats of stdin (0), stdout (1) or stderr (2). */
+    StreamStats   stream(int index) const;
+
+private:
+    std::atomic<bool>          enabled_   = false;
+    mutable std::mutex         mutex_;
+    std::uint64_t              processes_ = 0;
+    Histogram                  fork_to_exec_;
+    Histogram                  first_output_;
+    Histogram                  wall_time_;
+    std::array<StreamStats, 3> streams_;
+};
+
+} // namespace subprocess
+
+#endif
@@ -1,12 +1,28 @@
 #ifndef STREAMABLE_H
 #define STREAMABLE_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <streambuf>
 #include <thread>
+#include <utility>
+#include <vector>
 
+#include <sys/socket.h>
+
+#include "subprocess/async.h"
 #include "subprocess/bytes.h"
+#include "subprocess/stats.h"
 
 namespace subprocess {
 
@@ -60,8 +76,35 @@ public:
      *  @return A Bytes object containing the data read.
      *  @throws std::runtime_error If the stream is not readable or an error occurs.
      */
-    virtual Bytes read(Bytes::size_type size) = 0;
-    virtual Bytes read_all()                  = 0;
+    virtual Bytes       read(Bytes::size_type size) = 0;
+    virtual Bytes       read_all()                  = 0;
+
+    /** @brief Reads whatever is available, up to `size` bytes, without waiting for more.
+     *
+     *  Blocks only until some data is available (or EOF) and returns it after a single
+     *  read. In non-blocking mode, returns std::nullopt if no data is available.
+     *  The default implementation is equivalent to read().
+     *
+     *  @return The data read, empty at EOF.
+     */
+    virtual std::optional<Bytes> read_some(Bytes::size_type size);
+    /** @brief Reads up to `size` bytes, giving up once `deadline` is reached.
+     *
+     *  Returns the partial data read so far if the deadline expires or EOF is reached.
+     *  Deadlines are unsupported by the default implementation: it ignores `deadline`, blocks 
+     *  like read() and may return after it. Streams backed by a pollable descriptor (File) 
+     *  honour it.
+     */
+    virtual Bytes       read(Bytes::size_type size, std::chrono::steady_clock::time_point deadline);
+
+    /** @brief Asynchronous counterpart of read(), awaited on EventLoop::current().
+     *
+     *  The default implementation completes synchronously by calling read().
+     *  Streams backed by a pollable file descriptor suspend instead of blocking.
+     */
+    virtual Task<Bytes> async_read(Bytes::size_type size);
+    /** @brief Asynchronous counterpart of read_all(). */
+    virtual Task<Bytes> async_read_all();
 };
 
 /** @brief Interface for writable stream-like objects. */
@@ -69,7 +112,14 @@ class OStreamable : virtual public Streamable {
 public:
     virtual ~OStreamable() = default;
 
-    virtual Bytes::size_type write(const Bytes& bytes, Bytes::size_type size) = 0;
+    virtual Bytes::size_type       write(const Bytes& bytes, Bytes::size_type size) = 0;
+
+    /** @brief Asynchronous counterpart of write(), awaited on EventLoop::current().
+     *
+     *  The bytes are taken by value so that the returned task owns them.
+     *  The default implementation completes synchronously by calling write().
+     */
+    virtual Task<Bytes::size_type> async_write(Bytes bytes, Bytes::size_type size);
 };
 
 /** @brief Interface for stream-like objects that support both reading and writing.
@@ -108,6 +158,18 @@ public:
     virtual Bytes            read_all() override;
     virtual Bytes::size_type write(const Bytes& buf, Bytes::size_type size) override;
 
+    /** @brief Returns buffered data if any, otherwise the result of a single `read(2)`. */
+    virtual std::optional<Bytes> read_some(Bytes::size_type size) override;
+    /** @brief Reads up to `size` bytes, polling the descriptor until `deadline`. */
+    virtual Bytes            read(Bytes::size_type size, std::chrono::steady_clock::time_point deadline) override;
+
+    /** @brief Reads through the underlying descriptor, suspending while the pipe is empty.
+     *  Data already held in the `FILE*` buffer is consumed first. */
+    virtual Task<Bytes>            async_read(Bytes::size_type size) override;
+    virtual Task<Bytes>            async_read_all() override;
+    /** @brief Writes through the underlying descriptor, suspending while the pipe is full. */
+    virtual Task<Bytes::size_type> async_write(Bytes buf, Bytes::size_type size) override;
+
     virtual void             close() override;
     virtual void             release() override;
  
@@ -121,14 +183,141 @@ public:
      *  - `size >  1`: Full buffering (_IOFBF) with the specified size
      *  - `size <  0`: Full buffering (_IOFBF) with default size
      *
+     *  The read ends of pipes and sockets are unbuffered by default, as read_some() and the 
+     *  deadline and async reads bypass the buffer; buffering them is only safe with glibc.
+     *
      *  @param size The desired buffer size in bytes.
      *  @throws OSError If setting the buffer fails.
      */
     void                     set_bufsize(ssize_t size);
     void                     set_cloexec();
+    /** @brief Sets or clears `O_NONBLOCK` on the underlying descriptor.
+     *
+     *  read(), read_all() and write() keep their blocking semantics in non-blocking mode 
+     *  by polling the descriptor; read_some() returns std::nullopt instead of waiting.
+     */
+    void                     set_non_blocking(bool non_blocking);
+    bool                     is_non_blocking() const;
+
+    /** @brief Sets the capacity of the underlying pipe with `F_SETPIPE_SZ`.
+     *
+     *  The request is capped by max_pipe_size() and rounded up by the kernel to a power-of-two 
+     *  number of pages. When the per-user pipe quota is exhausted (`EPERM`) or the pipe holds 
+     *  more data than the requested capacity (`EBUSY`), the capacity is left unchanged.
+     *
+     *  @return The resulting capacity in bytes.
+     *  @throws OSError If the descriptor is not a pipe.
+     */
+    int                      set_pipe_size(ssize_t size);
+    /** @brief Returns the capacity of the underlying pipe (`F_GETPIPE_SZ`), or -1 if it is not a pipe. */
+    int                      pipe_size() const;
+    /** @brief Grows the pipe whenever reads keep finding it full.
+     *
+     *  Before reading, the amount of pending data is queried with `FIONREAD`. After two consecutive 
+     *  reads that find the pipe at capacity, the capacity is doubled, up to max_pipe_size().
+     */
+    void                     set_adaptive_pipe_size(bool adaptive);
+    /** @brief Returns the largest capacity an unprivileged process can set (`/proc/sys/fs/pipe-max-size`). */
+    static int               max_pipe_size();
+
+    /** @brief Attaches counters updated by every read and write (nullptr to detach). */
+    void                     set_counters(std::shared_ptr<IOCounters> counters);
+    std::shared_ptr<IOCounters> counters() const;
+
+    /** @brief Flushes data pending in the `FILE*` buffer to the underlying descriptor. */
+    void                     flush();
+    /** @brief Returns data already read ahead into the `FILE*` buffer, without any system call.
+     *
+     *  Callers bypassing the `FILE*` layer (e.g. reading the descriptor directly) must consume 
+     *  this first, otherwise buffered data would be lost.
+     */
+    Bytes                    read_buffered();
+
+protected:
+    /** @brief Reports an operation to counters_. A default `start_time` records no blocked time. */
+    void                     account(std::uint64_t bytes, std::uint64_t calls, std::chrono::steady_clock::time_point start_time);
 
 private:
+    void                     grow_pipe_if_full();
+
     std::FILE*               fp_;
+    bool                     adaptive_pipe_size_ = false;
+    int                      pipe_full_reads_    = 0;
+    std::shared_ptr<IOCounters> counters_;
+};
+
+/** @brief One end of an `AF_UNIX` socketpair, as opened by IOOption::SOCKETPAIR.
+ *
+ *  Unlike a pipe, a socket carries data both ways, and its buffers are sized per socket with 
+ *  `SO_SNDBUF`/`SO_RCVBUF` instead of being capped by `pipe-max-size`. Reads and writes go 
+ *  straight to the descriptor, bypassing the `FILE*` layer, so that both directions can be used 
+ *  at once.
+ *
+ *  With `SOCK_SEQPACKET`, every write() is sent as one message, and send_message() and 
+ *  receive_message() keep the boundaries between messages; read() of fewer bytes than a 
+ *  message discards the rest of it. Descriptors can be sent along a message with `SCM_RIGHTS`.
+ */
+class Socket : public File {
+public:
+    /** @brief A message received by receive_message(). */
+    struct Message {
+        Bytes            data;
+        /** Descriptors sent with the message, close-on-exec and owned by the receiver. */
+        std::vector<int> fds;
+        /** True if the message or its descriptors did not fit in the sizes given and were cut. */
+        bool             truncated = false;
+    };
+
+    /** Closes the socket if it is still open. */
+    virtual ~Socket();
+    /** @brief Takes ownership of `fd`, which must be a socket. */
+    explicit Socket(int fd);
+    Socket(const Socket& other)            = delete;
+    Socket& operator=(const Socket& other) = delete;
+    /** @brief Opens a connected pair of close-on-exec `AF_UNIX` sockets.
+     *  @param type `SOCK_STREAM` or `SOCK_SEQPACKET`.
+     *  @throws OSError If the sockets cannot be created. */
+    static std::pair<std::shared_ptr<Socket>, std::shared_ptr<Socket>> pair(int type = SOCK_STREAM);
+
+    /** @brief Returns another handle on the same socket, with its own descriptor. */
+    std::shared_ptr<Socket>  duplicate() const;
+    /** @brief Returns `SOCK_STREAM` or `SOCK_SEQPACKET`. */
+    int                      type() const;
+
+    virtual Bytes            read(Bytes::size_type size) override;
+    virtual Bytes            read_all() override;
+    virtual Bytes::size_type write(const Bytes& buf, Bytes::size_type size) override;
+    virtual std::optional<Bytes> read_some(Bytes::size_type size) override;
+    /** @brief Closes the descriptor, shutting down the writing direction first if set_half_close() was given. */
+    virtual void             close() override;
+
+    /** @brief Sends `size` bytes as a single message, with `fds` attached as `SCM_RIGHTS`.
+     *
+     *  The receiver gets its own duplicates of `fds`, which stay open here. With `SOCK_STREAM`, 
+     *  the descriptors arrive with the first byte of the data, which must not be empty.
+     *  @throws OSError If the message cannot be sent, e.g. `EMSGSIZE` if it exceeds the send buffer.
+     */
+    Bytes::size_type         send_message(const Bytes& buf, Bytes::size_type size, const std::vector<int>& fds = {});
+    /** @brief Receives one message of up to `max_size` bytes and `max_fds` descriptors.
+     *  @return std::nullopt at end of stream. */
+    std::optional<Message>   receive_message(Bytes::size_type max_size = 1 << 16, std::size_t max_fds = 16);
+
+    /** @brief Shuts down one or both directions (`SHUT_RD`, `SHUT_WR`, `SHUT_RDWR`) for every handle. */
+    void                     shutdown(int how);
+    /** @brief Makes close() send end-of-file to the peer even while other handles stay open. */
+    void                     set_half_close(bool half_close = true);
+
+    /** @brief Sets both `SO_SNDBUF` and `SO_RCVBUF`, which the kernel doubles and caps by 
+     *  `/proc/sys/net/core/wmem_max` and `rmem_max`.
+     *  @throws OSError If the option cannot be set. */
+    void                     set_buffer_size(int size);
+    int                      send_buffer_size() const;
+    int                      receive_buffer_size() const;
+
+private:
+    int                      get_option(int name) const;
+
+    bool                     half_close_ = false;
 };
 
 /** @brief A lightweight, non-owning wrapper for `std::istream` */
@@ -151,6 +340,7 @@ public:
     virtual bool  is_readable() const override;
     virtual bool  is_writable() const override;
 
+    using         IStreamable::read;
     virtual Bytes read(Bytes::size_type size) override;
     virtual Bytes read_all() override;
 
@@ -186,8 +376,9 @@ public:
 
     virtual Bytes::size_type write(const Bytes& buf, Bytes::size_type size) override;
 
-    /** @brief Detaches the stream without closing it (equivalent to release()). */
+    /** @brief Flushes and detaches the stream without closing it. */
     virtual void             close() override;
+    /** @brief Detaches the stream without flushing it. */
     virtual void             release() override;
 
     void                     open(std::ostream* stream);
@@ -214,11 +405,14 @@ public:
     virtual bool             is_readable() const override;
     virtual bool             is_writable() const override;
 
+    using                    IStreamable::read;
     virtual Bytes            read(Bytes::size_type size) override;
     virtual Bytes            read_all() override;
     virtual Bytes::size_type write(const Bytes& buf, Bytes::size_type size) override;
 
+    /** @brief Flushes and detaches the stream without closing it. */
     virtual void             close() override;
+    /** @brief Detaches the stream without flushing it. */
     virtual void             release() override;
 
     void                     open(std::iostream* stream);
@@ -227,13 +421,275 @@ private:
     std::iostream*           stream_;
 };
 
+/** @brief A `std::streambuf` reading from or writing to a file descriptor, typically a pipe.
+ *
+ *  Data goes through a page-aligned buffer of `buffer_size` bytes with raw read(2) and 
+ *  write(2) calls. Bulk transfers (`sgetn`, `sputn`, `std::istream::read`, ...) at least as 
+ *  large as the buffer bypass it, so that iostream-based code reads and writes at memcpy 
+ *  speed. The descriptor is used directly and not owned: it must not be read or written 
+ *  through another buffered stream (e.g. the `FILE*` of a File) meanwhile. A non-blocking 
+ *  descriptor is polled until it is ready. Errors are thrown as OSError, which streams 
+ *  turn into `badbit`.
+ */
+class PipeStreambuf : public std::streambuf {
+public:
+    static constexpr std::size_t default_buffer_size = 1 << 16;
+
+    /** Flushes the output buffer; errors are ignored. */
+    virtual ~PipeStreambuf();
+    /** @param mode `std::ios::in` to read from `fd`, `std::ios::out` to write to it. 
+     *  @throws std::invalid_argument If `fd` is -1, `mode` is neither or both, or `buffer_size` is 0. */
+    PipeStreambuf(int fd, std::ios::openmode mode, std::size_t buffer_size = default_buffer_size);
+    PipeStreambuf(const PipeStreambuf& other)            = delete;
+    PipeStreambuf& operator=(const PipeStreambuf& other) = delete;
+
+    int                     fd() const;
+
+protected:
+    virtual int_type        underflow() override;
+    virtual std::streamsize xsgetn(char_type* s, std::streamsize count) override;
+    /** Bytes readable without blocking, from FIONREAD. */
+    virtual std::streamsize showmanyc() override;
+
+    virtual int_type        overflow(int_type c) override;
+    virtual std::streamsize xsputn(const char_type* s, std::streamsize count) override;
+    virtual int             sync() override;
+
+private:
+    struct Free { void operator()(char* buffer) const; };
+
+    /** Returns 0 at EOF. */
+    std::size_t             read_fd(char* buf, std::size_t size);
+    void                    write_fd(const char* buf, std::size_t size);
+    void                    flush_buffer();
+
+    int                           fd_;
+    std::size_t                   buffer_size_;
+    std::unique_ptr<char[], Free> buffer_;
+};
+
+/** @brief A `std::istream` reading from a pipe through a PipeStreambuf.
+ *
+ *  @code
+ *  Popen p(PopenConfig(args_t("/usr/bin/seq", "1", "1000"), std_out_t(IOOption::PIPE)));
+ *  PipeIStream out(*p.std_out().value());
+ *  for (std::string line; std::getline(out, line);) { ... }
+ *  @endcode
+ */
+class PipeIStream : public std::istream {
+public:
+    explicit PipeIStream(int fd, std::size_t buffer_size = PipeStreambuf::default_buffer_size);
+    /** Reads the descriptor of `pipe`, which must outlive the stream.
+     *  @throws std::invalid_argument If `pipe` has no file descriptor. */
+    explicit PipeIStream(const Streamable& pipe, std::size_t buffer_size = PipeStreambuf::default_buffer_size);
+
+private:
+    PipeStreambuf buf_;
+};
+
+/** @brief A `std::ostream` writing to a pipe through a PipeStreambuf. The buffer is flushed 
+ *  on `flush()`, when full, and on destruction. */
+class PipeOStream : public std::ostream {
+public:
+    explicit PipeOStream(int fd, std::size_t buffer_size = PipeStreambuf::default_buffer_size);
+    /** Writes to the descriptor of `pipe`, which must outlive the stream.
+     *  @throws std::invalid_argument If `pipe` has no file descriptor. */
+    explicit PipeOStream(const Streamable& pipe, std::size_t buffer_size = PipeStreambuf::default_buffer_size);
+
+private:
+    PipeStreambuf buf_;
+};
+
+/** @brief A stream pulling its data from a producer, one chunk per call.
+ *
+ *  The producer returns the next chunk, or std::nullopt once it is done. It is only called 
+ *  when a reader asks for data, so a lazily generated stream never has to fit in memory.
+ *  forward() further waits for room in the pipe before each call: at most one chunk is held 
+ *  outside the pipe, and a reader that closes the pipe early stops the producer.
+ */
+class Generator : public IStreamable {
+public:
+    using Producer = std::function<std::optional<Bytes>()>;
+
+    virtual ~Generator() = default;
+    /** @throws std::invalid_argument If `producer` is empty. */
+    explicit Generator(Producer producer);
+    Generator(const Generator& other)            = delete;
+    Generator& operator=(const Generator& other) = delete;
+
+    virtual int                  fileno() const override;
+    virtual bool                 is_opened() const override;
+    /** @brief Returns true if is_opened() is true and the producer has not ended. */
+    virtual bool                 is_readable() const override;
+    virtual bool                 is_writable() const override;
+
+    using                        IStreamable::read;
+    virtual Bytes                read(Bytes::size_type size) override;
+    virtual Bytes                read_all() override;
+    /** @brief Returns the rest of the last chunk, or the next one, up to `size` bytes. */
+    virtual std::optional<Bytes> read_some(Bytes::size_type size) override;
+
+    /** @brief Writes the produced chunks to `pipe`, pulling each one once the pipe can take data.
+     *
+     *  Stops without error when the reader closes the pipe (EPIPE); SIGPIPE is blocked on the 
+     *  calling thread meanwhile.
+     *  @return The number of bytes written to `pipe`.
+     *  @throws OSError If writing to `pipe` fails otherwise.
+     */
+    Bytes::size_type             forward(File& pipe);
+    /** @brief True if the reader closed the pipe before the producer ended. */
+    bool                         broken() const;
+
+    /** @brief Stops pulling from the producer. */
+    virtual void                 close() override;
+    virtual void                 release() override;
+
+private:
+    /** Moves up to `size` bytes of the current chunk to `out`, pulling a chunk if needed. 
+     *  Returns false once the producer has ended. */
+    bool                         take(Bytes::size_type size, Bytes& out);
+
+    Producer         producer_;
+    Bytes            chunk_;
+    Bytes::size_type offset_;
+    bool             ended_;
+    bool             closed_;
+    bool             broken_;
+};
+
+/** @brief A bounded sink that keeps only the tail of what is written to it.
+ *
+ *  Writes go to a ring of `max_bytes` bytes, overwriting the oldest data, so memory stays
+ *  O(max_bytes) whatever the volume written. With `max_lines`, snapshots are further cut to
+ *  the last `max_lines` lines, and a line partly overwritten by the ring is dropped.
+ *
+ *  One thread writes while any number of threads take snapshots, without locks: a snapshot
+ *  copies the ring and then discards the bytes that the writer may have overwritten meanwhile.
+ *  It is always a contiguous suffix of the data written before it started.
+ */
+class TailBuffer : public OStreamable {
+public:
+    virtual ~TailBuffer() = default;
+    /** @throws std::invalid_argument If `max_bytes` is 0. */
+    explicit TailBuffer(std::size_t max_bytes, std::size_t max_lines = 0);
+    TailBuffer(const TailBuffer& other)                = delete;
+    TailBuffer& operator=(const TailBuffer& other)     = delete;
+
+    virtual int              fileno() const override;
+    /** @brief True until close() is called. */
+    virtual bool             is_opened() const override;
+    virtual bool             is_readable() const override;
+    virtual bool             is_writable() const override;
+
+    /** @brief Appends `size` bytes, overwriting the oldest ones once the ring is full. Single writer. */
+    virtual Bytes::size_type write(const Bytes& buf, Bytes::size_type size) override;
+
+    virtual void             close() override;
+    virtual void             release() override;
+
+    /** @brief Returns the retained tail. Thread-safe, also while the writer is running. */
+    Bytes                    snapshot() const;
+    /** @brief Number of bytes written since the creation of the buffer, retained or not. */
+    std::uint64_t            total() const;
+    std::size_t              max_bytes() const;
+    std::size_t              max_lines() const;
+
+private:
+    std::unique_ptr<std::atomic<char>[]> ring_;
+    std::size_t                          max_bytes_;
+    std::size_t                          max_lines_;
+    /** Total bytes published, and total bytes whose writing has started (ahead of `written_` during a write). */
+    std::atomic<std::uint64_t>           written_;
+    std::atomic<std::uint64_t>           claimed_;
+    std::atomic<bool>                    closed_;
+};
+
+/** @brief What a Tee does with data for a sink that is not keeping up. */
+enum class SinkPolicy {
+    /** Waits for the sink, slowing down the child once the pipe is full. */
+    BLOCK,
+    /** Drops data arriving while the sink is still writing previous data. */
+    DROP,
+    /** Queues up to `limit` bytes for the sink, and drops data beyond. */
+    BUFFER
+};
+
+/** @brief Duplicates the data written to it into several sinks.
+ *
+ *  Sinks with SinkPolicy::BLOCK are written by the caller. Other sinks are written by a thread
+ *  of their own, through a queue bounded by their policy, so that they never hold back the others.
+ *
+ *  forward() drains a pipe into the sinks. When blocking sinks are pipes, sockets or regular
+ *  files (without O_APPEND), the data is duplicated with `tee(2)` and moved with `splice(2)`
+ *  without leaving the kernel; it is copied to user space only if some sink requires it.
+ *
+ *  Sinks must be added before data is written. Closing a Tee waits for the queued data but
+ *  leaves the sinks open.
+ */
+class Tee : public OStreamable {
+public:
+    /** Closes the tee. */
+    virtual ~Tee();
+    Tee();
+    Tee(const Tee& other)            = delete;
+    Tee& operator=(const Tee& other) = delete;
+
+    /** @param limit Size of the queue of a SinkPolicy::BUFFER sink, in bytes. */
+    Tee&                     add(std::shared_ptr<OStreamable> sink, SinkPolicy policy = SinkPolicy::BLOCK, std::size_t limit = 0);
+    Tee&                     add(std::function<void(const Bytes&)> callback, SinkPolicy policy = SinkPolicy::BLOCK, std::size_t limit = 0);
+
+    virtual int              fileno() const override;
+    virtual bool             is_opened() const override;
+    virtual bool             is_readable() const override;
+    virtual bool             is_writable() const override;
+
+    /** @brief Writes `size` bytes to every sink. */
+    virtual Bytes::size_type write(const Bytes& buf, Bytes::size_type size) override;
+    /** @brief Writes everything read from `pipe` until EOF to every sink.
+     *  @return The number of bytes read from `pipe`. */
+    Bytes::size_type         forward(File& pipe);
+
+    /** @brief Waits for the queued data to be written. */
+    virtual void             close() override;
+    virtual void             release() override;
+
+    std::size_t              size() const;
+    /** @brief Number of bytes dropped for the `index`-th sink, in order of addition. */
+    std::uint64_t            dropped(std::size_t index) const;
+
+private:
+    struct Sink {
+        std::shared_ptr<OStreamable> stream;
+        SinkPolicy                   policy;
+        std::size_t                  limit;
+        std::atomic<std::uint64_t>   dropped{0};
+
+        /** Queue of asynchronous sinks; `queued` includes the chunk being written. */
+        std::mutex                   mutex;
+        std::condition_variable      cv;
+        std::deque<Bytes>            queue;
+        std::size_t                  queued  = 0;
+        bool                         closing = false;
+        /** Set once a write failed: the rest of the data is dropped. */
+        bool                         failed  = false;
+        std::thread                  thread;
+    };
+
+    void                     deliver(Sink& sink, const Bytes& chunk);
+    static void              run(Sink& sink);
+
+    std::vector<std::unique_ptr<Sink>> sinks_;
+    bool                               closed_;
+};
+
 // TODO: Add FStream inherited from IOStream. It overrides open and close behaviors.
 
 /* ===================================== Functions ===================================== */
 
 /** @brief Synchronously transfers data from the input stream to the output stream.
  *
- *  Reads all data from the input stream and writes it to the output stream.
+ *  Reads all data from the input stream and writes it to the output stream, chunk by chunk
+ *  as it becomes available: memory use does not grow with the amount of data.
  * 
  *  @param in The input stream (must be open and readable).
  *  @param out The output stream (must be open and writable).
@@ -0,0 +1,99 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace subprocess {
+
+namespace trace {
+
+using Clock = std::chrono::steady_clock;
+
+/** @brief Collects trace events in the Chrome trace-event JSON format.
+ *
+ *  The output loads in chrome://tracing and Perfetto. Every event belongs to the calling
+ *  process and to a track (a `tid`): the thread that issued it, or a child process, whose
+ *  pid is used as its track. Events are buffered in memory and written by stop().
+ *
+ *  The library only emits events when it is built with the `SUBPROCESS_TRACE` CMake option
+ *  (which defines `SUBPROCESS_ENABLE_TRACE`); otherwise the hooks are compiled out. Setting 
+ *  the `SUBPROCESS_TRACE_FILE` environment variable starts a trace to that file automatically, 
+ *  written at exit.
+ */
+class Tracer {
+public:
+    /** @brief Returns the tracer used by the library hooks. */
+    static Tracer& global();
+
+    ~Tracer();
+
+    /** @brief Starts collecting events, to be written to `file` by stop(). */
+    void start(const std::filesystem::path& file);
+    /** @brief Stops collecting events and writes them. */
+    void stop();
+    bool is_enabled() const;
+
+    /** @brief Names a track, e.g. "child 1234 (make)". */
+    void track_name(::pid_t track, std::string_view name);
+    /** @brief Records a slice from `start` to `end` on `track`. */
+    void complete(std::string_view name, ::pid_t track, Clock::time_point start, Clock::time_point end, std::string_view args = {});
+    /** @brief Records a point in time on `track`. */
+    void instant(std::string_view name, ::pid_t track, std::string_view args = {});
+
+    /** @brief Returns the track of the calling thread (its tid). */
+    static ::pid_t current_track();
+
+private:
+    Tracer();
+
+    void append(std::string event);
+
+    mutable std::mutex       mutex_;
+    bool                     enabled_;
+    std::filesystem::path    file_;
+    std::vector<std::string> events_;
+};
+
+/** @brief Records a slice on the calling thread's track from construction to destruction. */
+class Scope {
+public:
+    explicit Scope(std::string_view name, std::string args = {});
+    ~Scope();
+    Scope(const Scope& other)            = delete;
+    Scope& operator=(const Scope& other) = delete;
+
+private:
+    std::string_view  name_;
+    std::string       args_;
+    Clock::time_point start_;
+};
+
+} // namespace trace
+
+} // namespace subprocess
+
+#ifdef SUBPROCESS_ENABLE_TRACE
+    #define SUBPROCESS_TRACE_CONCAT_(a, b) a##b
+    #define SUBPROCESS_TRACE_CONCAT(a, b)  SUBPROCESS_TRACE_CONCAT_(a, b)
+    /** Traces the enclosing block on the calling thread's track. */
+    #define SUBPROCESS_TRACE_SCOPE(...) \
+        ::subprocess::trace::Scope SUBPROCESS_TRACE_CONCAT(subprocess_trace_scope_, __LINE__)(__VA_ARGS__)
+    /** Runs statements against the global tracer (named `tracer`) when tracing is enabled at runtime. */
+    #define SUBPROCESS_TRACE(...)                                                    \
+        do {                                                                         \
+            auto& tracer = ::subprocess::trace::Tracer::global();                    \
+            if (tracer.is_enabled()) { __VA_ARGS__; }                                \
+        } while (false)
+#else
+    #define SUBPROCESS_TRACE_SCOPE(...) ((void)0)
+    #define SUBPROCESS_TRACE(...)       ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "subprocess/streamable.h"
+
+#ifdef SUBPROCESS_ENABLE_ZLIB
+struct z_stream_s;
+#endif
+
+namespace subprocess {
+
+/** @brief A streaming stage between a pipe and its destination.
+ *
+ *  A stage sees the data chunk by chunk, in order, and never the whole stream: it may hold
+ *  back data (e.g. an unterminated line) until a later chunk or finish(). The line stages 
+ *  bound it with a maximum line length, past which a line is no longer held back whole.
+ *  Stages are called from the thread that forwards the stream, one chunk at a time.
+ */
+class Transform {
+public:
+    virtual ~Transform() = default;
+
+    /** @brief Transforms `size` bytes at `data`, appending the result to `out`. */
+    virtual void process(const char* data, std::size_t size, Bytes& out) = 0;
+    /** @brief Appends the data held back to `out`, at the end of the stream. */
+    virtual void finish(Bytes& /* out */) {}
+};
+
+/** @brief Passes only complete lines, holding back an unterminated line until its newline.
+ *  The last line is passed by finish() even without a newline. */
+class LineTransform : public Transform {
+public:
+    /** @param max_line Length from which an unterminated line is passed without waiting for 
+     *                  its newline, so that an endless line cannot grow the stage without bound.
+     *  @throws std::invalid_argument If `max_line` is 0. */
+    explicit LineTransform(std::size_t max_line = 1 << 20);
+
+    virtual void process(const char* data, std::size_t size, Bytes& out) override;
+    virtual void finish(Bytes& out) override;
+
+private:
+    std::size_t max_line_;
+    std::string partial_;
+};
+
+/** @brief Prepends `prefix` to every line, e.g. the tag of the job producing the output. */
+class PrefixTransform : public Transform {
+public:
+    explicit PrefixTransform(std::string prefix);
+
+    virtual void process(const char* data, std::size_t size, Bytes& out) override;
+
+private:
+    std::string prefix_;
+    bool        line_start_;
+};
+
+/** @brief Passes only the lines for which `predicate` returns true. The predicate gets
+ *  each line without its newline. */
+class FilterTransform : public Transform {
+public:
+    /** @param max_line Length from which a line is judged on its beginning only, the rest of 
+     *                  it following the same verdict without being held back.
+     *  @throws std::invalid_argument If `predicate` is empty or `max_line` is 0. */
+    explicit FilterTransform(std::function<bool(std::string_view)> predicate, std::size_t max_line = 1 << 20);
+
+    virtual void process(const char* data, std::size_t size, Bytes& out) override;
+    virtual void finish(Bytes& out) override;
+
+private:
+    void        emit(std::string_view line, bool newline, Bytes& out);
+
+    std::function<bool(std::string_view)> predicate_;
+    std::size_t                           max_line_;
+    std::string                           partial_;
+    /** Verdict on the rest of the current line once it reached `max_line_`. */
+    std::optional<bool>                   overlong_;
+};
+
+#ifdef SUBPROCESS_ENABLE_ZLIB
+/** @brief Compresses the stream to the gzip format. Available when zlib is found at build time. */
+class GzipTransform : public Transform {
+public:
+    /** @param level zlib compression level, from 0 (none) to 9 (best), -1 for the default.
+     *  @throws std::runtime_error If zlib cannot be initialized. */
+    explicit GzipTransform(int level = -1);
+    ~GzipTransform();
+    GzipTransform(const GzipTransform& other)            = delete;
+    GzipTransform& operator=(const GzipTransform& other) = delete;
+
+    virtual void process(const char* data, std::size_t size, Bytes& out) override;
+    virtual void finish(Bytes& out) override;
+
+private:
+    void deflate(const char* data, std::size_t size, int flush, Bytes& out);
+
+    /** zlib's `z_stream`, declared opaque so that this header does not need zlib. */
+    std::unique_ptr<::z_stream_s> stream_;
+};
+#endif
+
+/** @brief Throughput of a stage of a TransformChain. */
+struct TransformStats {
+    std::uint64_t            bytes_in  = 0;
+    std::uint64_t            bytes_out = 0;
+    /** Calls to Transform::process(). */
+    std::uint64_t            chunks    = 0;
+    /** Time spent in the stage. */
+    std::chrono::nanoseconds busy      = std::chrono::nanoseconds(0);
+};
+
+/** @brief Writes to `destination` through a chain of transforms.
+ *
+ *  Being an OStreamable, a chain can be given to communicate() or communicate_async(), or
+ *  set as the destination of a process with std_out_t::transform(). Each written chunk goes
+ *  through the stages in order of addition, with a reused buffer per stage: memory does not
+ *  grow with the volume of the stream. close() flushes the stages, but leaves the destination
+ *  open to its owner.
+ *
+ *  @code
+ *  TransformChain chain(std::make_shared<File>(log_fd));
+ *  chain.add(std::make_shared<PrefixTransform>("[job 1] "));
+ *  communicate(pipe, chain, true);
+ *  @endcode
+ */
+class TransformChain : public OStreamable {
+public:
+    /** Flushes the stages if the chain is still open. */
+    virtual ~TransformChain();
+    /** @throws std::invalid_argument If `destination` is null. */
+    explicit TransformChain(std::shared_ptr<OStreamable> destination);
+    TransformChain(const TransformChain& other)            = delete;
+    TransformChain& operator=(const TransformChain& other) = delete;
+
+    /** @brief Appends a stage, which sees the output of the previous ones. */
+    TransformChain&              add(std::shared_ptr<Transform> stage);
+
+    virtual int                  fileno() const override;
+    virtual bool                 is_opened() const override;
+    virtual bool                 is_readable() const override;
+    virtual bool                 is_writable() const override;
+
+    /** @brief Passes `size` bytes through the stages and writes the result to the destination.
+     *  @return `size`, the number of bytes consumed. */
+    virtual Bytes::size_type     write(const Bytes& buf, Bytes::size_type size) override;
+    /** @brief Flushes the data held back by the stages to the destination. */
+    virtual void                 close() override;
+    virtual void                 release() override;
+
+    const std::shared_ptr<OStreamable>& destination() const;
+    std::size_t                  size() const;
+    /** @brief Throughput of the `index`-th stage, in order of addition. Thread-safe. */
+    TransformStats               stats(std::size_t index) const;
+
+private:
+    struct Stage {
+        std::shared_ptr<Transform> transform;
+        Bytes                      buffer;
+        std::atomic<std::uint64_t> bytes_in{0};
+        std::atomic<std::uint64_t> bytes_out{0};
+        std::atomic<std::uint64_t> chunks{0};
+        std::atomic<std::int64_t>  busy_ns{0};
+    };
+
+    /** Runs the stages from `first` on `size` bytes of `data`, then writes what is left. */
+    void                         run(std::size_t first, const Bytes& data, std::size_t size);
+
+    std::shared_ptr<OStreamable>        destination_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    bool                                closed_;
+};
+
+} // namespace subprocess
+
+#endif
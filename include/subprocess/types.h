@@ -1,13 +1,22 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <atomic>
 #include <filesystem>
+#include <initializer_list>
+#include <optional>
+#include <span>
 #include <string>
 #include <type_traits>
 #include <variant>
+#include <utility>
 #include <vector>
 
+#include <sched.h>
+#include <sys/resource.h>
+
 #include "subprocess/streamable.h"
+#include "subprocess/transform.h"
 
 namespace subprocess {
 
@@ -37,14 +46,45 @@ private:
  *  - `size == 1`  : Line buffering
  *  - `size >  1` : Full buffering with the specified size
  *  - `size <  0` : Full buffering with a default size
+ *
+ *  `pipe_size` sets the capacity of the kernel pipes themselves:
+ *  - `pipe_size == 0`        : Kernel default (usually 64 KiB)
+ *  - `pipe_size >  0`        : Set with `F_SETPIPE_SZ`, capped by `/proc/sys/fs/pipe-max-size`
+ *  - `pipe_size == ADAPTIVE` : Kernel default, doubled whenever the parent keeps finding 
+ *                              the stdout or stderr pipe full when reading
+ *
+ *  The resulting capacities are reported by Popen::pipe_sizes().
  */
 class bufsize_t {
 public:
-    explicit bufsize_t(ssize_t bufsize);
+    static constexpr ssize_t ADAPTIVE = -1;
+
+    explicit bufsize_t(ssize_t bufsize, ssize_t pipe_size = 0);
     ssize_t bufsize;
+    ssize_t pipe_size;
 };
 
-enum class IOOption { NONE, PIPE, STDOUT, DEVNULL };
+/** @brief Standard redirections. `SOCKETPAIR` connects a stream to an `AF_UNIX` `SOCK_STREAM` 
+ *  socketpair instead of a pipe (see socketpair_t); `STDOUT` is for standard error only. */
+enum class IOOption { NONE, PIPE, STDOUT, DEVNULL, SOCKETPAIR };
+
+/** @brief Describes the `AF_UNIX` socketpair connecting a standard stream, in place of a pipe.
+ *
+ *  The parent end is a Socket: it can send descriptors to the child with `SCM_RIGHTS` and, 
+ *  with `SOCK_SEQPACKET`, exchange messages whose boundaries are kept. When both standard 
+ *  input and standard output are socketpairs, they share the one of standard input: the child 
+ *  reads and writes the same socket, and the parent gets two handles on its end. Closing the 
+ *  standard input handle then only shuts down the direction towards the child.
+ *
+ *  - `type`        : `SOCK_STREAM` or `SOCK_SEQPACKET`
+ *  - `buffer_size` : `SO_SNDBUF` and `SO_RCVBUF` of both ends, 0 for the kernel default
+ */
+class socketpair_t {
+public:
+    explicit socketpair_t(int type = SOCK_STREAM, int buffer_size = 0);
+    int type;
+    int buffer_size;
+};
 
 /** @brief Represents the standard input source for a process.
  *
@@ -59,6 +99,10 @@ enum class IOOption { NONE, PIPE, STDOUT, DEVNULL };
  *  - If a source is available but does not provide a file descriptor, 
  *    communication between the source and standard input is emulated using 
  *    a pipe and the `communicate` function.
+ *  - If in-memory data is given, it is written to a sealed memfd before the 
+ *    spawn, which is then connected like a file.
+ *  - If a producer is given, its chunks are written to a pipe as the child 
+ *    consumes them.
  */
 class std_in_t {
 public:
@@ -67,11 +111,37 @@ public:
     explicit std_in_t(IOOption option);
     explicit std_in_t(std::istream* stream);
     explicit std_in_t(const std::filesystem::path& file);
+    explicit std_in_t(const char* file);
+    explicit std_in_t(const std::string& file);
+    /** @brief Copies `data` into a sealed memfd that becomes the standard input of the child.
+     *
+     *  The child reads (and may seek) at its own pace; no pipe, thread or parent-side 
+     *  writes are involved after the spawn. Falls back to an `O_TMPFILE` when memfd is 
+     *  not available.
+     */
+    explicit std_in_t(const Bytes& data);
+    explicit std_in_t(std::span<const char> data);
+    /** @brief Streams the chunks returned by `producer` until it returns std::nullopt.
+     *
+     *  A thread of the parent calls the producer each time the pipe has room for more data 
+     *  (see Generator): memory stays bounded by the pipe plus one chunk. If the child closes 
+     *  its standard input early, the producer is no longer called.
+     */
+    explicit std_in_t(Generator::Producer producer);
+    explicit std_in_t(const socketpair_t& socketpair);
 
     std::shared_ptr<File>        pipe_reader;
     std::shared_ptr<File>        pipe_writer;
     std::shared_ptr<IStreamable> source;
 
+    /** @brief Puts `pipe_writer` in non-blocking mode once the process is created.
+     *
+     *  `write()` keeps its blocking semantics by polling, which lets the pipe be shared 
+     *  with an event loop or a `poll`-based caller.
+     */
+    std_in_t& set_non_blocking(bool non_blocking = true);
+    bool      non_blocking;
+
 private:
     static void auto_close(IStreamable* stream) noexcept {
         if (!stream)
@@ -85,6 +155,76 @@ private:
     }
 };
 
+/** @brief Describes an anonymous file that captures the output of a process.
+ *
+ *  The child writes straight into the file through `::dup2`; no pipe is involved and 
+ *  the parent does not copy anything. The file lives:
+ *  - In memory (`memfd_create`) when `size_hint` is at most `spill_threshold`.
+ *  - On disk (`O_TMPFILE` in `directory`) otherwise, or when memfd is not available.
+ *
+ *  The file is unlinked from the start and disappears with its last descriptor. The captured 
+ *  output is retrieved as a read-only mapping with Popen::captured_std_out() or 
+ *  Popen::captured_std_err().
+ */
+class capture_t {
+public:
+    explicit capture_t(
+        std::size_t                  size_hint       = 0, 
+        std::size_t                  spill_threshold = 64 << 20,
+        const std::filesystem::path& directory       = std::filesystem::temp_directory_path()
+    );
+    /** @brief Creates the anonymous file and returns its descriptor (close-on-exec). 
+     *  @throws OSError If the file cannot be created. */
+    int                   open() const;
+
+    std::size_t           size_hint;
+    std::size_t           spill_threshold;
+    std::filesystem::path directory;
+};
+
+/** @brief Keeps only the tail of the output of a process.
+ *
+ *  The pipe is drained by a thread of the parent as the child writes, into a TailBuffer 
+ *  holding the last `max_bytes` bytes (cut to the last `max_lines` lines if non-zero). 
+ *  Memory stays O(max_bytes) whatever the volume of the output. The tail is retrieved with 
+ *  Popen::tail_std_out() or Popen::tail_std_err(), while the process runs or after it exits.
+ */
+class tail_t {
+public:
+    explicit tail_t(std::size_t max_bytes, std::size_t max_lines = 0);
+
+    std::size_t max_bytes;
+    std::size_t max_lines;
+};
+
+/** @brief Sends the output of a process to several sinks.
+ *
+ *  The pipe is drained by a thread of the parent into a Tee. Sinks that are pipes, sockets or 
+ *  regular files and use SinkPolicy::BLOCK are fed in the kernel with tee(2) and splice(2), 
+ *  without copying the data to user space; the others get a copy of each chunk. A slow 
+ *  SinkPolicy::DROP or SinkPolicy::BUFFER sink does not hold back the other sinks.
+ *
+ *  @code
+ *  tee_t tee;
+ *  tee.add(log_fd).add(&std::cout, SinkPolicy::DROP);
+ *  Popen p(PopenConfig(args_t("make"), std_out_t(tee)));
+ *  @endcode
+ */
+class tee_t {
+public:
+    tee_t();
+
+    /** The descriptor is not closed by the tee. */
+    tee_t& add(int fd, SinkPolicy policy = SinkPolicy::BLOCK, std::size_t limit = 0);
+    tee_t& add(std::ostream* stream, SinkPolicy policy = SinkPolicy::BLOCK, std::size_t limit = 0);
+    /** @throws OSError If the file cannot be opened. */
+    tee_t& add(const std::filesystem::path& file, SinkPolicy policy = SinkPolicy::BLOCK, std::size_t limit = 0);
+    tee_t& add(std::function<void(const Bytes&)> callback, SinkPolicy policy = SinkPolicy::BLOCK, std::size_t limit = 0);
+    tee_t& add(std::shared_ptr<OStreamable> sink, SinkPolicy policy = SinkPolicy::BLOCK, std::size_t limit = 0);
+
+    std::shared_ptr<Tee> tee;
+};
+
 /** @brief Represents the standard output destination for a process.
  *
  *  This class defines how the standard output of a process is managed. It supports 
@@ -107,11 +247,33 @@ public:
     explicit std_out_t(IOOption option);
     explicit std_out_t(std::ostream* stream);
     explicit std_out_t(const std::filesystem::path& file);
+    explicit std_out_t(const capture_t& capture);
+    explicit std_out_t(const tail_t& tail);
+    explicit std_out_t(const tee_t& tee);
+    explicit std_out_t(const socketpair_t& socketpair);
 
     std::shared_ptr<File>        pipe_reader;
     std::shared_ptr<File>        pipe_writer;
     std::shared_ptr<OStreamable> destination;
 
+    /** @brief Puts `pipe_reader` in non-blocking mode once the process is created.
+     *
+     *  `read_some()` then returns `std::nullopt` instead of waiting for data, while the 
+     *  other operations of the pipe keep their blocking semantics by polling.
+     */
+    std_out_t& set_non_blocking(bool non_blocking = true);
+    bool       non_blocking;
+    /** @brief Passes the output through `stage` before it reaches `destination`.
+     *
+     *  `destination` is wrapped in a TransformChain, which further calls extend. The output 
+     *  then goes through a pipe drained by a thread of the parent, even if `destination` has 
+     *  a file descriptor.
+     *  @throws std::invalid_argument If there is no destination, or it is a capture_t.
+     */
+    std_out_t& transform(std::shared_ptr<Transform> stage);
+    /** @brief True if `destination` is an anonymous capture file (see capture_t). */
+    bool       is_capture;
+
 private:
     static void auto_close(OStreamable* stream) noexcept {
         if (!stream)
@@ -149,6 +311,9 @@ public:
     explicit std_err_t(IOOption option);
     explicit std_err_t(std::ostream* stream);
     explicit std_err_t(const std::filesystem::path& file);
+    explicit std_err_t(const capture_t& capture);
+    explicit std_err_t(const tail_t& tail);
+    explicit std_err_t(const tee_t& tee);
 
     std::shared_ptr<File>        pipe_reader;
     std::shared_ptr<File>        pipe_writer;
@@ -156,6 +321,24 @@ public:
 
     bool is_std_out;
 
+    /** @brief Puts `pipe_reader` in non-blocking mode once the process is created.
+     *
+     *  `read_some()` then returns `std::nullopt` instead of waiting for data, while the 
+     *  other operations of the pipe keep their blocking semantics by polling.
+     */
+    std_err_t& set_non_blocking(bool non_blocking = true);
+    bool       non_blocking;
+    /** @brief Passes the output through `stage` before it reaches `destination`.
+     *
+     *  `destination` is wrapped in a TransformChain, which further calls extend. The output 
+     *  then goes through a pipe drained by a thread of the parent, even if `destination` has 
+     *  a file descriptor.
+     *  @throws std::invalid_argument If there is no destination, or it is a capture_t.
+     */
+    std_err_t& transform(std::shared_ptr<Transform> stage);
+    /** @brief True if `destination` is an anonymous capture file (see capture_t). */
+    bool       is_capture;
+
 private:
     static void auto_close(OStreamable* stream) noexcept {
         if (!stream)
@@ -169,11 +352,127 @@ private:
     }
 };
 
+/** @brief Represents resource limits for a process.
+ *
+ *  Each limit (`RLIMIT_AS`, `RLIMIT_CPU`, `RLIMIT_NOFILE`, `RLIMIT_CORE`, ...) is applied 
+ *  with `setrlimit` in the child between fork and exec. Only system calls are made there, 
+ *  so no `preexec_fn_t` is needed. A child that cannot apply a limit exits with 
+ *  `EXIT_FAILURE` before executing the program.
+ *
+ *  Limits given with a single value set both the soft and the hard limit.
+ */
+class rlimit_t {
+public:
+    rlimit_t() = default;
+    explicit rlimit_t(std::initializer_list<std::pair<int, ::rlim_t>> limits);
+
+    rlimit_t& set(int resource, ::rlim_t limit);
+    rlimit_t& set(int resource, ::rlim_t soft, ::rlim_t hard);
+
+    std::vector<std::pair<int, ::rlimit>> limits;
+};
+
+/** @brief I/O scheduling classes for sched_t::set_ioprio(), as defined by `ioprio_set(2)`. */
+enum class IOPrioClass { REALTIME = 1, BEST_EFFORT = 2, IDLE = 3 };
+
+/** @brief Represents the CPU and I/O scheduling of a process.
+ *
+ *  Settings left unset are inherited from the parent. They are applied in the child 
+ *  between fork and exec with plain system calls, so no `preexec_fn_t` is needed:
+ *  - `affinity` : `sched_setaffinity`, restricted to the given CPUs
+ *  - `policy`   : `sched_setscheduler`, e.g. `SCHED_OTHER`, `SCHED_BATCH` or `SCHED_IDLE`
+ *  - `nice`     : `setpriority`; lowering the value below the parent's requires privileges
+ *  - `ioprio`   : `ioprio_set`, as a class and a level from 0 (highest) to 7
+ *
+ *  A child that cannot apply a setting exits with `EXIT_FAILURE` before executing the program.
+ */
+class sched_t {
+public:
+    sched_t() = default;
+
+    sched_t& set_affinity(const std::vector<int>& cpus);
+    sched_t& set_policy(int policy);
+    sched_t& set_nice(int nice);
+    sched_t& set_ioprio(IOPrioClass ioprio_class, int level = 4);
+
+    std::optional<::cpu_set_t> affinity;
+    std::optional<int>         policy;
+    std::optional<int>         nice;
+    /** Encoded as `(class << 13) | level`. */
+    std::optional<int>         ioprio;
+};
+
+/** @brief Spreads processes round-robin across a set of CPUs.
+ *
+ *  Each call to next() pins the returned sched_t to the following CPU of the set. 
+ *  The placement can be shared between threads.
+ */
+class round_robin_t {
+public:
+    explicit round_robin_t(std::vector<int> cpus);
+
+    /** @brief Returns `base` with its affinity set to the next CPU. */
+    sched_t next(sched_t base = sched_t());
+
+private:
+    std::vector<int>         cpus_;
+    std::atomic<std::size_t> next_;
+};
+
+/** @brief Extra file descriptors inherited by a process, beyond the standard streams.
+ *
+ *  Each mapping duplicates a descriptor of the parent onto a chosen number in the child, 
+ *  e.g. a data pipe on 3, a memfd on 4 and a control socket on 5. The mappings are applied 
+ *  all at once in the child, with plain system calls: a source may be the target of another 
+ *  mapping (e.g. swapping 3 and 4) or a standard stream of the parent.
+ *
+ *  With at least one mapping and `close_others` set, every other descriptor above 2 is 
+ *  closed on exec in the child, with `close_range(2)` where available, so that the child 
+ *  sees exactly the descriptors it was given.
+ */
+class pass_fds_t {
+public:
+    pass_fds_t() = default;
+    /** @brief Pairs of (descriptor of the parent, number in the child). */
+    pass_fds_t(std::initializer_list<std::pair<int, int>> mappings);
+
+    /** @throws std::invalid_argument If `fd` is negative, `target` is below 3 or already mapped. */
+    pass_fds_t&           add(int fd, int target);
+    /** @brief Opens a pipe whose write end is `target` in the child, and returns its read end. */
+    std::shared_ptr<File> pipe_from_child(int target);
+    /** @brief Opens a pipe whose read end is `target` in the child, and returns its write end. */
+    std::shared_ptr<File> pipe_to_child(int target);
+    pass_fds_t&           set_close_others(bool close_others);
+
+    std::vector<std::pair<int, int>>   mappings;
+    /** Pipe ends opened for the child, closed in the parent once the child is spawned. */
+    std::vector<std::shared_ptr<File>> child_ends;
+    bool                               close_others = true;
+
+private:
+    std::shared_ptr<File> open_pipe(int target, bool child_reads);
+
+    static void auto_close(File* file) noexcept {
+        if (!file)
+            return;
+        try {
+            file->close();
+        } catch (const std::exception& e) {
+            perror("Failed to close the pipe");
+        }
+        delete file;
+    }
+};
+
 /** @brief Represents a function to be executed before executing a process after a fork.
  *
  *  This class allows the specification of a function that will be executed 
  *  after forking but before executing a new process. It is useful for setting 
  *  up the environment or modifying process attributes before the new process starts.
+ *
+ *  @note The function runs in a copy of a possibly multithreaded parent, where only 
+ *        async-signal-safe functions may be called: no allocation, locking or stdio. 
+ *        An empty function is not called.
  */
 class preexec_fn_t {
 public:
@@ -181,6 +480,45 @@ public:
     std::function<void()> preexec_fn;
 };
 
+/** @brief Data fed to the standard input of a process started by run().
+ *
+ *  The data is placed in a sealed memfd (see std_in_t), so that the child reads it 
+ *  at its own pace without being fed by the parent. No data means no input.
+ */
+class input_t {
+public:
+    input_t() = default;
+    explicit input_t(const Bytes& data);
+    explicit input_t(Bytes&& data);
+    explicit input_t(const std::string& data);
+    std::optional<Bytes> data;
+};
+
+/** @brief Captures stdout and stderr of a process started by run().
+ *
+ *  `size_hint` is the expected size of stdout, used to size its buffer upfront.
+ */
+class capture_output_t {
+public:
+    explicit capture_output_t(bool capture_output, Bytes::size_type size_hint = 0);
+    bool             capture_output;
+    Bytes::size_type size_hint;
+};
+
+/** @brief Makes run() throw CalledProcessError if the process exits with a non-zero returncode. */
+class check_t {
+public:
+    explicit check_t(bool check);
+    bool check;
+};
+
+/** @brief Time limit of run() in seconds (negative: unlimited). */
+class timeout_t {
+public:
+    explicit timeout_t(double timeout);
+    double timeout;
+};
+
 } // namespace types
 
 } // namespace subprocess
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "subprocess/async.h"
+#include "subprocess/exception.h"
+#include "internal.h"
+
+namespace subprocess {
+
+namespace {
+
+thread_local EventLoop* current_loop = nullptr;
+
+/** Interval at which processes are polled when pidfd is not supported by the kernel. */
+constexpr int process_poll_interval_ms = 10;
+
+bool has_exited(::pid_t pid) {
+    ::siginfo_t info{};
+    if (::waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == -1)
+        return true; /** ECHILD: already reaped by someone else. */
+    return info.si_pid == pid;
+}
+
+} // namespace
+
+EventLoop::EventLoop() : epoll_fd_(-1), event_fd_(-1), pending_(0) {
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1)
+        throw OSError(errno, std::generic_category(), "Failed to create epoll instance");
+
+    event_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event_fd_ == -1) {
+        ::close(epoll_fd_);
+        throw OSError(errno, std::generic_category(), "Failed to create eventfd");
+    }
+
+    ::epoll_event event{};
+    event.events  = EPOLLIN;
+    event.data.fd = event_fd_;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) == -1) {
+        ::close(event_fd_);
+        ::close(epoll_fd_);
+        throw OSError(errno, std::generic_category(), "Failed to register eventfd");
+    }
+}
+
+EventLoop::~EventLoop() {
+    for (auto& [pidfd, handle] : pidfds_)
+        ::close(pidfd);
+    ::close(event_fd_);
+    ::close(epoll_fd_);
+}
+
+EventLoop& EventLoop::current() {
+    static EventLoop default_loop;
+    return current_loop ? *current_loop : default_loop;
+}
+
+int  EventLoop::fileno() const                  { return epoll_fd_; }
+void EventLoop::set_executor(Executor executor) { executor_ = std::move(executor); }
+
+void EventLoop::spawn(Task<void> task) {
+    ++pending_;
+    [](EventLoop& loop, Task<void> task) -> detail::Detached {
+        co_await loop.schedule();
+        try {
+            co_await task;
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(loop.mutex_);
+            if (!loop.error_)
+                loop.error_ = std::current_exception();
+        }
+        --loop.pending_;
+    }(*this, std::move(task));
+}
+
+void EventLoop::run() {
+    while (pending_ > 0)
+        run_once();
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error = std::exchange(error_, nullptr);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+std::size_t EventLoop::run_once(double timeout) {
+    EventLoop* previous = std::exchange(current_loop, this);
+    struct Restore {
+        EventLoop* previous;
+        ~Restore() { current_loop = previous; }
+    } restore{previous};
+
+    int timeout_ms = timeout < 0 ? -1 : static_cast<int>(std::min<double>(timeout * 1000, INT_MAX));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ready_.empty())
+            timeout_ms = 0;
+        else if (!polled_.empty() && (timeout_ms < 0 || timeout_ms > process_poll_interval_ms))
+            timeout_ms = process_poll_interval_ms;
+    }
+
+    ::epoll_event events[64];
+    int n = ::epoll_wait(epoll_fd_, events, 64, timeout_ms);
+    if (n == -1 && errno != EINTR)
+        throw OSError(errno, std::generic_category(), "Failed to wait for events");
+
+    std::deque<std::coroutine_handle<>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == event_fd_) {
+                std::uint64_t value;
+                while (::read(event_fd_, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+            if (auto it = pidfds_.find(fd); it != pidfds_.end()) {
+                ready_.push_back(it->second);
+                ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+                ::close(fd);
+                pidfds_.erase(it);
+                continue;
+            }
+            auto it = watches_.find(fd);
+            if (it == watches_.end())
+                continue;
+            auto& watch = it->second;
+            if (watch.reader && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                ready_.push_back(std::exchange(watch.reader, nullptr));
+            if (watch.writer && (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+                ready_.push_back(std::exchange(watch.writer, nullptr));
+            rearm(fd, watch);
+            if (!watch.reader && !watch.writer)
+                watches_.erase(it);
+        }
+
+        for (auto it = polled_.begin(); it != polled_.end();) {
+            if (has_exited(it->first)) {
+                ready_.push_back(it->second);
+                it = polled_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        ready.swap(ready_);
+    }
+
+    for (auto handle : ready)
+        dispatch(handle);
+    return ready.size();
+}
+
+void EventLoop::post(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.push_back(handle);
+    }
+    std::uint64_t value = 1;
+    if (::write(event_fd_, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        throw OSError(errno, std::generic_category(), "Failed to wake up event loop");
+}
+
+bool EventLoop::watch(int fd, bool write, std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto [it, inserted] = watches_.try_emplace(fd);
+    auto& watch = it->second;
+    (write ? watch.writer : watch.reader) = handle;
+
+    ::epoll_event event{};
+    event.events  = EPOLLONESHOT | (watch.reader ? static_cast<std::uint32_t>(EPOLLIN) : 0u) | (watch.writer ? static_cast<std::uint32_t>(EPOLLOUT) : 0u);
+    event.data.fd = fd;
+    if (::epoll_ctl(epoll_fd_, inserted ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event) == -1) {
+        int error = errno;
+        (write ? watch.writer : watch.reader) = nullptr;
+        if (inserted)
+            watches_.erase(it);
+        /** Regular files and directories do not support polling; they are always ready. */
+        if (error == EPERM)
+            return false;
+        throw OSError(error, std::generic_category(), "Failed to register file descriptor");
+    }
+    return true;
+}
+
+bool EventLoop::watch_process(::pid_t pid, std::coroutine_handle<> handle) {
+    int pidfd = internal::pidfd_open(pid);
+    if (pidfd == -1) {
+        if (errno == ESRCH)
+            return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        polled_.emplace_back(pid, handle);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ::epoll_event event{};
+    event.events  = EPOLLIN;
+    event.data.fd = pidfd;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pidfd, &event) == -1) {
+        int error = errno;
+        ::close(pidfd);
+        throw OSError(error, std::generic_category(), "Failed to register pidfd");
+    }
+    pidfds_.emplace(pidfd, handle);
+    return true;
+}
+
+void EventLoop::rearm(int fd, const Watch& watch) {
+    if (!watch.reader && !watch.writer) {
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        return;
+    }
+    ::epoll_event event{};
+    event.events  = EPOLLONESHOT | (watch.reader ? static_cast<std::uint32_t>(EPOLLIN) : 0u) | (watch.writer ? static_cast<std::uint32_t>(EPOLLOUT) : 0u);
+    event.data.fd = fd;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+}
+
+void EventLoop::dispatch(std::coroutine_handle<> handle) {
+    if (executor_)
+        executor_(handle);
+    else
+        handle.resume();
+}
+
+} // namespace subprocess
@@ -1,4 +1,11 @@
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "subprocess/bytes.h"
+#include "subprocess/exception.h"
 
 namespace subprocess {
 
@@ -20,4 +27,48 @@ const Bytes::value_type* Bytes::data() const { return bytes_.data(); }
 char* Bytes::c_str() { return static_cast<char*>(data()); }
 const char* Bytes::c_str() const { return static_cast<const char*>(data()); }
 
+MappedBytes::~MappedBytes() {
+    if (data_)
+        ::munmap(const_cast<value_type*>(data_), size_);
+}
+MappedBytes::MappedBytes(int fd) : data_(nullptr), size_(0) {
+    /** Fails with EINVAL for files that do not support sealing, which are mapped as they are. */
+    ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+
+    struct ::stat st;
+    if (::fstat(fd, &st) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to retrieve file size");
+    size_ = st.st_size;
+    if (size_ == 0)
+        return;
+
+    void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        throw OSError(errno, std::generic_category(), "Failed to map file");
+    ::madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const value_type*>(data);
+}
+MappedBytes::MappedBytes(MappedBytes&& other) noexcept 
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+MappedBytes& MappedBytes::operator=(MappedBytes&& other) noexcept {
+    if (this != &other) {
+        if (data_)
+            ::munmap(const_cast<value_type*>(data_), size_);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+const MappedBytes::value_type& MappedBytes::operator[](size_type n) const { return data_[n]; }
+
+MappedBytes::size_type MappedBytes::size() const { return size_; }
+bool MappedBytes::empty() const { return size_ == 0; }
+
+const MappedBytes::value_type* MappedBytes::data() const { return data_; }
+const MappedBytes::value_type* MappedBytes::begin() const { return data_; }
+const MappedBytes::value_type* MappedBytes::end() const { return data_ + size_; }
+Bytes MappedBytes::to_bytes() const { return size_ ? Bytes(begin(), end()) : Bytes(); }
+
 } // namespace subprocess
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <string_view>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "subprocess/command.h"
+#include "subprocess/exception.h"
+
+namespace subprocess {
+
+namespace {
+
+/** Default search path of execvp(3) when PATH is unset. */
+constexpr std::string_view default_path = "/bin:/usr/bin";
+
+/** Sets errno when `path` is not an executable regular file. */
+bool is_executable(const std::string& path) {
+    struct ::stat st;
+    if (::stat(path.c_str(), &st) == -1)
+        return false;
+    if (!S_ISREG(st.st_mode)) {
+        errno = EACCES;
+        return false;
+    }
+    return ::access(path.c_str(), X_OK) == 0;
+}
+
+/** Resolves `program` like execvp(3): names containing a slash are used as is, others are searched in PATH. */
+std::string resolve(const std::string& program) {
+    if (program.find('/') != std::string::npos) {
+        if (!is_executable(program))
+            throw OSError(errno, std::generic_category(), "Program is not executable", program);
+        return program;
+    }
+
+    const char*      env  = std::getenv("PATH");
+    std::string_view dirs = env ? env : default_path;
+    while (true) {
+        auto        end = dirs.find(':');
+        std::string dir(dirs.substr(0, end));
+        std::string candidate = (dir.empty() ? std::string(".") : dir) + "/" + program;
+        if (is_executable(candidate))
+            return candidate;
+        if (end == std::string_view::npos)
+            break;
+        dirs.remove_prefix(end + 1);
+    }
+    throw OSError(ENOENT, std::generic_category(), "Program not found in PATH", program);
+}
+
+/** Returns N if `arg` is the placeholder `{N}`, -1 otherwise.
+ *  @throws std::invalid_argument If N is not below `limit`. */
+long placeholder_index(const std::string& arg, std::size_t limit) {
+    if (arg.size() < 3 || arg.front() != '{' || arg.back() != '}')
+        return -1;
+    if (!std::all_of(arg.begin() + 1, arg.end() - 1, [](char c) { return c >= '0' && c <= '9'; }))
+        return -1;
+    std::size_t index = 0;
+    for (std::size_t i = 1; i + 1 < arg.size(); ++i) {
+        index = index * 10 + (arg[i] - '0');
+        if (index >= limit)
+            throw std::invalid_argument("Placeholder " + arg + " exceeds the number of arguments.");
+    }
+    return static_cast<long>(index);
+}
+
+} // namespace
+
+/* ===================================== CommandPlan ===================================== */
+
+PopenConfig detail::CommandPlan::instantiate() const {
+    PopenConfig config;
+    config.bufsize    = bufsize;
+    config.preexec_fn = preexec_fn;
+    config.rlimit     = rlimit;
+    config.sched      = sched;
+    config.pass_fds   = pass_fds;
+
+    auto& [std_in_plan, std_out_plan, std_err_plan] = streams;
+    types::std_in_t std_in(std_in_plan.redirect == Redirect::PIPE ? types::IOOption::PIPE : types::IOOption::NONE);
+    std_in.set_non_blocking(std_in_plan.non_blocking);
+    std_in.source = std_in_plan.source;
+    config.std_in = std::move(std_in);
+
+    types::std_out_t std_out(std_out_plan.redirect == Redirect::PIPE ? types::IOOption::PIPE : types::IOOption::NONE);
+    std_out.set_non_blocking(std_out_plan.non_blocking);
+    std_out.destination = std_out_plan.destination;
+    config.std_out = std::move(std_out);
+
+    types::std_err_t std_err(
+        std_err_plan.redirect == Redirect::PIPE   ? types::IOOption::PIPE   :
+        std_err_plan.redirect == Redirect::STDOUT ? types::IOOption::STDOUT : types::IOOption::NONE
+    );
+    std_err.set_non_blocking(std_err_plan.non_blocking);
+    std_err.destination = std_err_plan.destination;
+    config.std_err = std::move(std_err);
+    return config;
+}
+
+/* ===================================== CommandTemplate ===================================== */
+
+CommandTemplate::CommandTemplate(PopenConfig&& config) {
+    config.validate();
+    auto plan = std::make_shared<detail::CommandPlan>();
+
+    plan->args = std::move(config.args->args);
+    if (plan->args.empty())
+        throw std::invalid_argument("Command must have at least one argument.");
+    /** Larger indices would have spawn() require values that have nowhere to go. */
+    std::size_t limit = plan->args.size();
+    if (placeholder_index(plan->args[0], limit) != -1)
+        throw std::invalid_argument("The program of a command cannot be a placeholder.");
+    plan->executable = resolve(plan->args[0]);
+
+    for (std::size_t i = 0; i < plan->args.size(); ++i) {
+        long index = placeholder_index(plan->args[i], limit);
+        if (index == -1) {
+            plan->argv.push_back(plan->args[i].data());
+        } else {
+            plan->argv.push_back(nullptr);
+            plan->holes.emplace_back(i, index);
+            plan->arity = std::max<std::size_t>(plan->arity, index + 1);
+        }
+    }
+    plan->argv.push_back(nullptr);
+
+    using Redirect = detail::CommandPlan::Redirect;
+    auto& std_in   = config.std_in.value();
+    auto& std_out  = config.std_out.value();
+    auto& std_err  = config.std_err.value();
+    auto& streams  = plan->streams;
+    if (std_in.source) {
+        if (std_in.source->fileno() == -1)
+            throw std::invalid_argument("Standard input of a command must be a file descriptor or a pipe.");
+        streams[0] = {Redirect::SHARED, false, std_in.source, nullptr};
+    } else if (std_in.pipe_writer) {
+        streams[0] = {Redirect::PIPE, std_in.non_blocking, nullptr, nullptr};
+    }
+    if (std::dynamic_pointer_cast<Socket>(std_in.pipe_writer) || std::dynamic_pointer_cast<Socket>(std_out.pipe_reader))
+        throw std::invalid_argument("Socketpairs cannot be reused between the processes of a command.");
+    if (std_out.is_capture || std_err.is_capture)
+        throw std::invalid_argument("Captured output cannot be shared between the processes of a command.");
+    if (std_out.destination) {
+        if (std_out.destination->fileno() == -1)
+            throw std::invalid_argument("Standard output of a command must be a file descriptor or a pipe.");
+        streams[1] = {Redirect::SHARED, false, nullptr, std_out.destination};
+    } else if (std_out.pipe_reader) {
+        streams[1] = {Redirect::PIPE, std_out.non_blocking, nullptr, nullptr};
+    }
+    if (std_err.is_std_out) {
+        streams[2] = {Redirect::STDOUT, false, nullptr, nullptr};
+    } else if (std_err.destination) {
+        if (std_err.destination->fileno() == -1)
+            throw std::invalid_argument("Standard error of a command must be a file descriptor or a pipe.");
+        streams[2] = {Redirect::SHARED, false, nullptr, std_err.destination};
+    } else if (std_err.pipe_reader) {
+        streams[2] = {Redirect::PIPE, std_err.non_blocking, nullptr, nullptr};
+    }
+
+    plan->bufsize    = std::move(config.bufsize.value());
+    plan->preexec_fn = std::move(config.preexec_fn.value());
+    plan->rlimit     = std::move(config.rlimit.value());
+    plan->sched      = std::move(config.sched.value());
+    if (!config.pass_fds->child_ends.empty())
+        throw std::invalid_argument("Pipes passed to the child cannot be shared between the processes of a command.");
+    plan->pass_fds   = std::move(config.pass_fds.value());
+    plan_            = std::move(plan);
+}
+
+Popen CommandTemplate::spawn(std::vector<std::string> values) const {
+    return Popen(*this, std::move(values));
+}
+
+std::size_t        CommandTemplate::placeholders() const { return plan_->arity;      }
+const std::string& CommandTemplate::executable() const   { return plan_->executable; }
+
+} // namespace subprocess
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "subprocess/coprocess.h"
+#include "subprocess/exception.h"
+#include "internal.h"
+
+namespace subprocess {
+
+namespace {
+
+/** Size of the reads that fill the buffer of newline-delimited responses. */
+constexpr Bytes::size_type line_chunk_size = 1 << 16;
+/** Time the destructor waits for the child to exit on EOF before killing it, in seconds. */
+constexpr double destructor_close_timeout = 5;
+
+} // namespace
+
+Coprocess::Coprocess(PopenConfig&& config, Framing framing, std::size_t max_in_flight)
+    : popen_(with_pipes(config)), framing_(framing), max_in_flight_(std::max<std::size_t>(max_in_flight, 1)),
+      writer_(popen_.std_in().value()), reader_(popen_.std_out().value()) {
+    reader_thread_ = std::thread([this] { read_responses(); });
+}
+
+Coprocess::~Coprocess() {
+    try {
+        close(destructor_close_timeout);
+    } catch (...) {
+        popen_.kill();
+        try {
+            popen_.wait();
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to wait for the coprocess: " << e.what() << std::endl;
+        }
+        if (reader_thread_.joinable())
+            reader_thread_.join();
+    }
+}
+
+PopenConfig&& Coprocess::with_pipes(PopenConfig& config) {
+    if (config.std_in && std::dynamic_pointer_cast<Socket>(config.std_in->pipe_writer)) {
+        config.set_value(types::std_out_t(types::socketpair_t()));
+        return std::move(config);
+    }
+    config.set_value(types::std_in_t(types::IOOption::PIPE));
+    config.set_value(types::std_out_t(types::IOOption::PIPE));
+    return std::move(config);
+}
+
+std::future<Bytes> Coprocess::send(const Bytes& message) {
+    Bytes data = frame(message);
+
+    /** Held until the request is written, so that requests reach the pipe in the order of `pending_`. */
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    std::future<Bytes> response;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return closed_ || error_ || pending_.size() < max_in_flight_; });
+        if (closed_)
+            throw std::runtime_error("Coprocess is closed.");
+        if (error_)
+            std::rethrow_exception(error_);
+        pending_.emplace_back();
+        response = pending_.back().get_future();
+    }
+
+    internal::SigpipeGuard guard;
+    writer_->write(data, data.size());
+    return response;
+}
+
+Bytes Coprocess::request(const Bytes& message) {
+    return send(message).get();
+}
+
+std::optional<int> Coprocess::close(double timeout) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    /** Wakes up senders waiting for a slot, which give up and release the write lock. */
+    not_full_.notify_all();
+    {
+        std::lock_guard<std::mutex> write_lock(write_mutex_);
+        if (writer_->is_opened())
+            writer_->close();
+    }
+
+    auto returncode = popen_.wait(timeout);
+    if (reader_thread_.joinable())
+        reader_thread_.join();
+    return returncode;
+}
+
+std::size_t Coprocess::in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+Popen& Coprocess::popen() { return popen_; }
+
+Bytes Coprocess::frame(const Bytes& message) const {
+    Bytes data;
+    if (framing_ == Framing::LENGTH_PREFIXED) {
+        if (message.size() > std::numeric_limits<std::uint32_t>::max())
+            throw std::invalid_argument("Message is too large to be length-prefixed.");
+        std::uint32_t size = static_cast<std::uint32_t>(message.size());
+        data.resize(4 + message.size());
+        for (int i = 0; i < 4; ++i)
+            data[i] = static_cast<char>(size >> (24 - 8 * i));
+        std::copy(message.data(), message.data() + message.size(), data.data() + 4);
+    } else {
+        if (std::find(message.data(), message.data() + message.size(), '\n') != message.data() + message.size())
+            throw std::invalid_argument("Newline-delimited message contains a newline.");
+        data.resize(message.size() + 1);
+        std::copy(message.data(), message.data() + message.size(), data.data());
+        data[message.size()] = '\n';
+    }
+    return data;
+}
+
+std::optional<Bytes> Coprocess::read_frame() {
+    if (framing_ == Framing::LENGTH_PREFIXED) {
+        Bytes header = reader_->read(4);
+        if (header.empty())
+            return std::nullopt;
+        if (header.size() < 4)
+            throw std::runtime_error("Coprocess closed its standard output in the middle of a response.");
+        std::uint32_t size = 0;
+        for (int i = 0; i < 4; ++i)
+            size = (size << 8) | static_cast<unsigned char>(header[i]);
+        Bytes response = reader_->read(size);
+        if (response.size() < size)
+            throw std::runtime_error("Coprocess closed its standard output in the middle of a response.");
+        return response;
+    }
+
+    std::size_t scanned = line_start_;
+    while (true) {
+        if (auto end = lines_.find('\n', scanned); end != std::string::npos) {
+            Bytes response(lines_.begin() + line_start_, lines_.begin() + end);
+            line_start_ = end + 1;
+            /** Compact once the consumed prefix dominates the buffer. */
+            if (line_start_ > lines_.size() / 2) {
+                lines_.erase(0, line_start_);
+                line_start_ = 0;
+            }
+            return response;
+        }
+        scanned = lines_.size();
+
+        auto chunk = reader_->read_some(line_chunk_size);
+        if (!chunk || chunk->empty()) {
+            if (line_start_ < lines_.size())
+                throw std::runtime_error("Coprocess closed its standard output in the middle of a response.");
+            return std::nullopt;
+        }
+        lines_.append(chunk->data(), chunk->size());
+    }
+}
+
+void Coprocess::read_responses() {
+    std::exception_ptr error;
+    try {
+        while (auto response = read_frame()) {
+            std::promise<Bytes> promise;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (pending_.empty())
+                    throw std::runtime_error("Coprocess sent a response without a request.");
+                promise = std::move(pending_.front());
+                pending_.pop_front();
+            }
+            not_full_.notify_one();
+            promise.set_value(std::move(response.value()));
+        }
+        error = std::make_exception_ptr(std::runtime_error("Coprocess closed its standard output."));
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    std::deque<std::promise<Bytes>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = error;
+        pending.swap(pending_);
+    }
+    not_full_.notify_all();
+    for (auto& promise : pending)
+        promise.set_exception(error);
+}
+
+} // namespace subprocess
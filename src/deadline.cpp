@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+#include <utility>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "subprocess/deadline.h"
+#include "subprocess/exception.h"
+#include "internal.h"
+
+namespace subprocess {
+
+namespace {
+
+/** True if `pid` is a child of this process that has not exited yet. */
+bool is_running_child(::pid_t pid) {
+    ::siginfo_t info{};
+    if (::waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == -1)
+        return false; /** ECHILD: reaped already, or not our child. */
+    return info.si_pid == 0;
+}
+
+/** Signals through the pidfd when there is one: unlike kill(2), it cannot reach a process that recycled the pid. */
+bool send_signal(::pid_t pid, int pidfd, int signal) {
+    if (pidfd != -1)
+        return internal::pidfd_send_signal(pidfd, signal) == 0;
+    return ::kill(pid, signal) == 0;
+}
+
+} // namespace
+
+DeadlineManager::DeadlineManager(std::chrono::milliseconds tick, std::size_t slots, std::chrono::milliseconds grace)
+    : tick_(tick), grace_(grace), timer_fd_(-1), event_fd_(-1), slots_(slots, npos) {
+    if (tick.count() <= 0)
+        throw std::invalid_argument("Deadline tick must be positive.");
+    if (slots == 0)
+        throw std::invalid_argument("Deadline wheel must have at least one slot.");
+
+    timer_fd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd_ == -1)
+        throw OSError(errno, std::generic_category(), "Failed to create timerfd");
+    event_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event_fd_ == -1) {
+        ::close(timer_fd_);
+        throw OSError(errno, std::generic_category(), "Failed to create eventfd");
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+DeadlineManager::~DeadlineManager() {
+    std::uint64_t value = 1;
+    if (::write(event_fd_, &value, sizeof(value)) == -1)
+        ::perror("Failed to stop the deadline manager");
+    thread_.join();
+    for (auto& entry : entries_) {
+        if (entry.active && entry.pidfd != -1)
+            ::close(entry.pidfd);
+    }
+    ::close(event_fd_);
+    ::close(timer_fd_);
+}
+
+DeadlineManager::DeadlineId DeadlineManager::add(::pid_t pid, std::chrono::milliseconds timeout, std::chrono::milliseconds grace) {
+    /** Without pidfd support, or once the child is reaped already, signals fall back to kill(2). */
+    int pidfd = internal::pidfd_open(pid);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::uint32_t index;
+    if (free_ != npos) {
+        index = free_;
+        free_ = entries_[index].next;
+    } else {
+        index = static_cast<std::uint32_t>(entries_.size());
+        entries_.emplace_back();
+    }
+
+    auto& entry      = entries_[index];
+    entry.pid        = pid;
+    entry.pidfd      = pidfd;
+    entry.grace      = grace;
+    entry.terminated = false;
+    entry.active     = true;
+    /** One extra tick, as the current tick is already partly elapsed. */
+    schedule(index, to_ticks(timeout) + 1);
+    if (size_++ == 0 && !set_timer(true)) {
+        int error = errno;
+        unlink(index);
+        release(index);
+        throw OSError(error, std::generic_category(), "Failed to set deadline timer");
+    }
+    return (static_cast<DeadlineId>(entry.generation) << 32) | index;
+}
+DeadlineManager::DeadlineId DeadlineManager::add(::pid_t pid, std::chrono::milliseconds timeout) {
+    return add(pid, timeout, grace_);
+}
+DeadlineManager::DeadlineId DeadlineManager::add(const Popen& popen, std::chrono::milliseconds timeout) {
+    return add(popen.pid(), timeout, grace_);
+}
+
+bool DeadlineManager::cancel(DeadlineId id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::uint32_t index = static_cast<std::uint32_t>(id);
+    if (index >= entries_.size())
+        return false;
+    auto& entry = entries_[index];
+    if (!entry.active || entry.generation != static_cast<std::uint32_t>(id >> 32))
+        return false;
+    unlink(index);
+    release(index);
+    return true;
+}
+
+std::vector<DeadlineManager::Escalation> DeadlineManager::take_escalations() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::exchange(escalations_, {});
+}
+
+std::size_t DeadlineManager::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+void DeadlineManager::run() {
+    ::pollfd fds[2] = {
+        { timer_fd_, POLLIN, 0 },
+        { event_fd_, POLLIN, 0 }
+    };
+    while (true) {
+        if (::poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            ::perror("Failed to wait for the deadline timer");
+            return;
+        }
+        if (fds[1].revents & POLLIN)
+            return;
+
+        std::uint64_t expirations = 0;
+        if (::read(timer_fd_, &expirations, sizeof(expirations)) != sizeof(expirations))
+            continue;
+        std::lock_guard<std::mutex> lock(mutex_);
+        /** Ticks missed while the thread was not scheduled are caught up one by one. */
+        for (std::uint64_t i = 0; i < expirations && armed_; ++i)
+            advance();
+    }
+}
+
+void DeadlineManager::advance() {
+    ++now_;
+    std::uint32_t index = slots_[now_ % slots_.size()];
+    while (index != npos) {
+        std::uint32_t next  = entries_[index].next;
+        auto&         entry = entries_[index];
+        if (entry.expiry == now_) {
+            unlink(index);
+            int signal = !entry.terminated && entry.grace.count() > 0 ? SIGTERM : SIGKILL;
+            if (!is_running_child(entry.pid) || !send_signal(entry.pid, entry.pidfd, signal)) {
+                release(index);
+            } else {
+                escalations_.push_back({(static_cast<DeadlineId>(entry.generation) << 32) | index, entry.pid, signal, Clock::now()});
+                if (signal == SIGTERM) {
+                    entry.terminated = true;
+                    schedule(index, to_ticks(entry.grace));
+                } else {
+                    release(index);
+                }
+            }
+        }
+        index = next;
+    }
+}
+
+void DeadlineManager::schedule(std::uint32_t index, std::uint64_t ticks) {
+    auto& entry  = entries_[index];
+    entry.expiry = now_ + std::max<std::uint64_t>(ticks, 1);
+    auto& head   = slots_[entry.expiry % slots_.size()];
+    entry.prev   = npos;
+    entry.next   = head;
+    if (head != npos)
+        entries_[head].prev = index;
+    head = index;
+}
+
+void DeadlineManager::unlink(std::uint32_t index) {
+    auto& entry = entries_[index];
+    if (entry.prev != npos)
+        entries_[entry.prev].next = entry.next;
+    else
+        slots_[entry.expiry % slots_.size()] = entry.next;
+    if (entry.next != npos)
+        entries_[entry.next].prev = entry.prev;
+    entry.prev = entry.next = npos;
+}
+
+void DeadlineManager::release(std::uint32_t index) {
+    auto& entry  = entries_[index];
+    entry.active = false;
+    ++entry.generation;
+    entry.next   = free_;
+    free_        = index;
+    if (entry.pidfd != -1) {
+        ::close(entry.pidfd);
+        entry.pidfd = -1;
+    }
+    /** Also called on the wheel thread, which cannot throw: a timer left armed only ticks idly. */
+    if (--size_ == 0 && !set_timer(false))
+        ::perror("Failed to disarm the deadline timer");
+}
+
+std::uint64_t DeadlineManager::to_ticks(std::chrono::milliseconds duration) const {
+    return std::max<std::int64_t>((duration.count() + tick_.count() - 1) / tick_.count(), 0);
+}
+
+bool DeadlineManager::set_timer(bool armed) {
+    ::itimerspec spec{};
+    if (armed) {
+        spec.it_interval.tv_sec  = tick_.count() / 1000;
+        spec.it_interval.tv_nsec = (tick_.count() % 1000) * 1000000;
+        spec.it_value            = spec.it_interval;
+    }
+    if (::timerfd_settime(timer_fd_, 0, &spec, nullptr) == -1)
+        return false;
+    armed_ = armed;
+    return true;
+}
+
+} // namespace subprocess
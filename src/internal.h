@@ -0,0 +1,61 @@
+#ifndef INTERNAL_H
+#define INTERNAL_H
+
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/** Helpers shared by the translation units of the library, not part of its interface. */
+namespace subprocess::internal {
+
+/** pidfd_open(2), which glibc does not wrap before 2.36. Fails with ENOSYS on older kernel headers. */
+inline int pidfd_open(::pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/** pidfd_send_signal(2) with no siginfo. Fails with ENOSYS on older kernel headers. */
+inline int pidfd_send_signal(int pidfd, int signal) {
+#ifdef SYS_pidfd_send_signal
+    return static_cast<int>(::syscall(SYS_pidfd_send_signal, pidfd, signal, nullptr, 0));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/** @brief Blocks SIGPIPE on the calling thread for its lifetime, so that writing to a pipe or 
+ *  socket whose reader is gone fails with EPIPE instead of killing the process. A SIGPIPE 
+ *  raised meanwhile is discarded, unless it was already blocked. */
+class SigpipeGuard {
+public:
+    SigpipeGuard() {
+        sigemptyset(&set_);
+        sigaddset(&set_, SIGPIPE);
+        ::pthread_sigmask(SIG_BLOCK, &set_, &old_);
+    }
+    ~SigpipeGuard() {
+        if (!sigismember(&old_, SIGPIPE)) {
+            ::timespec zero{};
+            while (::sigtimedwait(&set_, nullptr, &zero) > 0) {}
+        }
+        ::pthread_sigmask(SIG_SETMASK, &old_, nullptr);
+    }
+
+private:
+    ::sigset_t set_;
+    ::sigset_t old_;
+};
+
+} // namespace subprocess::internal
+
+#endif
@@ -0,0 +1,491 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "subprocess/exception.h"
+#include "subprocess/io_uring.h"
+#include "subprocess/streamable.h"
+#include "internal.h"
+
+namespace subprocess {
+
+namespace {
+
+/** IORING_OP_WAITID (Linux 6.7), missing from older kernel headers. */
+constexpr std::uint8_t op_waitid = 50;
+
+std::atomic<IOBackend>   current_backend{IOBackend::BLOCKING};
+std::atomic<std::size_t> total_enters{0};
+
+int sys_io_uring_setup(unsigned entries, ::io_uring_params* params) {
+    return static_cast<int>(::syscall(SYS_io_uring_setup, entries, params));
+}
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(::syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(::syscall(SYS_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+/** @brief Returns the opcodes supported by the running kernel, probed once. */
+const std::array<bool, 256>& supported_ops() {
+    static const std::array<bool, 256> ops = [] {
+        std::array<bool, 256> ops{};
+        ::io_uring_params params{};
+        int fd = sys_io_uring_setup(1, &params);
+        if (fd == -1)
+            return ops;
+
+        std::vector<char> buf(sizeof(::io_uring_probe) + 256 * sizeof(::io_uring_probe_op), 0);
+        auto probe = reinterpret_cast<::io_uring_probe*>(buf.data());
+        if (sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+            for (int i = 0; i < probe->ops_len && i < 256; ++i)
+                ops[i] = probe->ops[i].flags & IO_URING_OP_SUPPORTED;
+        }
+        ::close(fd);
+        return ops;
+    }();
+    return ops;
+}
+
+bool is_retryable(int res) { return res == -EINTR || res == -EAGAIN; }
+
+} // namespace
+
+/* ===================================== Backend ===================================== */
+
+void set_io_backend(IOBackend backend) { current_backend = backend; }
+
+IOBackend io_backend() {
+    if (current_backend == IOBackend::BLOCKING)
+        return IOBackend::BLOCKING;
+    return IoUring::is_supported() ? IOBackend::IO_URING : IOBackend::BLOCKING;
+}
+
+/* ===================================== IoUring ===================================== */
+
+struct IoUring::Ring {
+    int            fd        = -1;
+    void*          sq_ptr    = MAP_FAILED;
+    std::size_t    sq_size   = 0;
+    void*          cq_ptr    = MAP_FAILED;
+    std::size_t    cq_size   = 0;
+    ::io_uring_sqe* sqes     = static_cast<::io_uring_sqe*>(MAP_FAILED);
+    std::size_t    sqes_size = 0;
+
+    unsigned*      sq_head;
+    unsigned*      sq_tail;
+    unsigned*      sq_mask;
+    unsigned*      sq_array;
+    unsigned       sq_entries;
+    unsigned*      cq_head;
+    unsigned*      cq_tail;
+    unsigned*      cq_mask;
+    ::io_uring_cqe* cqes;
+
+    unsigned       local_tail = 0;
+    unsigned       to_submit  = 0;
+    std::size_t    enters     = 0;
+
+    /** Timeouts are read by the kernel at submission, so they must outlive submit(). */
+    std::deque<::__kernel_timespec> timeouts;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED)
+            ::munmap(sqes, sqes_size);
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+            ::munmap(cq_ptr, cq_size);
+        if (sq_ptr != MAP_FAILED)
+            ::munmap(sq_ptr, sq_size);
+        if (fd != -1)
+            ::close(fd);
+    }
+};
+
+IoUring::IoUring(unsigned entries) : ring_(std::make_unique<Ring>()) {
+    ::io_uring_params params{};
+    ring_->fd = sys_io_uring_setup(entries, &params);
+    if (ring_->fd == -1)
+        throw OSError(errno, std::generic_category(), "Failed to set up io_uring");
+
+    /** On failure below, the partially initialized ring is released by ~Ring(). */
+    auto& ring = *ring_;
+    ring.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        ring.sq_size = ring.cq_size = std::max(ring.sq_size, ring.cq_size);
+
+    ring.sq_ptr = ::mmap(nullptr, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sq_ptr == MAP_FAILED)
+        throw OSError(errno, std::generic_category(), "Failed to map io_uring submission queue");
+    ring.cq_ptr = single_mmap ? ring.sq_ptr
+                              : ::mmap(nullptr, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    ring.sqes_size = params.sq_entries * sizeof(::io_uring_sqe);
+    ring.sqes = static_cast<::io_uring_sqe*>(
+        ::mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES));
+    if (ring.cq_ptr == MAP_FAILED || ring.sqes == MAP_FAILED)
+        throw OSError(errno, std::generic_category(), "Failed to map io_uring queues");
+
+    auto sq = static_cast<char*>(ring.sq_ptr);
+    auto cq = static_cast<char*>(ring.cq_ptr);
+    ring.sq_head    = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring.sq_tail    = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring.sq_mask    = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring.sq_array   = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring.sq_entries = params.sq_entries;
+    ring.cq_head    = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring.cq_tail    = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring.cq_mask    = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring.cqes       = reinterpret_cast<::io_uring_cqe*>(cq + params.cq_off.cqes);
+    ring.local_tail = *ring.sq_tail;
+}
+
+IoUring::~IoUring() = default;
+
+bool IoUring::is_supported() {
+    const auto& ops = supported_ops();
+    return ops[IORING_OP_READ] && ops[IORING_OP_WRITE] && ops[IORING_OP_TIMEOUT] && ops[IORING_OP_ASYNC_CANCEL];
+}
+bool IoUring::is_waitid_supported() { return supported_ops()[op_waitid]; }
+
+void IoUring::prep_read(int fd, void* buf, unsigned size, std::uint64_t user_data) {
+    auto sqe = static_cast<::io_uring_sqe*>(next_sqe());
+    sqe->opcode    = IORING_OP_READ;
+    sqe->fd        = fd;
+    sqe->addr      = reinterpret_cast<std::uint64_t>(buf);
+    sqe->len       = size;
+    sqe->off       = static_cast<std::uint64_t>(-1); /** Use (and advance) the file position. */
+    sqe->user_data = user_data;
+}
+
+void IoUring::prep_write(int fd, const void* buf, unsigned size, std::uint64_t user_data) {
+    auto sqe = static_cast<::io_uring_sqe*>(next_sqe());
+    sqe->opcode    = IORING_OP_WRITE;
+    sqe->fd        = fd;
+    sqe->addr      = reinterpret_cast<std::uint64_t>(buf);
+    sqe->len       = size;
+    sqe->off       = static_cast<std::uint64_t>(-1);
+    sqe->user_data = user_data;
+}
+
+void IoUring::prep_waitid(::pid_t pid, ::siginfo_t* info, std::uint64_t user_data) {
+    auto sqe = static_cast<::io_uring_sqe*>(next_sqe());
+    sqe->opcode     = op_waitid;
+    sqe->fd         = pid;
+    sqe->len        = P_PID;
+    sqe->file_index = WEXITED | WNOWAIT;
+    sqe->addr2      = reinterpret_cast<std::uint64_t>(info);
+    sqe->user_data  = user_data;
+}
+
+void IoUring::prep_timeout(std::chrono::nanoseconds timeout, std::uint64_t user_data) {
+    auto& ts   = ring_->timeouts.emplace_back();
+    ts.tv_sec  = timeout.count() / 1'000'000'000;
+    ts.tv_nsec = timeout.count() % 1'000'000'000;
+
+    auto sqe = static_cast<::io_uring_sqe*>(next_sqe());
+    sqe->opcode    = IORING_OP_TIMEOUT;
+    sqe->fd        = -1;
+    sqe->addr      = reinterpret_cast<std::uint64_t>(&ts);
+    sqe->len       = 1;
+    sqe->user_data = user_data;
+}
+
+void IoUring::prep_cancel(std::uint64_t target, std::uint64_t user_data) {
+    auto sqe = static_cast<::io_uring_sqe*>(next_sqe());
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->fd        = -1;
+    sqe->addr      = target;
+    sqe->user_data = user_data;
+}
+
+void IoUring::submit(unsigned wait_nr) {
+    auto& ring = *ring_;
+    std::atomic_ref<unsigned>(*ring.sq_tail).store(ring.local_tail, std::memory_order_release);
+
+    int ret;
+    do {
+        ++ring.enters;
+        ++total_enters;
+        ret = sys_io_uring_enter(ring.fd, ring.to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1)
+        throw OSError(errno, std::generic_category(), "Failed to enter io_uring");
+
+    ring.to_submit -= std::min<unsigned>(ret, ring.to_submit);
+    if (ring.to_submit == 0)
+        ring.timeouts.clear();
+}
+
+std::optional<IoUring::Completion> IoUring::peek() {
+    auto& ring = *ring_;
+    unsigned head = *ring.cq_head;
+    if (head == std::atomic_ref<unsigned>(*ring.cq_tail).load(std::memory_order_acquire))
+        return std::nullopt;
+
+    const auto& cqe = ring.cqes[head & *ring.cq_mask];
+    Completion completion{cqe.user_data, cqe.res};
+    std::atomic_ref<unsigned>(*ring.cq_head).store(head + 1, std::memory_order_release);
+    return completion;
+}
+
+std::size_t IoUring::enter_count() const { return ring_->enters; }
+std::size_t IoUring::total_enter_count()  { return total_enters;  }
+
+void* IoUring::next_sqe() {
+    auto& ring = *ring_;
+    if (ring.local_tail - std::atomic_ref<unsigned>(*ring.sq_head).load(std::memory_order_acquire) >= ring.sq_entries)
+        submit();
+    if (ring.local_tail - std::atomic_ref<unsigned>(*ring.sq_head).load(std::memory_order_acquire) >= ring.sq_entries)
+        throw std::runtime_error("io_uring submission queue is full.");
+
+    unsigned index = ring.local_tail & *ring.sq_mask;
+    auto sqe = &ring.sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[index] = index;
+    ++ring.local_tail;
+    ++ring.to_submit;
+    return sqe;
+}
+
+/* ===================================== Functions ===================================== */
+
+Bytes::size_type io_uring_transfer(File& in, File& out) {
+    internal::SigpipeGuard guard;
+
+    Bytes::size_type total_bytes = 0;
+    Bytes buffered = in.read_buffered();
+    if (!buffered.empty())
+        total_bytes += out.write(buffered, buffered.size());
+    out.flush();
+
+    /** Chunks are read and written in ring order, so that a read of the next chunk
+     *  is always in flight while the previous one is being written. */
+    enum class State { IDLE, READING, FILLED, WRITING };
+    struct Slot {
+        Bytes            buf;
+        State            state   = State::IDLE;
+        Bytes::size_type size    = 0;
+        Bytes::size_type written = 0;
+    };
+    constexpr std::size_t slot_count = 4;
+    constexpr unsigned    chunk_size = 1 << 17;
+
+    std::array<Slot, slot_count> slots;
+    for (auto& slot : slots)
+        slot.buf.resize(chunk_size);
+
+    int in_fd  = in.fileno();
+    int out_fd = out.fileno();
+    std::size_t next_read  = 0;
+    std::size_t next_write = 0;
+    bool reading = false;
+    bool writing = false;
+    bool eof     = false;
+
+    IoUring ring(2 * slot_count);
+    auto schedule = [&] {
+        auto& write_slot = slots[next_write];
+        if (!writing && write_slot.state == State::FILLED) {
+            write_slot.state = State::WRITING;
+            ring.prep_write(out_fd, write_slot.buf.c_str(), write_slot.size, (next_write << 1) | 1);
+            next_write = (next_write + 1) % slot_count;
+            writing = true;
+        }
+        auto& read_slot = slots[next_read];
+        if (!reading && !eof && read_slot.state == State::IDLE) {
+            read_slot.state = State::READING;
+            ring.prep_read(in_fd, read_slot.buf.c_str(), chunk_size, next_read << 1);
+            next_read = (next_read + 1) % slot_count;
+            reading = true;
+        }
+    };
+
+    schedule();
+    while (reading || writing) {
+        ring.submit(1);
+        while (auto completion = ring.peek()) {
+            auto& slot = slots[completion->user_data >> 1];
+            int   res  = completion->res;
+            if (completion->user_data & 1) {
+                if (is_retryable(res)) {
+                    ring.prep_write(out_fd, slot.buf.c_str() + slot.written, slot.size - slot.written, completion->user_data);
+                    continue;
+                }
+                if (res < 0)
+                    throw OSError(-res, std::generic_category(), "Failed to write to the file");
+                slot.written += res;
+                if (slot.written < slot.size) {
+                    ring.prep_write(out_fd, slot.buf.c_str() + slot.written, slot.size - slot.written, completion->user_data);
+                    continue;
+                }
+                total_bytes += slot.size;
+                slot.state = State::IDLE;
+                writing = false;
+            } else {
+                if (is_retryable(res)) {
+                    ring.prep_read(in_fd, slot.buf.c_str(), chunk_size, completion->user_data);
+                    continue;
+                }
+                if (res < 0)
+                    throw OSError(-res, std::generic_category(), "Failed to read from the file");
+                reading = false;
+                if (res == 0) {
+                    eof = true;
+                    slot.state = State::IDLE;
+                } else {
+                    slot.state   = State::FILLED;
+                    slot.size    = res;
+                    slot.written = 0;
+                }
+            }
+        }
+        schedule();
+    }
+    return total_bytes;
+}
+
+bool io_uring_communicate(
+    ::pid_t pid,
+    File* std_in,  const Bytes& input,
+    File* std_out, Bytes& std_out_data,
+    File* std_err, Bytes& std_err_data,
+    double timeout
+) {
+    internal::SigpipeGuard guard;
+
+    enum Tag : std::uint64_t { STDIN, STDOUT, STDERR, EXIT, TIMEOUT, CANCEL };
+    constexpr unsigned max_io_size = 1u << 30;
+
+    auto start_time = std::chrono::steady_clock::now();
+    IoUring ring(16);
+    bool busy[TIMEOUT + 1] = {};
+    bool timed_out = false;
+    bool exited    = false;
+
+    /** Stdin */
+    Bytes::size_type input_offset = 0;
+    auto write_input = [&] {
+        auto size = static_cast<unsigned>(std::min<Bytes::size_type>(input.size() - input_offset, max_io_size));
+        ring.prep_write(std_in->fileno(), input.c_str() + input_offset, size, STDIN);
+    };
+    if (std_in && std_in->is_opened()) {
+        std_in->flush();
+        if (input.empty()) {
+            std_in->close();
+        } else {
+            write_input();
+            busy[STDIN] = true;
+        }
+    }
+
+    /** Stdout and stderr */
+    File*            readers[2] = { std_out, std_err };
+    Bytes*           outputs[2] = { &std_out_data, &std_err_data };
+    Bytes::size_type sizes[2]   = { 0, 0 };
+    auto read_output = [&](int i) {
+        auto& output = *outputs[i];
+        if (output.size() <= sizes[i])
+            output.resize(std::max<Bytes::size_type>(output.size() * 2, BUFSIZ));
+        auto size = static_cast<unsigned>(std::min<Bytes::size_type>(output.size() - sizes[i], max_io_size));
+        ring.prep_read(readers[i]->fileno(), output.c_str() + sizes[i], size, STDOUT + i);
+    };
+    for (int i = 0; i < 2; ++i) {
+        if (readers[i] && readers[i]->is_opened()) {
+            *outputs[i] = readers[i]->read_buffered();
+            sizes[i]    = outputs[i]->size();
+            read_output(i);
+            busy[STDOUT + i] = true;
+        }
+    }
+
+    /** Exit and timeout */
+    ::siginfo_t info{};
+    if (IoUring::is_waitid_supported()) {
+        ring.prep_waitid(pid, &info, EXIT);
+        busy[EXIT] = true;
+    }
+    if (timeout >= 0) {
+        ring.prep_timeout(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(timeout)), TIMEOUT);
+        busy[TIMEOUT] = true;
+    }
+
+    while (busy[STDIN] || busy[STDOUT] || busy[STDERR] || busy[EXIT]) {
+        ring.submit(1);
+        while (auto completion = ring.peek()) {
+            int res = completion->res;
+            switch (completion->user_data) {
+                case STDIN: {
+                    if (is_retryable(res) && !timed_out) {
+                        write_input();
+                        break;
+                    }
+                    if (res > 0)
+                        input_offset += res;
+                    if (res > 0 && input_offset < input.size() && !timed_out) {
+                        write_input();
+                        break;
+                    }
+                    /** EPIPE: the process stopped reading its input, which is not an error. */
+                    if (res < 0 && res != -EPIPE && res != -ECANCELED && !timed_out)
+                        throw OSError(-res, std::generic_category(), "Failed to write to the pipe");
+                    busy[STDIN] = false;
+                    std_in->close();
+                    break;
+                }
+                case STDOUT:
+                case STDERR: {
+                    int i = completion->user_data - STDOUT;
+                    if (res > 0)
+                        sizes[i] += res;
+                    if ((res > 0 || is_retryable(res)) && !timed_out) {
+                        read_output(i);
+                        break;
+                    }
+                    if (res < 0 && res != -ECANCELED && !timed_out)
+                        throw OSError(-res, std::generic_category(), "Failed to read from the pipe");
+                    busy[STDOUT + i] = false;
+                    break;
+                }
+                case EXIT: {
+                    busy[EXIT] = false;
+                    exited = res >= 0;
+                    break;
+                }
+                case TIMEOUT: {
+                    busy[TIMEOUT] = false;
+                    if (res != -ETIME)
+                        break;
+                    timed_out = true;
+                    for (std::uint64_t tag : { STDIN, STDOUT, STDERR, EXIT }) {
+                        if (busy[tag])
+                            ring.prep_cancel(tag, CANCEL);
+                    }
+                    break;
+                }
+                default: break;
+            }
+        }
+    }
+
+    for (int i = 0; i < 2; ++i)
+        outputs[i]->resize(sizes[i]);
+
+    if (timed_out)
+        throw TimeoutExpired("Failed to communicate", std::chrono::steady_clock::now() - start_time);
+    return exited;
+}
+
+} // namespace subprocess
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "subprocess/exception.h"
+#include "subprocess/pool.h"
+
+namespace subprocess {
+
+ProcessPool::ProcessPool(std::size_t max_workers) : max_workers_(std::max<std::size_t>(max_workers, 1)) {
+    dispatcher_ = std::thread([this] { run(); });
+}
+
+ProcessPool::~ProcessPool() {
+    shutdown();
+}
+
+ProcessPool::Job ProcessPool::submit(PopenConfig&& config, Bytes input, int priority) {
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_)
+            throw std::runtime_error("Cannot submit a job to a pool that has been shut down.");
+        entry = std::make_shared<Entry>(next_id_++, priority, std::move(config), std::move(input));
+        auto [it, inserted] = queue_.emplace(QueueKey(-priority, entry->id), entry);
+        queued_.emplace(entry->id, it);
+        wake();
+    }
+    return Job{entry->id, entry->promise.get_future()};
+}
+
+bool ProcessPool::cancel(JobId id, int signal) {
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (auto it = queued_.find(id); it != queued_.end()) {
+            entry = it->second->second;
+            queue_.erase(it->second);
+            queued_.erase(it);
+        } else if (auto it = running_.find(id); it != running_.end()) {
+            it->second->signal = signal;
+            /** The process is signaled from the loop's thread, which owns it until it is reaped. */
+            [](ProcessPool& pool, std::shared_ptr<Entry> entry) -> detail::Detached {
+                co_await pool.loop_.schedule();
+                pool.signal_if_cancelled(*entry);
+            }(*this, it->second);
+            return true;
+        } else {
+            return false;
+        }
+    }
+    entry->promise.set_exception(std::make_exception_ptr(CancelledError("Job was cancelled before it started.")));
+    return true;
+}
+
+void ProcessPool::shutdown(bool cancel_pending) {
+    if (!dispatcher_.joinable())
+        return;
+
+    Queue cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        if (cancel_pending) {
+            cancelled.swap(queue_);
+            queued_.clear();
+        }
+        /** Posted under the lock, so that the dispatcher cannot exit before resuming it. */
+        wake();
+    }
+    for (auto& [key, entry] : cancelled)
+        entry->promise.set_exception(std::make_exception_ptr(CancelledError("Job was cancelled before it started.")));
+
+    dispatcher_.join();
+}
+
+std::size_t ProcessPool::max_workers() const { return max_workers_; }
+std::size_t ProcessPool::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+std::size_t ProcessPool::running() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return running_.size();
+}
+
+void ProcessPool::run() {
+    while (true) {
+        loop_.run_once();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ && queue_.empty() && running_.empty())
+            break;
+    }
+    /** Resume what was posted before the last job completed, e.g. a late cancel(). */
+    while (loop_.run_once(0) > 0) {}
+}
+
+void ProcessPool::dispatch() {
+    std::vector<std::shared_ptr<Entry>> started;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (running_.size() < max_workers_ && !queue_.empty()) {
+            auto entry = queue_.begin()->second;
+            queue_.erase(queue_.begin());
+            queued_.erase(entry->id);
+            running_.emplace(entry->id, entry);
+            started.push_back(std::move(entry));
+        }
+    }
+    for (auto& entry : started)
+        execute(std::move(entry));
+}
+
+detail::Detached ProcessPool::execute(std::shared_ptr<Entry> entry) {
+    /** Started on the next iteration of the loop, so that a job completing without
+     *  suspending does not recurse into dispatch(). */
+    co_await loop_.schedule();
+
+    std::optional<Popen>            popen;
+    std::optional<CompletedProcess> result;
+    std::exception_ptr              error;
+    try {
+        popen.emplace(std::move(entry->config));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entry->popen = &popen.value();
+        }
+        signal_if_cancelled(*entry);
+        auto [std_out, std_err] = co_await popen->async_communicate(std::move(entry->input));
+        result = CompletedProcess{
+            popen->args(), popen->returncode().value(), std::move(std_out), std::move(std_err), popen->usage()
+        };
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    /** Do not leave a child behind when the exchange with it failed. */
+    if (error && popen && !popen->returncode()) {
+        popen->kill();
+        try {
+            co_await popen->async_wait();
+        } catch (...) {}
+    }
+
+    /** Leave the running set first, so that a completed job can no longer be cancelled. */
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry->popen = nullptr;
+        running_.erase(entry->id);
+    }
+    if (error)
+        entry->promise.set_exception(error);
+    else
+        entry->promise.set_value(std::move(result.value()));
+    popen.reset();
+    dispatch();
+}
+
+detail::Detached ProcessPool::wake() {
+    co_await loop_.schedule();
+    dispatch();
+}
+
+void ProcessPool::signal_if_cancelled(Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entry.popen && entry.signal != 0)
+        entry.popen->send_signal(std::exchange(entry.signal, 0));
+}
+
+} // namespace subprocess
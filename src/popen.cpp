@@ -1,10 +1,98 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#if __has_include(<linux/close_range.h>)
+#include <linux/close_range.h>
+#endif
+#include <poll.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
+#include "subprocess/command.h"
 #include "subprocess/exception.h"
+#include "subprocess/io_uring.h"
 #include "subprocess/popen.h"
+#include "subprocess/trace.h"
+#include "internal.h"
 
 namespace subprocess {
 
+namespace {
+
+/** Applies `sched` to the calling process with system calls only, as it runs between fork and exec. */
+bool apply_sched(const types::sched_t& sched) {
+    if (sched.affinity && ::sched_setaffinity(0, sizeof(::cpu_set_t), &sched.affinity.value()) == -1)
+        return false;
+    if (sched.policy) {
+        ::sched_param param{};
+        if (::sched_setscheduler(0, sched.policy.value(), &param) == -1)
+            return false;
+    }
+    if (sched.nice && ::setpriority(PRIO_PROCESS, 0, sched.nice.value()) == -1)
+        return false;
+    /** IOPRIO_WHO_PROCESS = 1 */
+    if (sched.ioprio && ::syscall(SYS_ioprio_set, 1, 0, sched.ioprio.value()) == -1)
+        return false;
+    return true;
+}
+
+/** Reports `message` and errno on stderr and exits, with async-signal-safe calls only. */
+[[noreturn]] void child_fail(const char* message) {
+    char digits[16];
+    int  size  = 0;
+    int  error = errno;
+    do {
+        digits[sizeof(digits) - ++size] = static_cast<char>('0' + error % 10);
+        error /= 10;
+    } while (error > 0 && size < static_cast<int>(sizeof(digits)));
+
+    ::iovec parts[4] = {
+        { const_cast<char*>(message), std::strlen(message) },
+        { const_cast<char*>(": errno "), 8 },
+        { digits + sizeof(digits) - size, static_cast<std::size_t>(size) },
+        { const_cast<char*>("\n"), 1 }
+    };
+    [[maybe_unused]] ssize_t written = ::writev(STDERR_FILENO, parts, 4);
+    ::_exit(EXIT_FAILURE);
+}
+
+/** Sets close-on-exec on every descriptor above 2 except `keep` (sorted), with system calls 
+ *  only. Falls back to one fcntl() per descriptor below `limit` without close_range(2). */
+bool close_on_exec_except(const std::vector<int>& keep, ::rlim_t limit) {
+    unsigned int first = STDERR_FILENO + 1;
+#if defined(SYS_close_range) && defined(CLOSE_RANGE_CLOEXEC)
+    bool supported = true;
+    for (int fd : keep) {
+        if (fd < static_cast<int>(first))
+            continue;
+        if (fd > static_cast<int>(first) && ::syscall(SYS_close_range, first, fd - 1, CLOSE_RANGE_CLOEXEC) == -1) {
+            supported = false;
+            break;
+        }
+        first = fd + 1;
+    }
+    if (supported && ::syscall(SYS_close_range, first, ~0U, CLOSE_RANGE_CLOEXEC) == 0)
+        return true;
+    if (errno != ENOSYS && errno != EINVAL)
+        return false;
+    first = STDERR_FILENO + 1;
+#endif
+    for (::rlim_t fd = first; fd < limit && fd <= INT_MAX; ++fd) {
+        if (!std::binary_search(keep.begin(), keep.end(), static_cast<int>(fd)))
+            ::fcntl(static_cast<int>(fd), F_SETFD, FD_CLOEXEC);
+    }
+    return true;
+}
+
+} // namespace
+
 void PopenConfig::set_value(const types::args_t& args)             { this->args = args; }
 void PopenConfig::set_value(types::args_t&& args)                  { this->args = std::move(args); }
 void PopenConfig::set_value(const types::bufsize_t& bufsize)       { this->bufsize = bufsize; }
@@ -17,6 +105,12 @@ void PopenConfig::set_value(const types::std_err_t& std_err)       { this->std_e
 void PopenConfig::set_value(types::std_err_t&& std_err)            { this->std_err = std::move(std_err); }
 void PopenConfig::set_value(const types::preexec_fn_t& preexec_fn) { this->preexec_fn = preexec_fn; }
 void PopenConfig::set_value(types::preexec_fn_t&& preexec_fn)      { this->preexec_fn = std::move(preexec_fn); }
+void PopenConfig::set_value(const types::rlimit_t& rlimit)         { this->rlimit = rlimit; }
+void PopenConfig::set_value(types::rlimit_t&& rlimit)              { this->rlimit = std::move(rlimit); }
+void PopenConfig::set_value(const types::sched_t& sched)           { this->sched = sched; }
+void PopenConfig::set_value(types::sched_t&& sched)                { this->sched = std::move(sched); }
+void PopenConfig::set_value(const types::pass_fds_t& pass_fds)     { this->pass_fds = pass_fds; }
+void PopenConfig::set_value(types::pass_fds_t&& pass_fds)          { this->pass_fds = std::move(pass_fds); }
 
 void PopenConfig::validate() {
     if (!args)       throw std::invalid_argument("Missing required 'args' argument.");
@@ -25,6 +119,36 @@ void PopenConfig::validate() {
     if (!std_out)    throw std::invalid_argument("Missing required 'std_out' argument.");
     if (!std_err)    throw std::invalid_argument("Missing required 'std_err' argument.");
     if (!preexec_fn) throw std::invalid_argument("Missing required 'preexec_fn' argument.");
+    if (!rlimit)     throw std::invalid_argument("Missing required 'rlimit' argument.");
+    if (!sched)      throw std::invalid_argument("Missing required 'sched' argument.");
+    if (!pass_fds)   throw std::invalid_argument("Missing required 'pass_fds' argument.");
+}
+
+/* ===================================== RunConfig ===================================== */
+
+void RunConfig::set_value(const types::input_t& input)                   { this->input = input; }
+void RunConfig::set_value(types::input_t&& input)                        { this->input = std::move(input); }
+void RunConfig::set_value(const types::capture_output_t& capture_output) { this->capture_output = capture_output; }
+void RunConfig::set_value(types::capture_output_t&& capture_output)      { this->capture_output = std::move(capture_output); }
+void RunConfig::set_value(const types::check_t& check)                   { this->check = check; }
+void RunConfig::set_value(types::check_t&& check)                        { this->check = std::move(check); }
+void RunConfig::set_value(const types::timeout_t& timeout)               { this->timeout = timeout; }
+void RunConfig::set_value(types::timeout_t&& timeout)                    { this->timeout = std::move(timeout); }
+
+void RunConfig::validate() {
+    PopenConfig::validate();
+    if (!input)          throw std::invalid_argument("Missing required 'input' argument.");
+    if (!capture_output) throw std::invalid_argument("Missing required 'capture_output' argument.");
+    if (!check)          throw std::invalid_argument("Missing required 'check' argument.");
+    if (!timeout)        throw std::invalid_argument("Missing required 'timeout' argument.");
+
+    auto& std_in  = this->std_in.value();
+    auto& std_out = this->std_out.value();
+    auto& std_err = this->std_err.value();
+    if (input->data && (std_in.pipe_reader || std_in.source))
+        throw std::invalid_argument("'std_in' and 'input' arguments may not both be used.");
+    if (capture_output->capture_output && (std_out.pipe_reader || std_out.destination || std_err.pipe_reader || std_err.destination || std_err.is_std_out))
+        throw std::invalid_argument("'std_out' and 'std_err' arguments may not be used with 'capture_output'.");
 }
 
 /* ===================================== Popen ===================================== */
@@ -33,13 +157,46 @@ Popen::Popen(PopenConfig&& config) : config_(std::move(config)), pid_(-1), usage
     /** Throws a std::invalid_argument exception when required argument is missing. */
     config_.validate();
 
+    std::vector<char*> argv;
+    for (auto& arg : config_.args->args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    spawn(argv[0], argv.data());
+}
+
+Popen::Popen(const CommandTemplate& command, std::vector<std::string> values)
+    : config_(command.plan_->instantiate()), command_(command.plan_), values_(std::move(values)),
+      pid_(-1), usage_(std::nullopt), returncode_(std::nullopt) {
+    if (values_.size() != command_->arity)
+        throw std::invalid_argument(
+            "Command expects " + std::to_string(command_->arity) + " values, got " + std::to_string(values_.size()) + "."
+        );
+
+    std::vector<char*> argv(command_->argv);
+    for (auto [index, value] : command_->holes)
+        argv[index] = values_[value].data();
+    spawn(command_->executable.c_str(), argv.data());
+}
+
+void Popen::spawn(const char* path, char* const argv[]) {
+    SUBPROCESS_TRACE_SCOPE("spawn");
+
     /** Alias references for optional configuration values. */
-    auto& args       = config_.args.value();
     auto& std_in     = config_.std_in.value();
     auto& std_out    = config_.std_out.value();
     auto& std_err    = config_.std_err.value();
     auto& bufsize    = config_.bufsize.value();
     auto& preexec_fn = config_.preexec_fn.value();
+    auto& rlimit     = config_.rlimit.value();
+    auto& sched      = config_.sched.value();
+    auto& pass_fds   = config_.pass_fds.value();
+
+    /** With a socketpair on both, standard output shares the one of standard input (see socketpair_t). */
+    auto socket = std::dynamic_pointer_cast<Socket>(std_in.pipe_writer);
+    if (socket && std::dynamic_pointer_cast<Socket>(std_out.pipe_reader)) {
+        std_out.pipe_reader = socket->duplicate();
+        std_out.pipe_writer = std_in.pipe_reader;
+    }
 
     /** Pipe handles for the parent process. */
     File* parent_fps[3] = { 
@@ -47,14 +204,32 @@ Popen::Popen(PopenConfig&& config) : config_(std::move(config)), pid_(-1), usage
         std_out.pipe_reader.get(), 
         std_err.pipe_reader.get() 
     };
-    for (auto fp : parent_fps) {
-        if (fp && fp->is_opened()) {
-            fp->set_bufsize(bufsize.bufsize);
+    bool non_blocking[3] = { std_in.non_blocking, std_out.non_blocking, std_err.non_blocking };
+    for (int i = 0; i < 3; ++i) {
+        if (parent_fps[i] && parent_fps[i]->is_opened()) {
+            /** The read ends were already made unbuffered by File(int), and setvbuf may only be
+             *  called once per stream: they are only rebuffered when asked for explicitly. */
+            if (i == 0 || bufsize.bufsize >= 0)
+                parent_fps[i]->set_bufsize(bufsize.bufsize);
+            /** Sockets are sized by socketpair_t instead. */
+            bool is_pipe = !dynamic_cast<Socket*>(parent_fps[i]);
+            if (is_pipe && bufsize.pipe_size > 0)
+                parent_fps[i]->set_pipe_size(bufsize.pipe_size);
+            else if (is_pipe && bufsize.pipe_size == types::bufsize_t::ADAPTIVE && i != 0)
+                parent_fps[i]->set_adaptive_pipe_size(true);
+            if (non_blocking[i])
+                parent_fps[i]->set_non_blocking(true);
+            counters_[i] = std::make_shared<IOCounters>();
+            parent_fps[i]->set_counters(counters_[i]);
         }
     }
 
-    if (std_err.is_std_out)
+    if (std_err.is_std_out) {
         std_err.pipe_writer = std_out.pipe_writer;
+        /** Without a pipe, stderr shares a destination that can be duplicated directly (e.g. a capture file). */
+        if (!std_err.pipe_writer && std_out.destination && std_out.destination->fileno() != -1)
+            std_err.destination = std_out.destination;
+    }
 
     /** Pipe handles for the child process. */
     File* child_fps[3] = {
@@ -70,52 +245,124 @@ Popen::Popen(PopenConfig&& config) : config_(std::move(config)), pid_(-1), usage
         { static_cast<Streamable*>(std_err.destination.get()), STDERR_FILENO }
     };
 
+    /** Descriptor actions of the child, resolved before fork so that the child only makes system calls:
+     *  the descriptor duplicated onto each standard stream, and those closed afterwards. Pipes are
+     *  close-on-exec already, but descriptors of files opened for a stream may not be. */
+    int dup_fds[3];
+    int close_fds[9];
+    int close_count = 0;
+    auto is_passed = [&](int fd) {
+        return std::any_of(pass_fds.mappings.begin(), pass_fds.mappings.end(), [fd](auto& mapping) { return mapping.second == fd; });
+    };
+    auto close_in_child = [&](int fd) {
+        if (fd > STDERR_FILENO && !is_passed(fd) && std::find(close_fds, close_fds + close_count, fd) == close_fds + close_count)
+            close_fds[close_count++] = fd;
+    };
+    for (int i = 0; i < 3; ++i) {
+        auto [stream, fd] = streams[i];
+        auto fp           = child_fps[i];
+        /** If the stream is of a type that provides a valid file descriptor,  
+         *  use dup2 to directly connect the child process's stdin, stdout, or stderr. */
+        if (stream && stream->fileno() != -1)
+            dup_fds[i] = stream->fileno();
+        else if (fp && fp->fileno() != -1)
+            dup_fds[i] = fp->fileno();
+        else
+            dup_fds[i] = -1;
+
+        if (parent_fps[i]) close_in_child(parent_fps[i]->fileno());
+        if (fp)            close_in_child(fp->fileno());
+        if (stream)        close_in_child(stream->fileno());
+    }
+
+    /** Closed on exec: EOF on the read end marks the end of the fork-to-exec interval. The parent 
+     *  does not wait for it, which would stall on a slow preexec_fn or on a concurrent fork 
+     *  inheriting the write end: the read end is checked without blocking by check_exec(). Opened 
+     *  before the map is built, so that a target taking its write end is known. */
+    int exec_pipe[2];
+    if (::pipe2(exec_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to open pipe");
+
+    /** Every (source, target) pair duplicated in the child, standard streams included. Sources 
+     *  that are also targets are first moved above all targets, so that the order of the 
+     *  duplications does not matter. */
+    std::vector<std::pair<int, int>> fd_map;
+    for (int i = 0; i < 3; ++i) {
+        if (dup_fds[i] != -1)
+            fd_map.emplace_back(dup_fds[i], streams[i].second);
+    }
+    fd_map.insert(fd_map.end(), pass_fds.mappings.begin(), pass_fds.mappings.end());
+    std::vector<int> targets;
+    for (auto& mapping : fd_map)
+        targets.push_back(mapping.second);
+    std::sort(targets.begin(), targets.end());
+    int  lift_floor   = targets.empty() ? 0 : targets.back() + 1;
+    bool close_others = pass_fds.close_others && !pass_fds.mappings.empty();
+    /** Upper bound for the fallback when close_range(2) is not available. */
+    ::rlimit nofile{};
+    if (close_others && ::getrlimit(RLIMIT_NOFILE, &nofile) == -1) {
+        int error = errno;
+        ::close(exec_pipe[0]);
+        ::close(exec_pipe[1]);
+        throw OSError(error, std::generic_category(), "Failed to get the descriptor limit");
+    }
+
+    spawn_time_ = std::chrono::steady_clock::now();
     pid_ = ::fork();
     if (pid_ == -1) {
+        ::close(exec_pipe[0]);
+        ::close(exec_pipe[1]);
         throw std::runtime_error("Failed to fork a process.");
     } else if (pid_ == 0) {
-        for (auto fp : parent_fps) {
-            if (fp) fp->close();
+        /** Only async-signal-safe calls from here: another thread may have held a lock
+         *  (of malloc or stdio, for instance) when the process was forked. */
+        ::close(exec_pipe[0]);
+        /** The write end is lifted like a source, so that no duplication onto its number closes it. */
+        if (std::binary_search(targets.begin(), targets.end(), exec_pipe[1])) {
+            exec_pipe[1] = ::fcntl(exec_pipe[1], F_DUPFD_CLOEXEC, lift_floor);
+            if (exec_pipe[1] == -1)
+                child_fail("Failed to duplicate file descriptor");
         }
-        /** If the stream is of a type that provides a valid file descriptor,  
-         *  use dup2 to directly connect the child process's stdin, stdout, or stderr. */
-        for (int i = 0; i < 3; ++i) {
-            auto [stream, fd] = streams[i];
-            auto fp           = child_fps[i];
-            if (stream && stream->fileno() != -1) {
-                if (::dup2(stream->fileno(), fd) == -1) {
-                    ::perror("Failed to duplicate file descriptor.");
-                    ::_exit(EXIT_FAILURE);
-                }
-            } else if (fp && fp->fileno() != -1) {
-                if (::dup2(fp->fileno(), fd) == -1) {
-                    ::perror("Failed to duplicate file descriptor.");
-                    ::_exit(EXIT_FAILURE);
-                }
+        for (auto& [source, target] : fd_map) {
+            if (source != target && std::binary_search(targets.begin(), targets.end(), source)) {
+                source = ::fcntl(source, F_DUPFD_CLOEXEC, lift_floor);
+                if (source == -1)
+                    child_fail("Failed to duplicate file descriptor");
             }
         }
-
-        // TODO: clo_exec
-        for (auto fp : child_fps) {
-            if (fp) fp->close();
+        for (auto [source, target] : fd_map) {
+            /** dup2() onto itself keeps close-on-exec, which is cleared explicitly instead. */
+            if (source == target ? ::fcntl(target, F_SETFD, 0) == -1 : ::dup2(source, target) == -1)
+                child_fail("Failed to duplicate file descriptor");
         }
-        for (auto [stream, fd] : streams) {
-            if (stream) stream->close();
+        for (int i = 0; i < close_count; ++i)
+            ::close(close_fds[i]);
+        if (close_others && !close_on_exec_except(targets, nofile.rlim_cur))
+            child_fail("Failed to close inherited file descriptors");
+
+        for (auto& [resource, limit] : rlimit.limits) {
+            if (::setrlimit(resource, &limit) == -1)
+                child_fail("Failed to set resource limit");
         }
 
-        preexec_fn.preexec_fn();
+        if (!apply_sched(sched))
+            child_fail("Failed to set scheduling attributes");
 
-        std::vector<char*> c_args;
-        for (auto& arg : args.args) 
-            c_args.push_back(arg.data());
-        c_args.push_back(nullptr);
-        ::execv(c_args[0], c_args.data());
-        ::perror("Failed to execute a program");
-        ::_exit(EXIT_FAILURE);
+        if (preexec_fn.preexec_fn)
+            preexec_fn.preexec_fn();
+
+        ::execve(path, argv, environ);
+        child_fail("Failed to execute a program");
     } else {
+        ::close(exec_pipe[1]);
+        exec_fd_ = exec_pipe[0];
+        SUBPROCESS_TRACE(tracer.track_name(pid_, "child " + std::to_string(pid_) + " (" + argv[0] + ")"));
+
         for (auto fp : child_fps) {
             if (fp) fp->close();
         }
+        for (auto& child_end : pass_fds.child_ends)
+            child_end->close();
         /** If a source or destination is specified, start communication with a pipe connected 
          * to child process through a thread, simulating the behavior of dup2. */
         for (int i = 0; i < 3; ++i) {
@@ -135,7 +382,20 @@ Popen::Popen(PopenConfig&& config) : config_(std::move(config)), pid_(-1), usage
     }
 }
 
+Popen::~Popen() {
+    if (exec_fd_ != -1)
+        ::close(exec_fd_);
+    if (pid_ > 0 && StatsAggregator::global().is_enabled())
+        StatsAggregator::global().record(stats());
+}
+
 std::vector<std::string> Popen::args() const {
+    if (command_) {
+        auto args = command_->args;
+        for (auto [index, value] : command_->holes)
+            args[index] = values_[value];
+        return args;
+    }
     if (!config_.args.has_value())
         throw std::runtime_error("Missing required 'args' argument.");
     return config_.args.value().args;
@@ -172,10 +432,98 @@ std::optional<std::shared_ptr<IStreamable>> Popen::std_err() {
         return std::nullopt;
 }
 
+std::optional<MappedBytes> Popen::captured_std_out() {
+    if (!config_.std_out.has_value())
+        throw std::runtime_error("Missing required 'std_out' argument."); 
+    auto& std_out = config_.std_out.value();
+    if (!std_out.is_capture)
+        return std::nullopt;
+    if (!returncode_)
+        wait();
+    return MappedBytes(std_out.destination->fileno());
+}
+
+std::optional<MappedBytes> Popen::captured_std_err() {
+    if (!config_.std_err.has_value())
+        throw std::runtime_error("Missing required 'std_err' argument."); 
+    auto& std_err = config_.std_err.value();
+    if (!std_err.is_capture)
+        return std::nullopt;
+    if (!returncode_)
+        wait();
+    return MappedBytes(std_err.destination->fileno());
+}
+
+std::optional<std::shared_ptr<TailBuffer>> Popen::tail_std_out() {
+    if (!config_.std_out.has_value())
+        throw std::runtime_error("Missing required 'std_out' argument."); 
+    auto destination = config_.std_out->destination;
+    /** A transformed tail keeps the transformed output. */
+    if (auto chain = std::dynamic_pointer_cast<TransformChain>(destination))
+        destination = chain->destination();
+    if (auto tail = std::dynamic_pointer_cast<TailBuffer>(destination))
+        return tail;
+    return std::nullopt;
+}
+
+std::optional<std::shared_ptr<TailBuffer>> Popen::tail_std_err() {
+    if (!config_.std_err.has_value())
+        throw std::runtime_error("Missing required 'std_err' argument."); 
+    auto destination = config_.std_err->destination;
+    if (auto chain = std::dynamic_pointer_cast<TransformChain>(destination))
+        destination = chain->destination();
+    if (auto tail = std::dynamic_pointer_cast<TailBuffer>(destination))
+        return tail;
+    return std::nullopt;
+}
+
+ProcessStats Popen::stats() const {
+    check_exec();
+    ProcessStats stats;
+    if (fork_to_exec_)
+        stats.fork_to_exec = std::chrono::duration_cast<std::chrono::nanoseconds>(fork_to_exec_.value());
+    if (exit_time_)
+        stats.wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(exit_time_.value() - spawn_time_);
+
+    StreamStats* streams[3] = { &stats.std_in, &stats.std_out, &stats.std_err };
+    std::int64_t spawn_ns   = std::chrono::duration_cast<std::chrono::nanoseconds>(spawn_time_.time_since_epoch()).count();
+    for (int i = 0; i < 3; ++i) {
+        if (!counters_[i])
+            continue;
+        streams[i]->bytes    = counters_[i]->bytes.load(std::memory_order_relaxed);
+        streams[i]->io_calls = counters_[i]->io_calls.load(std::memory_order_relaxed);
+        streams[i]->blocked  = std::chrono::nanoseconds(counters_[i]->blocked_ns.load(std::memory_order_relaxed));
+
+        std::int64_t first_byte_ns = counters_[i]->first_byte_ns.load(std::memory_order_relaxed);
+        if (i > 0 && first_byte_ns != -1) {
+            auto first_output = std::chrono::nanoseconds(first_byte_ns - spawn_ns);
+            if (!stats.first_output || first_output < stats.first_output.value())
+                stats.first_output = first_output;
+        }
+    }
+    return stats;
+}
+
+std::array<std::optional<int>, 3> Popen::pipe_sizes() const {
+    File* parent_fps[3] = {
+        config_.std_in->pipe_writer.get(),
+        config_.std_out->pipe_reader.get(),
+        config_.std_err->pipe_reader.get()
+    };
+    std::array<std::optional<int>, 3> sizes;
+    for (int i = 0; i < 3; ++i) {
+        int size = parent_fps[i] ? parent_fps[i]->pipe_size() : -1;
+        if (size > 0)
+            sizes[i] = size;
+    }
+    return sizes;
+}
+
 std::optional<int> Popen::poll() {
     if (returncode())
         return returncode();
 
+    check_exec();
     int status;
     ::rusage usage;
     int pid = ::wait4(pid_, &status, WNOHANG, &usage);
@@ -185,13 +533,26 @@ std::optional<int> Popen::poll() {
     } else if (pid == pid_) {
         /** Wait until the entire asynchronous communication is complete. */
         comm_wait(); 
+        exit_time_ = std::chrono::steady_clock::now();
         set_returncode(status);
         usage_ = usage;
+        /** A write end still held by a concurrent fork must not keep the descriptor open. */
+        check_exec();
+        if (exec_fd_ != -1) {
+            ::close(exec_fd_);
+            exec_fd_ = -1;
+        }
+        SUBPROCESS_TRACE(
+            tracer.complete("running", pid_, spawn_time_ + fork_to_exec_.value_or(std::chrono::steady_clock::duration::zero()), exit_time_.value(),
+                            "\"returncode\": " + std::to_string(returncode_.value()));
+            tracer.instant("reaped", trace::Tracer::current_track(), "\"pid\": " + std::to_string(pid_))
+        );
     }
 
     return returncode();
 }
 std::optional<int> Popen::wait(double timeout) {
+    SUBPROCESS_TRACE_SCOPE("wait", "\"pid\": " + std::to_string(pid_));
     if (timeout < 0) {
         while (!poll())
             std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -210,14 +571,42 @@ std::optional<int> Popen::wait(double timeout) {
 std::pair<
     std::optional<Bytes>, 
     std::optional<Bytes>> Popen::communicate(const Bytes& input, double timeout) {
+    SUBPROCESS_TRACE_SCOPE("communicate", "\"pid\": " + std::to_string(pid_));
     auto& std_in  = config_.std_in.value();
     auto& std_out = config_.std_out.value();
     auto& std_err = config_.std_err.value();
-    if (std_in.pipe_writer && std_in.pipe_writer->is_opened())
-        std_in.pipe_writer->write(input, input.size()); 
-    else
+    if (!(std_in.pipe_writer && std_in.pipe_writer->is_opened()))
         throw std::runtime_error("Pipe is not opened.");
 
+    if (io_backend() == IOBackend::IO_URING) {
+        auto start_time = std::chrono::steady_clock::now();
+        File* std_out_pipe = std_out.pipe_reader && std_out.pipe_reader->is_opened() ? std_out.pipe_reader.get() : nullptr;
+        File* std_err_pipe = std_err.pipe_reader && std_err.pipe_reader->is_opened() ? std_err.pipe_reader.get() : nullptr;
+        Bytes std_out_data;
+        Bytes std_err_data;
+        bool exited = io_uring_communicate(
+            pid_,
+            std_in.pipe_writer.get(), input,
+            std_out_pipe, std_out_data,
+            std_err_pipe, std_err_data,
+            timeout
+        );
+        if (std_out_pipe) std_out_pipe->close();
+        if (std_err_pipe) std_err_pipe->close();
+
+        if (!poll() && !exited) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+            wait(timeout < 0 ? -1 : std::max(timeout - elapsed.count(), 0.0));
+        }
+
+        return {
+            std_out_pipe ? std::optional<Bytes>(std::move(std_out_data)) : std::nullopt,
+            std_err_pipe ? std::optional<Bytes>(std::move(std_err_data)) : std::nullopt
+        };
+    }
+
+    std_in.pipe_writer->write(input, input.size()); 
+
     if (std_in.pipe_writer)
         std_in.pipe_writer->close();
 
@@ -238,6 +627,44 @@ std::pair<
     return {std_out_data, std_err_data};
 }
 
+Task<std::optional<int>> Popen::async_wait() {
+    while (!poll())
+        co_await EventLoop::current().exited(pid_);
+    co_return returncode();
+}
+
+Task<std::pair<
+    std::optional<Bytes>,
+    std::optional<Bytes>>> Popen::async_communicate(Bytes input) {
+    auto feed = [](std::optional<std::shared_ptr<OStreamable>> writer, Bytes input) -> Task<Bytes::size_type> {
+        if (!writer) {
+            if (!input.empty())
+                throw std::runtime_error("Pipe is not opened.");
+            co_return 0;
+        }
+        Bytes::size_type size = input.size();
+        Bytes::size_type size_written = co_await writer.value()->async_write(std::move(input), size);
+        writer.value()->close();
+        co_return size_written;
+    };
+    auto drain = [](std::optional<std::shared_ptr<IStreamable>> reader) -> Task<std::optional<Bytes>> {
+        if (!reader)
+            co_return std::nullopt;
+        Bytes bytes = co_await reader.value()->async_read_all();
+        reader.value()->close();
+        co_return bytes;
+    };
+
+    auto [size_written, std_out_data, std_err_data] = co_await when_all(
+        feed(std_in(), std::move(input)),
+        drain(std_out()),
+        drain(std_err())
+    );
+    co_await async_wait();
+
+    co_return std::make_pair(std::move(std_out_data), std::move(std_err_data));
+}
+
 void Popen::send_signal(int signal) {
     if (!returncode())
         ::kill(pid_, signal);
@@ -245,6 +672,20 @@ void Popen::send_signal(int signal) {
 void Popen::terminate() { send_signal(SIGTERM); }
 void Popen::kill()      { send_signal(SIGKILL); }
 
+void Popen::check_exec() const {
+    if (exec_fd_ == -1)
+        return;
+    char byte;
+    ssize_t bytes_read;
+    while ((bytes_read = ::read(exec_fd_, &byte, 1)) == -1 && errno == EINTR) {}
+    if (bytes_read == -1 && errno == EAGAIN)
+        return;
+    fork_to_exec_ = std::chrono::steady_clock::now() - spawn_time_;
+    ::close(exec_fd_);
+    exec_fd_ = -1;
+    SUBPROCESS_TRACE(tracer.complete("fork-exec", pid_, spawn_time_, spawn_time_ + fork_to_exec_.value()));
+}
+
 void Popen::comm_wait() {
     for (auto& comm_result : comm_results) {
         if (comm_result.valid())
@@ -261,4 +702,139 @@ void Popen::set_returncode(int status) {
         throw std::runtime_error("Invalid return code detected.");
 }
 
-} // namespace subprocess
\ No newline at end of file
+/* ===================================== run ===================================== */
+
+CompletedProcess run(RunConfig&& config) {
+    config.validate();
+    SUBPROCESS_TRACE_SCOPE("run");
+
+    bool             check     = config.check->check;
+    double           timeout   = config.timeout->timeout;
+    Bytes::size_type size_hint = config.capture_output->size_hint;
+    if (config.input->data)
+        config.std_in = types::std_in_t(config.input->data.value());
+    if (config.capture_output->capture_output) {
+        config.std_out = types::std_out_t(types::IOOption::PIPE);
+        config.std_err = types::std_err_t(types::IOOption::PIPE);
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    Popen popen(std::move(config));
+    if (auto std_in = popen.std_in())
+        std_in.value()->close();
+
+    /** Output of a pipe, read in place into a buffer that doubles whenever it is full. */
+    struct Output {
+        std::shared_ptr<IStreamable> stream;
+        Bytes                        data;
+        Bytes::size_type             size = 0;
+        std::shared_ptr<IOCounters>  counters = nullptr;
+    };
+    std::optional<Output> outputs[2];
+    if (auto std_out = popen.std_out())
+        outputs[0] = Output{std_out.value(), Bytes(std::max<Bytes::size_type>(size_hint, BUFSIZ))};
+    if (auto std_err = popen.std_err())
+        outputs[1] = Output{std_err.value(), Bytes(BUFSIZ)};
+    for (auto& output : outputs) {
+        if (auto file = output ? std::dynamic_pointer_cast<File>(output->stream) : nullptr)
+            output->counters = file->counters();
+    }
+
+    /** The exit is awaited in the same poll as the pipes; without pidfd, it is waited for once they are drained. */
+    struct Pidfd {
+        int fd;
+        ~Pidfd() { if (fd != -1) ::close(fd); }
+    } pidfd{internal::pidfd_open(popen.pid())};
+
+    auto expire = [&] {
+        popen.kill();
+        popen.wait();
+        throw TimeoutExpired("Failed to run", std::chrono::steady_clock::now() - start_time);
+    };
+    auto remaining = [&] {
+        return std::chrono::duration<double>(timeout) - std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time);
+    };
+
+    while (true) {
+        ::pollfd fds[3];
+        int      sources[3];
+        nfds_t   nfds = 0;
+        for (int i = 0; i < 2; ++i) {
+            if (outputs[i] && outputs[i]->stream->is_opened()) {
+                fds[nfds]       = { outputs[i]->stream->fileno(), POLLIN, 0 };
+                sources[nfds++] = i;
+            }
+        }
+        if (pidfd.fd != -1 && !popen.returncode()) {
+            fds[nfds]       = { pidfd.fd, POLLIN, 0 };
+            sources[nfds++] = 2;
+        }
+        if (nfds == 0)
+            break;
+
+        int timeout_ms = -1;
+        if (timeout >= 0) {
+            if (remaining().count() <= 0)
+                expire();
+            /** A timeout beyond INT_MAX ms (about 24.8 days) is waited for in slices. */
+            timeout_ms = static_cast<int>(std::min<double>(std::ceil(remaining().count() * 1000), INT_MAX));
+        }
+        int ready = ::poll(fds, nfds, timeout_ms);
+        if (ready == -1) {
+            if (errno == EINTR)
+                continue;
+            throw OSError(errno, std::generic_category(), "Failed to poll process");
+        }
+
+        for (nfds_t i = 0; i < nfds && ready > 0; ++i) {
+            if (fds[i].revents == 0)
+                continue;
+            --ready;
+            if (sources[i] == 2) {
+                popen.poll();
+                continue;
+            }
+
+            auto& output = outputs[sources[i]].value();
+            if (output.size == output.data.size())
+                output.data.resize(output.data.size() * 2);
+            ssize_t bytes_read = ::read(fds[i].fd, output.data.data() + output.size, output.data.size() - output.size);
+            if (bytes_read > 0) {
+                output.size += bytes_read;
+                if (output.counters)
+                    output.counters->record(bytes_read, 1, std::chrono::nanoseconds(0));
+            } else if (bytes_read == 0) {
+                output.stream->close();
+            } else if (errno != EINTR && errno != EAGAIN) {
+                throw OSError(errno, std::generic_category(), "Failed to read process output");
+            }
+        }
+    }
+
+    if (!popen.returncode()) {
+        if (timeout < 0) {
+            popen.wait();
+        } else if (remaining().count() <= 0) {
+            expire();
+        } else {
+            try {
+                popen.wait(remaining().count());
+            } catch (const TimeoutExpired&) {
+                expire();
+            }
+        }
+    }
+
+    CompletedProcess result{popen.args(), popen.returncode().value(), std::nullopt, std::nullopt, popen.usage()};
+    for (int i = 0; i < 2; ++i) {
+        if (!outputs[i])
+            continue;
+        outputs[i]->data.resize(outputs[i]->size);
+        (i == 0 ? result.std_out : result.std_err) = std::move(outputs[i]->data);
+    }
+    if (check && result.returncode != 0)
+        throw CalledProcessError(result.returncode, result.args, std::move(result.std_out), std::move(result.std_err));
+    return result;
+}
+
+} // namespace subprocess
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <bit>
+#include <sstream>
+
+#include "subprocess/stats.h"
+
+namespace subprocess {
+
+/* ===================================== IOCounters ===================================== */
+
+void IOCounters::record(std::uint64_t bytes, std::uint64_t calls, std::chrono::nanoseconds blocked) {
+    if (bytes > 0 && first_byte_ns.load(std::memory_order_relaxed) == -1) {
+        std::int64_t expected = -1;
+        std::int64_t now      = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        first_byte_ns.compare_exchange_strong(expected, now, std::memory_order_relaxed);
+    }
+    this->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    io_calls.fetch_add(calls, std::memory_order_relaxed);
+    blocked_ns.fetch_add(blocked.count(), std::memory_order_relaxed);
+}
+
+/* ===================================== Histogram ===================================== */
+
+void Histogram::record(std::chrono::nanoseconds value) {
+    std::uint64_t ns = static_cast<std::uint64_t>(std::max<std::int64_t>(value.count(), 0));
+    /** Bucket i holds values in [2^(i-1), 2^i), bucket 0 holds 0. */
+    std::size_t bucket = std::min<std::size_t>(std::bit_width(ns), bucket_count - 1);
+    ++buckets_[bucket];
+    ++count_;
+    sum_ns_ += static_cast<std::int64_t>(ns);
+    max_ns_  = std::max<std::int64_t>(max_ns_, ns);
+}
+
+std::uint64_t Histogram::count() const { return count_; }
+
+std::chrono::nanoseconds Histogram::quantile(double q) const {
+    if (count_ == 0)
+        return std::chrono::nanoseconds(0);
+    std::uint64_t rank = static_cast<std::uint64_t>(std::clamp(q, 0.0, 1.0) * (count_ - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets_[i];
+        if (seen >= rank)
+            return std::chrono::nanoseconds(std::min<std::int64_t>((std::int64_t(1) << i) - 1, max_ns_));
+    }
+    return std::chrono::nanoseconds(max_ns_);
+}
+
+std::string Histogram::to_json() const {
+    std::ostringstream out;
+    out << "{\"count\": " << count_
+        << ", \"sum_ns\": " << sum_ns_
+        << ", \"max_ns\": " << max_ns_
+        << ", \"p50_ns\": " << quantile(0.5).count()
+        << ", \"p99_ns\": " << quantile(0.99).count()
+        << ", \"buckets\": [";
+    bool first = true;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        if (buckets_[i] == 0)
+            continue;
+        out << (first ? "" : ", ") << "{\"le_ns\": " << ((std::uint64_t(1) << i) - 1) << ", \"count\": " << buckets_[i] << "}";
+        first = false;
+    }
+    out << "]}";
+    return out.str();
+}
+
+/* ===================================== StatsAggregator ===================================== */
+
+StatsAggregator& StatsAggregator::global() {
+    static StatsAggregator aggregator;
+    return aggregator;
+}
+
+void StatsAggregator::enable(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+bool StatsAggregator::is_enabled() const    { return enabled_.load(std::memory_order_relaxed); }
+
+void StatsAggregator::record(const ProcessStats& stats) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++processes_;
+    if (stats.fork_to_exec)
+        fork_to_exec_.record(stats.fork_to_exec.value());
+    if (stats.first_output)
+        first_output_.record(stats.first_output.value());
+    if (stats.wall_time)
+        wall_time_.record(stats.wall_time.value());
+
+    const StreamStats* streams[3] = { &stats.std_in, &stats.std_out, &stats.std_err };
+    for (int i = 0; i < 3; ++i) {
+        streams_[i].bytes    += streams[i]->bytes;
+        streams_[i].io_calls += streams[i]->io_calls;
+        streams_[i].blocked  += streams[i]->blocked;
+    }
+}
+
+void StatsAggregator::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    processes_    = 0;
+    fork_to_exec_ = Histogram();
+    first_output_ = Histogram();
+    wall_time_    = Histogram();
+    streams_      = {};
+}
+
+std::string StatsAggregator::to_json() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+    out << "{\"processes\": " << processes_
+        << ", \"fork_to_exec\": " << fork_to_exec_.to_json()
+        << ", \"first_output\": " << first_output_.to_json()
+        << ", \"wall_time\": " << wall_time_.to_json();
+    const char* names[3] = { "std_in", "std_out", "std_err" };
+    for (int i = 0; i < 3; ++i) {
+        out << ", \"" << names[i] << "\": {\"bytes\": " << streams_[i].bytes
+            << ", \"io_calls\": " << streams_[i].io_calls
+            << ", \"blocked_ns\": " << streams_[i].blocked.count() << "}";
+    }
+    out << "}";
+    return out.str();
+}
+
+std::uint64_t StatsAggregator::processes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return processes_;
+}
+Histogram StatsAggregator::fork_to_exec() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fork_to_exec_;
+}
+Histogram StatsAggregator::first_output() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return first_output_;
+}
+Histogram StatsAggregator::wall_time() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return wall_time_;
+}
+StreamStats StatsAggregator::stream(int index) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return streams_.at(index);
+}
+
+} // namespace subprocess
@@ -1,16 +1,123 @@
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <future>
+#include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <thread>
 #include <utility>
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "subprocess/exception.h"
+#include "subprocess/io_uring.h"
 #include "subprocess/streamable.h"
+#include "subprocess/trace.h"
+#include "internal.h"
 
 namespace subprocess {
 
+namespace {
+
+/** Size of the chunks forwarded by communicate(), the default capacity of a pipe. */
+constexpr Bytes::size_type forward_chunk_size = 1 << 16;
+
+/** @brief Returns the number of bytes already read ahead into the stdio buffer of `fp`.
+ *
+ *  Only glibc exposes it; elsewhere it is 0, which is exact for the unbuffered read ends of 
+ *  pipes and sockets opened by File(int), but not for a buffered `FILE*` handed to File. */
+std::size_t buffered_input(FILE* fp) {
+#ifdef __GLIBC__
+    return fp->_IO_read_end - fp->_IO_read_ptr;
+#else
+    return 0;
+#endif
+}
+
+/** @brief Waits until `fp` is ready again after a stdio call failed on a non-blocking descriptor.
+ *  @return False if the failure was not caused by the descriptor being non-blocking. */
+bool wait_if_would_block(FILE* fp, short events) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return false;
+    std::clearerr(fp);
+    ::pollfd pfd{::fileno(fp), events, 0};
+    while (::poll(&pfd, 1, -1) == -1 && errno == EINTR) {}
+    return true;
+}
+
+/** Waits for `events` on `fd` after an operation failed with EAGAIN. */
+void wait_for(int fd, short events) {
+    ::pollfd pfd{fd, events, 0};
+    while (::poll(&pfd, 1, -1) == -1 && errno == EINTR) {}
+}
+
+/** @brief Reads up to `size` bytes from the buffer of `stream` with a single `sgetn`, 
+ *  bypassing the per-character machinery of `std::istream::read`. */
+Bytes stream_read(std::istream& stream, Bytes::size_type size) {
+    Bytes buf(size);
+    std::istream::sentry sentry(stream, true);
+    std::streamsize bytes_read = sentry ? stream.rdbuf()->sgetn(buf.c_str(), size) : 0;
+    /** Matches std::istream::read, which sets both on a short read. */
+    if (static_cast<Bytes::size_type>(bytes_read) < size)
+        stream.setstate(std::ios::eofbit | std::ios::failbit);
+    buf.resize(bytes_read);
+    return buf;
+}
+
+/** @brief Reads `stream` until EOF, sizing the buffer from `in_avail()` when the stream knows it. */
+Bytes stream_read_all(std::istream& stream) {
+    std::istream::sentry sentry(stream, true);
+    if (!sentry)
+        return Bytes();
+    auto            buffer = stream.rdbuf();
+    std::streamsize hint   = std::max<std::streamsize>(buffer->in_avail(), 0);
+    Bytes           buf(hint + BUFSIZ);
+    std::streamsize total_bytes = 0;
+    while (true) {
+        if (buf.size() <= static_cast<Bytes::size_type>(total_bytes))
+            buf.resize(buf.size() * 2);
+        std::streamsize bytes_to_read = buf.size() - total_bytes;
+        std::streamsize bytes_read    = buffer->sgetn(buf.c_str() + total_bytes, bytes_to_read);
+        total_bytes += bytes_read;
+        if (bytes_read < bytes_to_read)
+            break;
+    }
+    stream.setstate(std::ios::eofbit);
+    buf.resize(total_bytes);
+    return buf;
+}
+
+/** @brief Writes `size` bytes to the buffer of `stream` with a single `sputn`, without flushing. */
+void stream_write(std::ostream& stream, const Bytes& buf, Bytes::size_type size) {
+    std::ostream::sentry sentry(stream);
+    if (!sentry || stream.rdbuf()->sputn(buf.data(), size) != static_cast<std::streamsize>(size)) {
+        stream.setstate(std::ios::badbit);
+        throw std::runtime_error("Error occurred while writing to the stream.");
+    }
+}
+
+} // namespace
+
+/* ===================================== Interfaces ===================================== */
+
+std::optional<Bytes> IStreamable::read_some(Bytes::size_type size) { return read(size); }
+/** Deadlines are unsupported by default: a stream without a pollable descriptor cannot be interrupted. */
+Bytes IStreamable::read(Bytes::size_type size, [[maybe_unused]] std::chrono::steady_clock::time_point deadline) { return read(size); }
+
+Task<Bytes> IStreamable::async_read(Bytes::size_type size) { co_return read(size); }
+Task<Bytes> IStreamable::async_read_all()                  { co_return read_all(); }
+
+Task<Bytes::size_type> OStreamable::async_write(Bytes bytes, Bytes::size_type size) { co_return write(bytes, size); }
+
 /* ===================================== File ===================================== */
 
 File::File() : fp_(nullptr) {}
@@ -30,17 +137,30 @@ File::File(int fd) {
 
     if (fp_ == nullptr)
         throw std::runtime_error("Failed to open file descriptor.");
+
+    /** Pipes and sockets are also read with read(2) directly (read_some(), deadline and async 
+     *  reads): their read ends are left unbuffered, so that stdio never reads ahead of them. */
+    struct stat st;
+    if ((flags & O_ACCMODE) != O_WRONLY && ::fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)))
+        ::setvbuf(fp_, nullptr, _IONBF, 0);
 }
 File::File(FILE* fp) { open(fp); }
-File::File(const File& other) : fp_(other.fp_) {}
-File::File(File&& other) noexcept : fp_(std::exchange(other.fp_, nullptr)) {}
+File::File(const File& other) : fp_(other.fp_), adaptive_pipe_size_(other.adaptive_pipe_size_), counters_(other.counters_) {}
+File::File(File&& other) noexcept 
+    : fp_(std::exchange(other.fp_, nullptr)), adaptive_pipe_size_(other.adaptive_pipe_size_), counters_(std::move(other.counters_)) {}
 
 File& File::operator=(const File& other) { 
-    fp_ = other.fp_; 
+    fp_                 = other.fp_; 
+    adaptive_pipe_size_ = other.adaptive_pipe_size_;
+    pipe_full_reads_    = 0;
+    counters_           = other.counters_;
     return *this;
 }
 File& File::operator=(File&& other) noexcept { 
-    fp_ = std::exchange(other.fp_, nullptr);
+    fp_                 = std::exchange(other.fp_, nullptr);
+    adaptive_pipe_size_ = other.adaptive_pipe_size_;
+    pipe_full_reads_    = 0;
+    counters_           = std::move(other.counters_);
     return *this;
 }
 
@@ -89,21 +209,26 @@ Bytes File::read(Bytes::size_type size) {
     if (!is_readable())
         throw std::runtime_error("File is not readable.");
 
+    auto start_time = counters_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    grow_pipe_if_full();
     Bytes buf(size);
     size_t total_bytes = 0;
+    size_t calls       = 0;
     while (total_bytes < buf.size()) {
         size_t bytes_to_read = buf.size() - total_bytes;
+        calls += bytes_to_read > buffered_input(fp_);
         size_t bytes_read = std::fread(buf.c_str() + total_bytes, sizeof(Bytes::value_type), bytes_to_read, fp_);
         total_bytes += bytes_read;
         if (bytes_read < bytes_to_read) {
             if (std::feof(fp_)) {
                 break;
-            } else {
+            } else if (!wait_if_would_block(fp_, POLLIN)) {
                 throw std::runtime_error("Error occurred while reading from the file.");
             }
         }
     }
     buf.resize(total_bytes);
+    account(total_bytes, calls, start_time);
     return buf;
 }
 
@@ -113,23 +238,28 @@ Bytes File::read_all() {
     if (!is_readable())
         throw std::runtime_error("File is not readable.");
 
+    auto start_time = counters_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
     Bytes buf(BUFSIZ);
     size_t total_bytes = 0;
+    size_t calls       = 0;
     while (true) {
         if (buf.size() <= total_bytes)
             buf.resize(buf.size() * 2);
+        grow_pipe_if_full();
         size_t bytes_to_read = buf.size() - total_bytes;
+        calls += bytes_to_read > buffered_input(fp_);
         size_t bytes_read = std::fread(buf.c_str() + total_bytes, sizeof(Bytes::value_type), bytes_to_read, fp_);
         total_bytes += bytes_read;
         if (bytes_read < bytes_to_read) {
             if (std::feof(fp_)) {
                 break;
-            } else {
+            } else if (!wait_if_would_block(fp_, POLLIN)) {
                 throw std::runtime_error("Error occurred while reading from the file.");
             }
         }
     }
     buf.resize(total_bytes);
+    account(total_bytes, calls, start_time);
     return buf;
 }
 
@@ -139,11 +269,32 @@ Bytes::size_type File::write(const Bytes& buf, Bytes::size_type size) {
     if (!is_writable())
         throw std::runtime_error("File is not writable.");
 
+    auto start_time = counters_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
     size_t total_bytes = 0;
+    size_t calls       = 0;
+    if (is_non_blocking()) {
+        /** A partial flush of the stdio buffer cannot be resumed, so the descriptor is written 
+         *  directly. The buffer is empty here, as every write() ends with a flush. */
+        int fd = fileno();
+        while (total_bytes < size) {
+            ssize_t bytes_written = ::write(fd, buf.c_str() + total_bytes, size - total_bytes);
+            ++calls;
+            if (bytes_written == -1) {
+                if (errno == EINTR || wait_if_would_block(fp_, POLLOUT))
+                    continue;
+                throw std::runtime_error("Error occurred while writing to the file.");
+            }
+            total_bytes += bytes_written;
+        }
+        account(total_bytes, calls, start_time);
+        return total_bytes;
+    }
+
     while (total_bytes < size) {
         size_t bytes_to_write = size - total_bytes;
         size_t bytes_written = std::fwrite(buf.c_str() + total_bytes, sizeof(Bytes::value_type), bytes_to_write, fp_);
         total_bytes += bytes_written;
+        ++calls;
         if (bytes_written < bytes_to_write) {
             if (ferror(fp_)) {
                 throw std::runtime_error("Error occurred while writing to the file."); 
@@ -151,9 +302,190 @@ Bytes::size_type File::write(const Bytes& buf, Bytes::size_type size) {
         }
     }
     fflush(fp_);
+    account(total_bytes, calls + 1, start_time);
     return total_bytes;
 }
 
+std::optional<Bytes> File::read_some(Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed file.");
+    if (!is_readable())
+        throw std::runtime_error("File is not readable.");
+
+    if (size_t buffered = buffered_input(fp_)) {
+        Bytes buf(std::min(size, buffered));
+        buf.resize(std::fread(buf.c_str(), sizeof(Bytes::value_type), buf.size(), fp_));
+        account(buf.size(), 0, std::chrono::steady_clock::time_point());
+        return buf;
+    }
+
+    auto start_time = counters_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    grow_pipe_if_full();
+    Bytes buf(size);
+    while (true) {
+        ssize_t bytes_read = ::read(fileno(), buf.c_str(), size);
+        if (bytes_read >= 0) {
+            buf.resize(bytes_read);
+            account(bytes_read, 1, start_time);
+            return buf;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return std::nullopt;
+        if (errno != EINTR)
+            throw OSError(errno, std::generic_category(), "Failed to read from the file");
+    }
+}
+
+Bytes File::read(Bytes::size_type size, std::chrono::steady_clock::time_point deadline) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed file.");
+    if (!is_readable())
+        throw std::runtime_error("File is not readable.");
+
+    auto start_time = counters_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    Bytes buf(size);
+    size_t total_bytes = std::fread(buf.c_str(), sizeof(Bytes::value_type), std::min(size, buffered_input(fp_)), fp_);
+    size_t calls       = 0;
+    int fd = fileno();
+    while (total_bytes < buf.size()) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+            break;
+
+        ::pollfd pfd{fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, static_cast<int>(std::min<std::chrono::milliseconds::rep>(remaining.count(), INT_MAX)));
+        if (ready == -1 && errno != EINTR)
+            throw OSError(errno, std::generic_category(), "Failed to poll the file");
+        if (ready <= 0)
+            continue;
+
+        grow_pipe_if_full();
+        ssize_t bytes_read = ::read(fd, buf.c_str() + total_bytes, buf.size() - total_bytes);
+        ++calls;
+        if (bytes_read == 0)
+            break;
+        if (bytes_read == -1) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+            throw OSError(errno, std::generic_category(), "Failed to read from the file");
+        }
+        total_bytes += bytes_read;
+    }
+    buf.resize(total_bytes);
+    account(total_bytes, calls, start_time);
+    return buf;
+}
+
+Task<Bytes> File::async_read(Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed file.");
+    if (!is_readable())
+        throw std::runtime_error("File is not readable.");
+
+    Bytes buf(size);
+    size_t total_bytes = std::fread(buf.c_str(), sizeof(Bytes::value_type), std::min(size, buffered_input(fp_)), fp_);
+    size_t calls       = 0;
+    int fd = fileno();
+    while (total_bytes < buf.size()) {
+        co_await EventLoop::current().readable(fd);
+        grow_pipe_if_full();
+        ssize_t bytes_read = ::read(fd, buf.c_str() + total_bytes, buf.size() - total_bytes);
+        ++calls;
+        if (bytes_read == 0)
+            break;
+        if (bytes_read == -1) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            throw OSError(errno, std::generic_category(), "Failed to read from the file");
+        }
+        total_bytes += bytes_read;
+    }
+    buf.resize(total_bytes);
+    account(total_bytes, calls, std::chrono::steady_clock::time_point());
+    co_return buf;
+}
+
+Task<Bytes> File::async_read_all() {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed file.");
+    if (!is_readable())
+        throw std::runtime_error("File is not readable.");
+
+    Bytes buf(BUFSIZ);
+    size_t total_bytes = 0;
+    while (size_t buffered = buffered_input(fp_)) {
+        if (buf.size() < total_bytes + buffered)
+            buf.resize(total_bytes + buffered);
+        total_bytes += std::fread(buf.c_str() + total_bytes, sizeof(Bytes::value_type), buffered, fp_);
+    }
+    size_t calls = 0;
+    int fd = fileno();
+    while (true) {
+        if (buf.size() <= total_bytes)
+            buf.resize(buf.size() * 2);
+        co_await EventLoop::current().readable(fd);
+        grow_pipe_if_full();
+        ssize_t bytes_read = ::read(fd, buf.c_str() + total_bytes, buf.size() - total_bytes);
+        ++calls;
+        if (bytes_read == 0)
+            break;
+        if (bytes_read == -1) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            throw OSError(errno, std::generic_category(), "Failed to read from the file");
+        }
+        total_bytes += bytes_read;
+    }
+    buf.resize(total_bytes);
+    account(total_bytes, calls, std::chrono::steady_clock::time_point());
+    co_return buf;
+}
+
+Task<Bytes::size_type> File::async_write(Bytes buf, Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to write to a closed file.");
+    if (!is_writable())
+        throw std::runtime_error("File is not writable.");
+    if (std::fflush(fp_) == EOF)
+        throw OSError(errno, std::generic_category(), "Failed to flush the file");
+
+    /** The descriptor is switched to non-blocking mode for the duration of the call,
+     *  since a writable pipe only guarantees room for PIPE_BUF bytes. */
+    int fd    = fileno();
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags == -1)
+        throw OSError(errno, std::generic_category(), "Failed to retrieve file status flags using fcntl");
+    if (!(flags & O_NONBLOCK) && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to set file status flags using fcntl");
+
+    size_t total_bytes = 0;
+    size_t calls       = 0;
+    std::exception_ptr error;
+    try {
+        while (total_bytes < size) {
+            ssize_t bytes_written = ::write(fd, buf.c_str() + total_bytes, size - total_bytes);
+            ++calls;
+            if (bytes_written == -1) {
+                if (errno == EAGAIN) {
+                    co_await EventLoop::current().writable(fd);
+                    continue;
+                }
+                if (errno == EINTR)
+                    continue;
+                throw OSError(errno, std::generic_category(), "Failed to write to the file");
+            }
+            total_bytes += bytes_written;
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    ::fcntl(fd, F_SETFL, flags);
+    if (error)
+        std::rethrow_exception(error);
+    account(total_bytes, calls, std::chrono::steady_clock::time_point());
+    co_return total_bytes;
+}
+
 void File::close() { 
     if (is_opened() && ::fclose(fp_) == -1)
         throw OSError(errno, std::generic_category(), "Failed to close the file");
@@ -178,6 +510,338 @@ void File::set_bufsize(ssize_t size) {
         throw OSError(errno, std::generic_category(), "Failed to set buffer size");
 }
 
+int File::set_pipe_size(ssize_t size) {
+    int capacity = static_cast<int>(std::clamp<ssize_t>(size, 1, max_pipe_size()));
+    if (::fcntl(fileno(), F_SETPIPE_SZ, capacity) == -1 && errno != EPERM && errno != EBUSY)
+        throw OSError(errno, std::generic_category(), "Failed to set pipe size using fcntl");
+    return pipe_size();
+}
+
+int File::pipe_size() const {
+    if (!is_opened())
+        return -1;
+    return ::fcntl(fileno(), F_GETPIPE_SZ);
+}
+
+void File::set_adaptive_pipe_size(bool adaptive) {
+    adaptive_pipe_size_ = adaptive;
+    pipe_full_reads_    = 0;
+}
+
+int File::max_pipe_size() {
+    static const int max_size = [] {
+        int size = 1 << 20;
+        if (FILE* fp = std::fopen("/proc/sys/fs/pipe-max-size", "r")) {
+            if (std::fscanf(fp, "%d", &size) != 1)
+                size = 1 << 20;
+            std::fclose(fp);
+        }
+        return size;
+    }();
+    return max_size;
+}
+
+void File::grow_pipe_if_full() {
+    if (!adaptive_pipe_size_)
+        return;
+
+    int pending  = 0;
+    int capacity = pipe_size();
+    if (capacity <= 0 || ::ioctl(fileno(), FIONREAD, &pending) == -1 || pending < capacity) {
+        pipe_full_reads_ = 0;
+        return;
+    }
+    /** The writer has been stalled on a full pipe since the last read. */
+    if (++pipe_full_reads_ < 2 || capacity >= max_pipe_size())
+        return;
+    pipe_full_reads_ = 0;
+    set_pipe_size(static_cast<ssize_t>(capacity) * 2);
+}
+
+void File::set_counters(std::shared_ptr<IOCounters> counters) { counters_ = std::move(counters); }
+std::shared_ptr<IOCounters> File::counters() const { return counters_; }
+
+void File::account(std::uint64_t bytes, std::uint64_t calls, std::chrono::steady_clock::time_point start_time) {
+    if (!counters_)
+        return;
+    auto blocked = start_time == std::chrono::steady_clock::time_point() 
+        ? std::chrono::nanoseconds(0) 
+        : std::chrono::steady_clock::now() - start_time;
+    counters_->record(bytes, calls, std::chrono::duration_cast<std::chrono::nanoseconds>(blocked));
+}
+
+void File::set_non_blocking(bool non_blocking) {
+    int fd    = fileno();
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags == -1)
+        throw OSError(errno, std::generic_category(), "Failed to retrieve file status flags using fcntl");
+    flags = non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if (::fcntl(fd, F_SETFL, flags) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to set file status flags using fcntl");
+}
+
+bool File::is_non_blocking() const {
+    if (!is_opened())
+        return false;
+    int flags = ::fcntl(fileno(), F_GETFL);
+    if (flags == -1)
+        throw OSError(errno, std::generic_category(), "Failed to retrieve file status flags using fcntl");
+    return flags & O_NONBLOCK;
+}
+
+void File::flush() {
+    if (is_opened() && std::fflush(fp_) == EOF)
+        throw OSError(errno, std::generic_category(), "Failed to flush the file");
+}
+
+Bytes File::read_buffered() {
+    if (!is_opened())
+        return Bytes();
+    Bytes buf(buffered_input(fp_));
+    buf.resize(std::fread(buf.c_str(), sizeof(Bytes::value_type), buf.size(), fp_));
+    return buf;
+}
+
+/* ===================================== Socket ===================================== */
+
+Socket::~Socket() {
+    try {
+        close();
+    } catch (const std::exception& e) {
+        ::perror("Failed to close the socket");
+    }
+}
+Socket::Socket(int fd) : File(fd) {}
+
+std::pair<std::shared_ptr<Socket>, std::shared_ptr<Socket>> Socket::pair(int type) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, type | SOCK_CLOEXEC, 0, fds) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to open socketpair");
+    return { std::make_shared<Socket>(fds[0]), std::make_shared<Socket>(fds[1]) };
+}
+
+std::shared_ptr<Socket> Socket::duplicate() const {
+    int fd = ::fcntl(fileno(), F_DUPFD_CLOEXEC, 0);
+    if (fd == -1)
+        throw OSError(errno, std::generic_category(), "Failed to duplicate the socket");
+    return std::make_shared<Socket>(fd);
+}
+
+int Socket::type() const { return get_option(SO_TYPE); }
+
+Bytes Socket::read(Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed socket.");
+
+    auto start_time = counters() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    Bytes buf(size);
+    size_t total_bytes = 0;
+    size_t calls       = 0;
+    int fd = fileno();
+    while (total_bytes < size) {
+        ssize_t bytes_read = ::recv(fd, buf.c_str() + total_bytes, size - total_bytes, 0);
+        ++calls;
+        if (bytes_read == 0)
+            break;
+        if (bytes_read == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                wait_for(fd, POLLIN);
+            else if (errno != EINTR)
+                throw OSError(errno, std::generic_category(), "Failed to read from the socket");
+            continue;
+        }
+        total_bytes += bytes_read;
+    }
+    buf.resize(total_bytes);
+    account(total_bytes, calls, start_time);
+    return buf;
+}
+
+Bytes Socket::read_all() {
+    Bytes buf;
+    while (true) {
+        auto chunk = read(BUFSIZ);
+        if (chunk.empty())
+            break;
+        Bytes::size_type total_bytes = buf.size();
+        buf.resize(total_bytes + chunk.size());
+        std::memcpy(buf.c_str() + total_bytes, chunk.c_str(), chunk.size());
+    }
+    return buf;
+}
+
+Bytes::size_type Socket::write(const Bytes& buf, Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to write to a closed socket.");
+
+    auto start_time = counters() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    size_t total_bytes = 0;
+    size_t calls       = 0;
+    int fd = fileno();
+    /** A message of SOCK_SEQPACKET is sent whole or not at all, even when empty. */
+    do {
+        ssize_t bytes_written = ::send(fd, buf.c_str() + total_bytes, size - total_bytes, MSG_NOSIGNAL);
+        ++calls;
+        if (bytes_written == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                wait_for(fd, POLLOUT);
+            else if (errno != EINTR)
+                throw OSError(errno, std::generic_category(), "Failed to write to the socket");
+            continue;
+        }
+        total_bytes += bytes_written;
+    } while (total_bytes < size);
+    account(total_bytes, calls, start_time);
+    return total_bytes;
+}
+
+std::optional<Bytes> Socket::read_some(Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed socket.");
+
+    auto start_time = counters() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    Bytes buf(size);
+    while (true) {
+        ssize_t bytes_read = ::recv(fileno(), buf.c_str(), size, 0);
+        if (bytes_read >= 0) {
+            buf.resize(bytes_read);
+            account(bytes_read, 1, start_time);
+            return buf;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return std::nullopt;
+        if (errno != EINTR)
+            throw OSError(errno, std::generic_category(), "Failed to read from the socket");
+    }
+}
+
+void Socket::close() {
+    /** ENOTCONN: the peer is gone already, and there is no one left to notify. */
+    if (half_close_ && is_opened() && ::shutdown(fileno(), SHUT_WR) == -1 && errno != ENOTCONN)
+        throw OSError(errno, std::generic_category(), "Failed to shut down the socket");
+    File::close();
+}
+
+Bytes::size_type Socket::send_message(const Bytes& buf, Bytes::size_type size, const std::vector<int>& fds) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to write to a closed socket.");
+
+    ::iovec iov{const_cast<char*>(buf.c_str()), size};
+    ::msghdr msg{};
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+    std::vector<char> control(fds.empty() ? 0 : CMSG_SPACE(sizeof(int) * fds.size()));
+    if (!fds.empty()) {
+        msg.msg_control    = control.data();
+        msg.msg_controllen = control.size();
+        ::cmsghdr* cmsg    = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level   = SOL_SOCKET;
+        cmsg->cmsg_type    = SCM_RIGHTS;
+        cmsg->cmsg_len     = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+
+    auto start_time = counters() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    int fd = fileno();
+    ssize_t bytes_sent;
+    size_t  calls = 0;
+    while (true) {
+        bytes_sent = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        ++calls;
+        if (bytes_sent >= 0)
+            break;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            wait_for(fd, POLLOUT);
+        else if (errno != EINTR)
+            throw OSError(errno, std::generic_category(), "Failed to send a message");
+    }
+    /** The descriptors went with the first bytes: the rest of a stream is written as plain data. */
+    Bytes::size_type total_bytes = bytes_sent;
+    while (total_bytes < size) {
+        ssize_t bytes_written = ::send(fd, buf.c_str() + total_bytes, size - total_bytes, MSG_NOSIGNAL);
+        ++calls;
+        if (bytes_written == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                wait_for(fd, POLLOUT);
+            else if (errno != EINTR)
+                throw OSError(errno, std::generic_category(), "Failed to send a message");
+            continue;
+        }
+        total_bytes += bytes_written;
+    }
+    account(total_bytes, calls, start_time);
+    return total_bytes;
+}
+
+std::optional<Socket::Message> Socket::receive_message(Bytes::size_type max_size, std::size_t max_fds) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed socket.");
+
+    Message message;
+    message.data.resize(max_size);
+    ::iovec iov{message.data.c_str(), max_size};
+    ::msghdr msg{};
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+    std::vector<char> control(max_fds == 0 ? 0 : CMSG_SPACE(sizeof(int) * max_fds));
+    msg.msg_control    = control.empty() ? nullptr : control.data();
+    msg.msg_controllen = control.size();
+
+    auto start_time = counters() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    int fd = fileno();
+    ssize_t bytes_read;
+    size_t  calls = 0;
+    while (true) {
+        bytes_read = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        ++calls;
+        if (bytes_read >= 0)
+            break;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            wait_for(fd, POLLIN);
+        else if (errno != EINTR)
+            throw OSError(errno, std::generic_category(), "Failed to receive a message");
+    }
+    for (::cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        std::size_t first = message.fds.size();
+        message.fds.resize(first + count);
+        std::memcpy(message.fds.data() + first, CMSG_DATA(cmsg), sizeof(int) * count);
+    }
+    account(bytes_read, calls, start_time);
+    if (bytes_read == 0 && message.fds.empty())
+        return std::nullopt;
+    message.data.resize(bytes_read);
+    message.truncated = msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC);
+    return message;
+}
+
+void Socket::shutdown(int how) {
+    if (::shutdown(fileno(), how) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to shut down the socket");
+}
+
+void Socket::set_half_close(bool half_close) { half_close_ = half_close; }
+
+void Socket::set_buffer_size(int size) {
+    int fd = fileno();
+    if (::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == -1 ||
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to set the socket buffer size");
+}
+
+int Socket::send_buffer_size() const    { return get_option(SO_SNDBUF); }
+int Socket::receive_buffer_size() const { return get_option(SO_RCVBUF); }
+
+int Socket::get_option(int name) const {
+    int value;
+    ::socklen_t length = sizeof(value);
+    if (::getsockopt(fileno(), SOL_SOCKET, name, &value, &length) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to get a socket option");
+    return value;
+}
+
 /* ===================================== IStream ===================================== */
 
 IStream::IStream() : stream_(nullptr) {}
@@ -206,11 +870,7 @@ Bytes IStream::read(Bytes::size_type size) {
         throw std::runtime_error("Attempted to read from a closed stream.");
     if (!is_readable())
         throw std::runtime_error("Stream is not readable.");
-
-    Bytes buf(size);
-    stream_->read(buf.c_str(), size);
-    buf.resize(stream_->gcount());
-    return buf;
+    return stream_read(*stream_, size);
 }
 
 Bytes IStream::read_all() {
@@ -218,22 +878,7 @@ Bytes IStream::read_all() {
         throw std::runtime_error("Attempted to read from a closed stream.");
     if (!is_readable())
         throw std::runtime_error("Stream is not readable.");
-
-    Bytes buf(BUFSIZ);
-    std::streamsize total_bytes = 0;
-    while (true) {
-        if (buf.size() <= total_bytes)
-            buf.resize(buf.size() * 2);
-        std::streamsize bytes_to_read = buf.size() - total_bytes;
-        stream_->read(buf.c_str() + total_bytes, bytes_to_read);
-        total_bytes += stream_->gcount();
-        if (stream_->eof()) // Operations that reach the End-of-File may also set the failbit, so EOF should be checked first
-            break;          // https://stackoverflow.com/questions/70306575/why-is-failbit-set-when-i-enter-eof
-        if (stream_->fail())
-            throw std::runtime_error("Error occurred while reading from the stream.");
-   }
-   buf.resize(total_bytes);
-   return buf;
+    return stream_read_all(*stream_);
 }
 
 void IStream::close() { stream_ = nullptr; }
@@ -268,18 +913,657 @@ Bytes::size_type OStream::write(const Bytes& buf, Bytes::size_type size) {
         throw std::runtime_error("Attempted to write to a closed stream.");
     if (!is_writable())
         throw std::runtime_error("Stream is not writable.");
-
-    stream_->write(buf.data(), size);
-    if (stream_->fail())
-        throw std::runtime_error("Error occurred while writing to the stream.");
-    stream_->flush();
+    /** Not flushed: the stream keeps its own buffering until close(). */
+    stream_write(*stream_, buf, size);
     return size;
 }
 
-void OStream::close() { stream_ = nullptr; }
+void OStream::close() {
+    if (stream_)
+        stream_->flush();
+    stream_ = nullptr;
+}
 void OStream::release() { stream_ = nullptr; }
 void OStream::open(std::ostream* stream) { stream_ = stream; }
 
+/* ===================================== TailBuffer ===================================== */
+
+TailBuffer::TailBuffer(std::size_t max_bytes, std::size_t max_lines)
+    : max_bytes_(max_bytes), max_lines_(max_lines), written_(0), claimed_(0), closed_(false) {
+    if (max_bytes == 0)
+        throw std::invalid_argument("Tail buffer must retain at least one byte.");
+    ring_ = std::make_unique<std::atomic<char>[]>(max_bytes);
+}
+
+int TailBuffer::fileno() const { return -1; }
+
+bool TailBuffer::is_opened() const   { return !closed_.load(std::memory_order_relaxed); }
+bool TailBuffer::is_readable() const { return false; }
+bool TailBuffer::is_writable() const { return is_opened(); }
+
+Bytes::size_type TailBuffer::write(const Bytes& buf, Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to write to a closed stream.");
+
+    std::uint64_t end  = written_.load(std::memory_order_relaxed) + size;
+    std::size_t   kept = std::min(size, max_bytes_);
+    /** The claim is visible to any snapshot that reads one of the bytes overwritten below. */
+    claimed_.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    const char* data = buf.data() + (size - kept);
+    for (std::uint64_t pos = end - kept; pos < end; ++pos)
+        ring_[pos % max_bytes_].store(*data++, std::memory_order_relaxed);
+    written_.store(end, std::memory_order_release);
+    return size;
+}
+
+void TailBuffer::close()   { closed_.store(true, std::memory_order_relaxed); }
+void TailBuffer::release() { close(); }
+
+Bytes TailBuffer::snapshot() const {
+    std::uint64_t end   = written_.load(std::memory_order_acquire);
+    std::uint64_t begin = end > max_bytes_ ? end - max_bytes_ : 0;
+    Bytes data(end - begin);
+    for (std::uint64_t pos = begin; pos < end; ++pos)
+        data[pos - begin] = ring_[pos % max_bytes_].load(std::memory_order_relaxed);
+
+    /** Bytes before `claimed - max_bytes` may have been overwritten while they were copied. */
+    std::atomic_thread_fence(std::memory_order_acquire);
+    std::uint64_t claimed = claimed_.load(std::memory_order_relaxed);
+    std::uint64_t valid   = claimed > max_bytes_ ? claimed - max_bytes_ : 0;
+    std::size_t   first   = static_cast<std::size_t>(std::min(std::max(valid, begin), end) - begin);
+    std::size_t   last    = data.size();
+
+    if (max_lines_ > 0) {
+        /** A line whose start was overwritten is incomplete. */
+        if (begin + first > 0) {
+            auto newline = std::find(data.data() + first, data.data() + last, '\n');
+            first = newline == data.data() + last ? last : newline - data.data() + 1;
+        }
+        std::size_t lines = 0;
+        for (std::size_t i = last; i > first; --i) {
+            if (data[i - 1] == '\n' && i != last && ++lines == max_lines_) {
+                first = i;
+                break;
+            }
+        }
+    }
+    return Bytes(data.data() + first, data.data() + last);
+}
+
+std::uint64_t TailBuffer::total() const     { return written_.load(std::memory_order_acquire); }
+std::size_t   TailBuffer::max_bytes() const { return max_bytes_; }
+std::size_t   TailBuffer::max_lines() const { return max_lines_; }
+
+/* ===================================== Tee ===================================== */
+
+namespace {
+
+/** Forwards `in` to `out` chunk by chunk, so that memory stays bounded whatever the volume. */
+Bytes::size_type copy_chunks(IStreamable& in, OStreamable& out) {
+    Bytes::size_type size = 0;
+    /** Streams such as IStream stop being readable once they reach EOF. */
+    while (in.is_opened() && in.is_readable()) {
+        std::optional<Bytes> chunk;
+        {
+            SUBPROCESS_TRACE_SCOPE("read", "\"fd\": " + std::to_string(in.fileno()));
+            chunk = in.read_some(forward_chunk_size);
+        }
+        if (!chunk) {
+            /** Non-blocking input without data available. */
+            ::pollfd pfd{in.fileno(), POLLIN, 0};
+            while (::poll(&pfd, 1, -1) == -1 && errno == EINTR) {}
+            continue;
+        }
+        if (chunk->empty())
+            break;
+        SUBPROCESS_TRACE_SCOPE("write", "\"fd\": " + std::to_string(out.fileno()) + ", \"bytes\": " + std::to_string(chunk->size()));
+        size += out.write(chunk.value(), chunk->size());
+    }
+    return size;
+}
+
+/** @brief A sink calling a function with each chunk. */
+class CallbackSink : public OStreamable {
+public:
+    explicit CallbackSink(std::function<void(const Bytes&)> callback) : callback_(std::move(callback)) {}
+
+    int  fileno() const override      { return -1;    }
+    bool is_opened() const override   { return true;  }
+    bool is_readable() const override { return false; }
+    bool is_writable() const override { return true;  }
+
+    Bytes::size_type write(const Bytes& buf, Bytes::size_type size) override {
+        if (size == buf.size())
+            callback_(buf);
+        else
+            callback_(Bytes(buf.data(), buf.data() + size));
+        return size;
+    }
+
+    void close() override   {}
+    void release() override {}
+
+private:
+    std::function<void(const Bytes&)> callback_;
+};
+
+/** True if data can be spliced into `fd`: a pipe, a socket or a regular file not opened with O_APPEND. */
+bool is_splice_target(int fd) {
+    struct ::stat st;
+    if (fd == -1 || ::fstat(fd, &st) == -1)
+        return false;
+    int flags = ::fcntl(fd, F_GETFL);
+    return flags != -1 && !(flags & O_APPEND) && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode) || S_ISREG(st.st_mode));
+}
+
+/** Moves exactly `size` bytes from the pipe `from` into `to`. */
+void splice_all(int from, int to, std::size_t size) {
+    while (size > 0) {
+        ssize_t moved = ::splice(from, nullptr, to, nullptr, size, SPLICE_F_MOVE);
+        if (moved > 0) {
+            size -= moved;
+        } else if (moved == 0) {
+            throw std::runtime_error("Pipe ended before the data could be spliced.");
+        } else if (errno == EAGAIN) {
+            wait_for(to, POLLOUT);
+            wait_for(from, POLLIN);
+        } else if (errno != EINTR) {
+            throw OSError(errno, std::generic_category(), "Failed to splice data");
+        }
+    }
+}
+
+/** Pipes used to duplicate data with tee(2), closed on destruction. */
+struct TeePipes {
+    ~TeePipes() {
+        for (auto& fds : pipes) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+        }
+    }
+    std::vector<std::array<int, 2>> pipes;
+};
+
+} // namespace
+
+Tee::Tee() : closed_(false) {}
+Tee::~Tee() { close(); }
+
+Tee& Tee::add(std::shared_ptr<OStreamable> sink, SinkPolicy policy, std::size_t limit) {
+    if (!sink)
+        throw std::invalid_argument("Tee sink must not be null.");
+    auto entry    = std::make_unique<Sink>();
+    entry->stream = std::move(sink);
+    entry->policy = policy;
+    entry->limit  = policy == SinkPolicy::BUFFER ? limit : 0;
+    if (policy != SinkPolicy::BLOCK) {
+        Sink& ref     = *entry;
+        entry->thread = std::thread([&ref] { run(ref); });
+    }
+    sinks_.push_back(std::move(entry));
+    return *this;
+}
+Tee& Tee::add(std::function<void(const Bytes&)> callback, SinkPolicy policy, std::size_t limit) {
+    return add(std::make_shared<CallbackSink>(std::move(callback)), policy, limit);
+}
+
+int  Tee::fileno() const      { return -1; }
+bool Tee::is_opened() const   { return !closed_; }
+bool Tee::is_readable() const { return false; }
+bool Tee::is_writable() const { return is_opened(); }
+
+Bytes::size_type Tee::write(const Bytes& buf, Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to write to a closed stream.");
+    if (size == buf.size()) {
+        for (auto& sink : sinks_)
+            deliver(*sink, buf);
+    } else {
+        Bytes chunk(buf.data(), buf.data() + size);
+        for (auto& sink : sinks_)
+            deliver(*sink, chunk);
+    }
+    return size;
+}
+
+Bytes::size_type Tee::forward(File& pipe) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to write to a closed stream.");
+    /** A sink whose reader is gone fails with EPIPE, in the kernel and in user space alike. */
+    internal::SigpipeGuard guard;
+    int in = pipe.fileno();
+    struct ::stat st;
+    if (in == -1 || ::fstat(in, &st) == -1 || !S_ISFIFO(st.st_mode))
+        return copy_chunks(pipe, *this);
+
+    /** Blocking sinks that can be spliced stay in the kernel; the others get a copy in user space. */
+    std::vector<int>   kernel_fds;
+    std::vector<Sink*> user_sinks;
+    for (auto& sink : sinks_) {
+        int fd = sink->stream->fileno();
+        if (sink->policy == SinkPolicy::BLOCK && is_splice_target(fd))
+            kernel_fds.push_back(fd);
+        else
+            user_sinks.push_back(sink.get());
+    }
+    if (kernel_fds.empty())
+        return copy_chunks(pipe, *this);
+
+    /** Without user-space sinks, the last sink consumes the data from the pipe; the others get a duplicate. */
+    int consumer = -1;
+    if (user_sinks.empty()) {
+        consumer = kernel_fds.back();
+        kernel_fds.pop_back();
+    }
+    /** Duplicates go through empty pipes as large as the input, so that each tee(2) takes a whole chunk.
+     *  A pipe that cannot grow that large (e.g. beyond /proc/sys/fs/pipe-max-size for an unprivileged 
+     *  user) could not take every chunk: nothing is consumed yet, so the copy in user space takes over. */
+    TeePipes tee_pipes;
+    int      capacity = std::max(::fcntl(in, F_GETPIPE_SZ), 1 << 16);
+    for (std::size_t i = 0; i < kernel_fds.size(); ++i) {
+        std::array<int, 2> fds;
+        if (::pipe2(fds.data(), O_CLOEXEC) == -1)
+            throw OSError(errno, std::generic_category(), "Failed to open pipe");
+        tee_pipes.pipes.push_back(fds);
+        if (::fcntl(fds[1], F_SETPIPE_SZ, capacity) < capacity)
+            return copy_chunks(pipe, *this);
+    }
+
+    auto counters = pipe.counters();
+    Bytes::size_type total = 0;
+    while (true) {
+        ssize_t size;
+        while (true) {
+            size = kernel_fds.empty()
+                 ? ::splice(in, nullptr, consumer, nullptr, capacity, SPLICE_F_MOVE)
+                 : ::tee(in, tee_pipes.pipes[0][1], capacity, 0);
+            if (size >= 0)
+                break;
+            if (errno == EAGAIN)
+                wait_for(in, POLLIN);
+            else if (errno != EINTR)
+                throw OSError(errno, std::generic_category(), "Failed to duplicate pipe data");
+        }
+        if (size == 0)
+            break;
+
+        for (std::size_t i = 1; i < kernel_fds.size(); ++i) {
+            ssize_t duplicated;
+            while ((duplicated = ::tee(in, tee_pipes.pipes[i][1], size, 0)) == -1 && errno == EINTR) {}
+            if (duplicated == -1)
+                throw OSError(errno, std::generic_category(), "Failed to duplicate pipe data");
+            if (duplicated != size)
+                throw std::runtime_error("Short tee: duplicated " + std::to_string(duplicated) + " of " + 
+                                         std::to_string(size) + " bytes of pipe data.");
+        }
+        for (std::size_t i = 0; i < kernel_fds.size(); ++i)
+            splice_all(tee_pipes.pipes[i][0], kernel_fds[i], size);
+
+        if (!kernel_fds.empty() && consumer != -1) {
+            splice_all(in, consumer, size);
+        } else if (!user_sinks.empty()) {
+            Bytes chunk(size);
+            for (ssize_t done = 0; done < size;) {
+                ssize_t bytes_read = ::read(in, chunk.data() + done, size - done);
+                if (bytes_read > 0)
+                    done += bytes_read;
+                else if (bytes_read == -1 && errno == EAGAIN)
+                    wait_for(in, POLLIN);
+                else if (bytes_read == 0 || errno != EINTR)
+                    throw OSError(errno, std::generic_category(), "Failed to read duplicated pipe data");
+            }
+            for (auto sink : user_sinks)
+                deliver(*sink, chunk);
+        }
+        if (counters)
+            counters->record(size, 1, std::chrono::nanoseconds(0));
+        total += size;
+    }
+    return total;
+}
+
+void Tee::close() {
+    if (closed_)
+        return;
+    closed_ = true;
+    for (auto& sink : sinks_) {
+        if (!sink->thread.joinable())
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            sink->closing = true;
+        }
+        sink->cv.notify_one();
+        sink->thread.join();
+    }
+}
+void Tee::release() { close(); }
+
+std::size_t   Tee::size() const                    { return sinks_.size(); }
+std::uint64_t Tee::dropped(std::size_t index) const { return sinks_.at(index)->dropped.load(std::memory_order_relaxed); }
+
+void Tee::deliver(Sink& sink, const Bytes& chunk) {
+    if (sink.policy == SinkPolicy::BLOCK) {
+        sink.stream->write(chunk, chunk.size());
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        /** An idle sink always takes the chunk, even one larger than its limit. */
+        if (sink.failed || (sink.queued != 0 && sink.queued + chunk.size() > sink.limit)) {
+            sink.dropped.fetch_add(chunk.size(), std::memory_order_relaxed);
+            return;
+        }
+        sink.queue.push_back(chunk);
+        sink.queued += chunk.size();
+    }
+    sink.cv.notify_one();
+}
+
+void Tee::run(Sink& sink) {
+    /** A sink whose reader is gone fails and is dropped, instead of killing the process. */
+    internal::SigpipeGuard       guard;
+    std::unique_lock<std::mutex> lock(sink.mutex);
+    while (true) {
+        sink.cv.wait(lock, [&sink] { return !sink.queue.empty() || sink.closing; });
+        if (sink.queue.empty())
+            return;
+        Bytes chunk = std::move(sink.queue.front());
+        sink.queue.pop_front();
+        lock.unlock();
+        try {
+            sink.stream->write(chunk, chunk.size());
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to write to a tee sink: " << e.what() << std::endl;
+            lock.lock();
+            sink.failed = true;
+            sink.dropped.fetch_add(sink.queued, std::memory_order_relaxed);
+            sink.queue.clear();
+            sink.queued = 0;
+            continue;
+        }
+        lock.lock();
+        sink.queued -= chunk.size();
+    }
+}
+
+/* ===================================== PipeStreambuf ===================================== */
+
+void PipeStreambuf::Free::operator()(char* buffer) const { std::free(buffer); }
+
+PipeStreambuf::PipeStreambuf(int fd, std::ios::openmode mode, std::size_t buffer_size) : fd_(fd), buffer_size_(buffer_size) {
+    bool in  = mode & std::ios::in;
+    bool out = mode & std::ios::out;
+    if (fd == -1)
+        throw std::invalid_argument("Pipe stream buffer needs a file descriptor.");
+    if (in == out)
+        throw std::invalid_argument("Pipe stream buffer must be opened for either input or output.");
+    if (buffer_size == 0)
+        throw std::invalid_argument("Pipe stream buffer size must be positive.");
+
+    /** Page-aligned, so that the kernel copies whole pages to and from the buffer. */
+    std::size_t alignment = ::sysconf(_SC_PAGESIZE);
+    std::size_t allocated = (buffer_size + alignment - 1) / alignment * alignment;
+    buffer_.reset(static_cast<char*>(std::aligned_alloc(alignment, allocated)));
+    if (!buffer_)
+        throw std::bad_alloc();
+    if (in)
+        setg(buffer_.get(), buffer_.get(), buffer_.get());
+    else
+        setp(buffer_.get(), buffer_.get() + buffer_size_);
+}
+
+PipeStreambuf::~PipeStreambuf() {
+    try {
+        flush_buffer();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to flush the pipe stream buffer: " << e.what() << std::endl;
+    }
+}
+
+int PipeStreambuf::fd() const { return fd_; }
+
+PipeStreambuf::int_type PipeStreambuf::underflow() {
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+    if (!eback())
+        return traits_type::eof();
+    std::size_t bytes_read = read_fd(buffer_.get(), buffer_size_);
+    setg(buffer_.get(), buffer_.get(), buffer_.get() + bytes_read);
+    return bytes_read == 0 ? traits_type::eof() : traits_type::to_int_type(*gptr());
+}
+
+std::streamsize PipeStreambuf::xsgetn(char_type* s, std::streamsize count) {
+    std::streamsize total = std::min<std::streamsize>(count, egptr() - gptr());
+    std::memcpy(s, gptr(), total);
+    gbump(total);
+    while (total < count) {
+        std::size_t bytes_read;
+        if (static_cast<std::size_t>(count - total) >= buffer_size_) {
+            /** Large reads go straight to the caller's memory. */
+            bytes_read = read_fd(s + total, count - total);
+        } else {
+            if (traits_type::eq_int_type(underflow(), traits_type::eof()))
+                break;
+            bytes_read = std::min<std::streamsize>(count - total, egptr() - gptr());
+            std::memcpy(s + total, gptr(), bytes_read);
+            gbump(bytes_read);
+        }
+        if (bytes_read == 0)
+            break;
+        total += bytes_read;
+    }
+    return total;
+}
+
+std::streamsize PipeStreambuf::showmanyc() {
+    int available = 0;
+    if (!eback() || ::ioctl(fd_, FIONREAD, &available) == -1)
+        return 0;
+    return available;
+}
+
+PipeStreambuf::int_type PipeStreambuf::overflow(int_type c) {
+    if (!pbase())
+        return traits_type::eof();
+    flush_buffer();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize PipeStreambuf::xsputn(const char_type* s, std::streamsize count) {
+    if (!pbase())
+        return 0;
+    if (count <= epptr() - pptr()) {
+        std::memcpy(pptr(), s, count);
+        pbump(count);
+        return count;
+    }
+    flush_buffer();
+    if (static_cast<std::size_t>(count) >= buffer_size_) {
+        /** Large writes go straight from the caller's memory. */
+        write_fd(s, count);
+    } else {
+        std::memcpy(pptr(), s, count);
+        pbump(count);
+    }
+    return count;
+}
+
+int PipeStreambuf::sync() {
+    flush_buffer();
+    return 0;
+}
+
+std::size_t PipeStreambuf::read_fd(char* buf, std::size_t size) {
+    while (true) {
+        ssize_t bytes_read = ::read(fd_, buf, size);
+        if (bytes_read >= 0)
+            return bytes_read;
+        if (errno == EAGAIN)
+            wait_for(fd_, POLLIN);
+        else if (errno != EINTR)
+            throw OSError(errno, std::generic_category(), "Failed to read from the pipe");
+    }
+}
+
+void PipeStreambuf::write_fd(const char* buf, std::size_t size) {
+    while (size > 0) {
+        ssize_t bytes_written = ::write(fd_, buf, size);
+        if (bytes_written >= 0) {
+            buf  += bytes_written;
+            size -= bytes_written;
+        } else if (errno == EAGAIN) {
+            wait_for(fd_, POLLOUT);
+        } else if (errno != EINTR) {
+            throw OSError(errno, std::generic_category(), "Failed to write to the pipe");
+        }
+    }
+}
+
+void PipeStreambuf::flush_buffer() {
+    if (!pbase() || pptr() == pbase())
+        return;
+    /** The buffer is reset first, so that a failed write is not retried by the destructor. */
+    std::size_t size = pptr() - pbase();
+    setp(buffer_.get(), buffer_.get() + buffer_size_);
+    write_fd(buffer_.get(), size);
+}
+
+PipeIStream::PipeIStream(int fd, std::size_t buffer_size) : std::istream(nullptr), buf_(fd, std::ios::in, buffer_size) { rdbuf(&buf_); }
+PipeIStream::PipeIStream(const Streamable& pipe, std::size_t buffer_size) : PipeIStream(pipe.fileno(), buffer_size) {}
+
+PipeOStream::PipeOStream(int fd, std::size_t buffer_size) : std::ostream(nullptr), buf_(fd, std::ios::out, buffer_size) { rdbuf(&buf_); }
+PipeOStream::PipeOStream(const Streamable& pipe, std::size_t buffer_size) : PipeOStream(pipe.fileno(), buffer_size) {}
+
+/* ===================================== Generator ===================================== */
+
+Generator::Generator(Producer producer) 
+    : producer_(std::move(producer)), offset_(0), ended_(false), closed_(false), broken_(false) {
+    if (!producer_)
+        throw std::invalid_argument("Generator producer must not be empty.");
+}
+
+int  Generator::fileno() const      { return -1; }
+bool Generator::is_opened() const   { return !closed_; }
+bool Generator::is_readable() const { return is_opened() && (!ended_ || offset_ < chunk_.size()); }
+bool Generator::is_writable() const { return false; }
+
+Bytes Generator::read(Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed stream.");
+    Bytes out;
+    while (out.size() < size && take(size - out.size(), out)) {}
+    return out;
+}
+
+Bytes Generator::read_all() {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed stream.");
+    Bytes out;
+    while (take(std::numeric_limits<Bytes::size_type>::max(), out)) {}
+    return out;
+}
+
+std::optional<Bytes> Generator::read_some(Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed stream.");
+    Bytes out;
+    take(size, out);
+    return out;
+}
+
+Bytes::size_type Generator::forward(File& pipe) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to read from a closed stream.");
+    if (!pipe.is_opened())
+        throw std::runtime_error("Attempted to write to a closed stream.");
+
+    internal::SigpipeGuard guard;
+    int              fd       = pipe.fileno();
+    auto             counters = pipe.counters();
+    Bytes::size_type total    = 0;
+    Bytes            chunk;
+    while (!broken_) {
+        /** The next chunk is only pulled once the pipe has room, or the reader is gone. */
+        ::pollfd pfd{fd, POLLOUT, 0};
+        while (::poll(&pfd, 1, -1) == -1) {
+            if (errno != EINTR)
+                throw OSError(errno, std::generic_category(), "Failed to wait for the pipe");
+        }
+        if (pfd.revents & POLLERR) {
+            broken_ = true;
+            break;
+        }
+        chunk.clear();
+        if (!take(std::numeric_limits<Bytes::size_type>::max(), chunk))
+            break;
+
+        Bytes::size_type done  = 0;
+        std::uint64_t    calls = 0;
+        while (done < chunk.size()) {
+            ssize_t bytes_written = ::write(fd, chunk.data() + done, chunk.size() - done);
+            ++calls;
+            if (bytes_written >= 0) {
+                done += bytes_written;
+            } else if (errno == EAGAIN) {
+                wait_for(fd, POLLOUT);
+            } else if (errno == EPIPE) {
+                broken_ = true;
+                break;
+            } else if (errno != EINTR) {
+                throw OSError(errno, std::generic_category(), "Failed to write to the pipe");
+            }
+        }
+        if (counters)
+            counters->record(done, calls, std::chrono::nanoseconds(0));
+        total += done;
+    }
+    return total;
+}
+
+bool Generator::broken() const { return broken_; }
+
+void Generator::close() {
+    closed_ = true;
+    chunk_.clear();
+    offset_ = 0;
+}
+void Generator::release() { close(); }
+
+bool Generator::take(Bytes::size_type size, Bytes& out) {
+    while (offset_ == chunk_.size()) {
+        if (ended_ || closed_)
+            return false;
+        auto next = producer_();
+        if (!next) {
+            ended_ = true;
+            chunk_.clear();
+            offset_ = 0;
+            return false;
+        }
+        chunk_  = std::move(next.value());
+        offset_ = 0;
+    }
+
+    Bytes::size_type count = std::min(size, chunk_.size() - offset_);
+    if (out.empty() && offset_ == 0 && count == chunk_.size()) {
+        /** A whole chunk is handed over without a copy. */
+        out = std::move(chunk_);
+        chunk_.clear();
+        return true;
+    }
+    Bytes::size_type start = out.size();
+    out.resize(start + count);
+    std::copy(chunk_.data() + offset_, chunk_.data() + offset_ + count, out.data() + start);
+    offset_ += count;
+    return true;
+}
+
 /* ===================================== IOStream ===================================== */
 
 IOStream::IOStream() : stream_(nullptr) {}
@@ -308,11 +1592,7 @@ Bytes IOStream::read(Bytes::size_type size) {
         throw std::runtime_error("Attempted to read from a closed stream.");
     if (!is_readable())
         throw std::runtime_error("Stream is not readable.");
-
-    Bytes buf(size);
-    stream_->read(buf.c_str(), size);
-    buf.resize(stream_->gcount());
-    return buf;
+    return stream_read(*stream_, size);
 }
 
 Bytes IOStream::read_all() {
@@ -320,22 +1600,7 @@ Bytes IOStream::read_all() {
         throw std::runtime_error("Attempted to read from a closed stream.");
     if (!is_readable())
         throw std::runtime_error("Stream is not readable.");
-
-    Bytes buf(BUFSIZ);
-    std::streamsize total_bytes = 0;
-    while (true) {
-        if (buf.size() <= total_bytes)
-            buf.resize(buf.size() * 2);
-        std::streamsize bytes_to_read = buf.size() - total_bytes;
-        stream_->read(buf.c_str() + total_bytes, bytes_to_read);
-        total_bytes += stream_->gcount();
-        if (stream_->eof()) // Operations that reach the End-of-File may also set the failbit, so EOF should be checked first
-            break;          // https://stackoverflow.com/questions/70306575/why-is-failbit-set-when-i-enter-eof
-        if (stream_->fail())
-            throw std::runtime_error("Error occurred while reading from the stream.");
-   }
-   buf.resize(total_bytes);
-   return buf;
+    return stream_read_all(*stream_);
 }
 
 Bytes::size_type IOStream::write(const Bytes& buf, Bytes::size_type size) {
@@ -343,15 +1608,16 @@ Bytes::size_type IOStream::write(const Bytes& buf, Bytes::size_type size) {
         throw std::runtime_error("Attempted to write to a closed stream.");
     if (!is_writable())
         throw std::runtime_error("Stream is not writable.");
-
-    stream_->write(buf.data(), size);
-    if (stream_->fail())
-        throw std::runtime_error("Error occurred while writing to the stream.");
-    stream_->flush();
+    /** Not flushed: the stream keeps its own buffering until close(). */
+    stream_write(*stream_, buf, size);
     return size;
 }
 
-void IOStream::close() { stream_ = nullptr; }
+void IOStream::close() {
+    if (stream_)
+        stream_->flush();
+    stream_ = nullptr;
+}
 void IOStream::release() { stream_ = nullptr; }
 void IOStream::open(std::iostream* stream) { stream_ = stream; }
 
@@ -367,9 +1633,23 @@ Bytes::size_type communicate(IStreamable& in, OStreamable& out, bool auto_close)
     if (!out.is_writable())
         throw std::runtime_error("Stream is not writable.");
 
-    Bytes bytes = in.read_all();
+    auto in_file  = dynamic_cast<File*>(&in);
+    auto out_file = dynamic_cast<File*>(&out);
+    if (in_file && out_file && io_backend() == IOBackend::IO_URING) {
+        Bytes::size_type size = io_uring_transfer(*in_file, *out_file);
+        if (auto_close) in.close();
+        if (auto_close) out.close();
+        return size;
+    }
+
+    Bytes::size_type size;
+    if (auto tee = dynamic_cast<Tee*>(&out); tee && in_file)
+        size = tee->forward(*in_file);
+    else if (auto generator = dynamic_cast<Generator*>(&in); generator && out_file)
+        size = generator->forward(*out_file);
+    else
+        size = copy_chunks(in, out);
     if (auto_close) in.close();
-    Bytes::size_type size = out.write(bytes, bytes.size());
     if (auto_close) out.close();
     return size;
 }
@@ -385,11 +1665,12 @@ std::future<Bytes::size_type> communicate_async(IStreamable& in, OStreamable& ou
         throw std::runtime_error("Stream is not writable.");
 
     return std::async(std::launch::async, [&]() {
-         Bytes bytes = in.read_all();
-         if (auto_close) in.close();
-         Bytes::size_type size = out.write(bytes, bytes.size());
-         if (auto_close) out.close();
-         return size;
+        SUBPROCESS_TRACE(tracer.track_name(
+            trace::Tracer::current_track(), 
+            "forward fd " + std::to_string(in.fileno()) + " -> fd " + std::to_string(out.fileno())
+        ));
+        SUBPROCESS_TRACE_SCOPE("forward");
+        return communicate(in, out, auto_close); 
     });
 }
 
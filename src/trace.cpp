@@ -0,0 +1,134 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "subprocess/exception.h"
+#include "subprocess/trace.h"
+
+namespace subprocess {
+
+namespace trace {
+
+namespace {
+
+/** Microseconds since the clock's epoch, the unit of trace-event timestamps. */
+double timestamp(Clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time.time_since_epoch()).count();
+}
+
+std::string escape(std::string_view text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            escaped += c;
+    }
+    return escaped;
+}
+
+} // namespace
+
+Tracer& Tracer::global() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() : enabled_(false) {
+    if (const char* file = std::getenv("SUBPROCESS_TRACE_FILE"); file && *file)
+        start(file);
+}
+
+Tracer::~Tracer() {
+    try {
+        stop();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to write trace: " << e.what() << std::endl;
+    }
+}
+
+void Tracer::start(const std::filesystem::path& file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_    = file;
+    enabled_ = true;
+    events_.clear();
+}
+
+void Tracer::stop() {
+    std::vector<std::string> events;
+    std::filesystem::path    file;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_)
+            return;
+        enabled_ = false;
+        events.swap(events_);
+        file = file_;
+    }
+
+    std::ofstream out(file, std::ios::trunc);
+    if (!out)
+        throw OSError(errno, std::generic_category(), "Failed to open trace file", file);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    for (std::size_t i = 0; i < events.size(); ++i)
+        out << events[i] << (i + 1 < events.size() ? ",\n" : "\n");
+    out << "]}\n";
+}
+
+bool Tracer::is_enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return enabled_;
+}
+
+void Tracer::track_name(::pid_t track, std::string_view name) {
+    std::ostringstream event;
+    event << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": " << ::getpid() << ", \"tid\": " << track
+          << ", \"args\": {\"name\": \"" << escape(name) << "\"}}";
+    append(event.str());
+}
+
+void Tracer::complete(std::string_view name, ::pid_t track, Clock::time_point start, Clock::time_point end, std::string_view args) {
+    std::ostringstream event;
+    event << std::fixed << "{\"ph\": \"X\", \"name\": \"" << escape(name) << "\", \"pid\": " << ::getpid() << ", \"tid\": " << track
+          << ", \"ts\": " << timestamp(start) << ", \"dur\": " << timestamp(end) - timestamp(start);
+    if (!args.empty())
+        event << ", \"args\": {" << args << "}";
+    event << "}";
+    append(event.str());
+}
+
+void Tracer::instant(std::string_view name, ::pid_t track, std::string_view args) {
+    std::ostringstream event;
+    event << std::fixed << "{\"ph\": \"i\", \"s\": \"t\", \"name\": \"" << escape(name) << "\", \"pid\": " << ::getpid()
+          << ", \"tid\": " << track << ", \"ts\": " << timestamp(Clock::now());
+    if (!args.empty())
+        event << ", \"args\": {" << args << "}";
+    event << "}";
+    append(event.str());
+}
+
+::pid_t Tracer::current_track() {
+    thread_local ::pid_t tid = ::gettid();
+    return tid;
+}
+
+void Tracer::append(std::string event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (enabled_)
+        events_.push_back(std::move(event));
+}
+
+Scope::Scope(std::string_view name, std::string args) : name_(name), args_(std::move(args)), start_(Clock::now()) {}
+Scope::~Scope() {
+    auto& tracer = Tracer::global();
+    if (tracer.is_enabled())
+        tracer.complete(name_, Tracer::current_track(), start_, Clock::now(), args_);
+}
+
+} // namespace trace
+
+} // namespace subprocess
@@ -0,0 +1,241 @@
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef SUBPROCESS_ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "subprocess/transform.h"
+
+namespace subprocess {
+
+namespace {
+
+/** Appends `size` bytes at `data` to `out`; the capacity of `out` is kept between chunks. */
+void append(Bytes& out, const char* data, std::size_t size) {
+    std::size_t offset = out.size();
+    out.resize(offset + size);
+    std::memcpy(out.data() + offset, data, size);
+}
+
+} // namespace
+
+/* ===================================== LineTransform ===================================== */
+
+LineTransform::LineTransform(std::size_t max_line) : max_line_(max_line) {
+    if (max_line_ == 0)
+        throw std::invalid_argument("Maximum line length must be positive.");
+}
+
+void LineTransform::process(const char* data, std::size_t size, Bytes& out) {
+    auto last = static_cast<const char*>(::memrchr(data, '\n', size));
+    if (last) {
+        append(out, partial_.data(), partial_.size());
+        partial_.clear();
+        append(out, data, last + 1 - data);
+        partial_.append(last + 1, data + size - (last + 1));
+    } else {
+        partial_.append(data, size);
+    }
+    /** An overlong line is passed in pieces rather than held back whole. */
+    if (partial_.size() >= max_line_) {
+        append(out, partial_.data(), partial_.size());
+        partial_.clear();
+    }
+}
+
+void LineTransform::finish(Bytes& out) {
+    append(out, partial_.data(), partial_.size());
+    partial_.clear();
+}
+
+/* ===================================== PrefixTransform ===================================== */
+
+PrefixTransform::PrefixTransform(std::string prefix) : prefix_(std::move(prefix)), line_start_(true) {}
+
+void PrefixTransform::process(const char* data, std::size_t size, Bytes& out) {
+    const char* end = data + size;
+    while (data < end) {
+        if (line_start_)
+            append(out, prefix_.data(), prefix_.size());
+        auto newline = static_cast<const char*>(std::memchr(data, '\n', end - data));
+        auto next    = newline ? newline + 1 : end;
+        append(out, data, next - data);
+        line_start_ = newline != nullptr;
+        data        = next;
+    }
+}
+
+/* ===================================== FilterTransform ===================================== */
+
+FilterTransform::FilterTransform(std::function<bool(std::string_view)> predicate, std::size_t max_line)
+    : predicate_(std::move(predicate)), max_line_(max_line) {
+    if (!predicate_)
+        throw std::invalid_argument("Filter predicate must not be empty.");
+    if (max_line_ == 0)
+        throw std::invalid_argument("Maximum line length must be positive.");
+}
+
+void FilterTransform::process(const char* data, std::size_t size, Bytes& out) {
+    const char* end = data + size;
+    while (data < end) {
+        auto newline = static_cast<const char*>(std::memchr(data, '\n', end - data));
+        auto next    = newline ? newline + 1 : end;
+        if (overlong_) {
+            /** The rest of an overlong line follows the verdict on its beginning. */
+            if (overlong_.value())
+                append(out, data, next - data);
+            if (newline)
+                overlong_.reset();
+        } else if (newline && partial_.empty()) {
+            emit(std::string_view(data, newline - data), true, out);
+        } else {
+            partial_.append(data, (newline ? newline : end) - data);
+            if (newline) {
+                emit(partial_, true, out);
+                partial_.clear();
+            } else if (partial_.size() >= max_line_) {
+                overlong_ = predicate_(partial_);
+                if (overlong_.value())
+                    append(out, partial_.data(), partial_.size());
+                partial_.clear();
+            }
+        }
+        data = next;
+    }
+}
+
+void FilterTransform::finish(Bytes& out) {
+    if (!partial_.empty())
+        emit(partial_, false, out);
+    partial_.clear();
+    overlong_.reset();
+}
+
+void FilterTransform::emit(std::string_view line, bool newline, Bytes& out) {
+    if (!predicate_(line))
+        return;
+    append(out, line.data(), line.size());
+    if (newline)
+        out.push_back('\n');
+}
+
+#ifdef SUBPROCESS_ENABLE_ZLIB
+/* ===================================== GzipTransform ===================================== */
+
+GzipTransform::GzipTransform(int level) : stream_(std::make_unique<::z_stream>()) {
+    /** A window of 15 bits plus 16 selects the gzip wrapper. */
+    if (::deflateInit2(stream_.get(), level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error("Failed to initialize zlib.");
+}
+
+GzipTransform::~GzipTransform() { ::deflateEnd(stream_.get()); }
+
+void GzipTransform::process(const char* data, std::size_t size, Bytes& out) { deflate(data, size, Z_NO_FLUSH, out); }
+void GzipTransform::finish(Bytes& out)                                      { deflate(nullptr, 0, Z_FINISH, out); }
+
+void GzipTransform::deflate(const char* data, std::size_t size, int flush, Bytes& out) {
+    stream_->next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream_->avail_in = static_cast<uInt>(size);
+    while (true) {
+        std::size_t offset = out.size();
+        std::size_t room   = ::deflateBound(stream_.get(), stream_->avail_in) + 64;
+        out.resize(offset + room);
+        stream_->next_out  = reinterpret_cast<Bytef*>(out.data() + offset);
+        stream_->avail_out = static_cast<uInt>(room);
+        int ret = ::deflate(stream_.get(), flush);
+        out.resize(offset + room - stream_->avail_out);
+        if (ret == Z_STREAM_ERROR)
+            throw std::runtime_error("Failed to compress data with zlib.");
+        if (flush == Z_FINISH ? ret == Z_STREAM_END : stream_->avail_in == 0 && stream_->avail_out != 0)
+            return;
+    }
+}
+#endif
+
+/* ===================================== TransformChain ===================================== */
+
+TransformChain::TransformChain(std::shared_ptr<OStreamable> destination) : destination_(std::move(destination)), closed_(false) {
+    if (!destination_)
+        throw std::invalid_argument("Transform chain destination must not be null.");
+}
+
+TransformChain::~TransformChain() {
+    try {
+        close();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to flush the transform chain: " << e.what() << std::endl;
+    }
+}
+
+TransformChain& TransformChain::add(std::shared_ptr<Transform> stage) {
+    if (!stage)
+        throw std::invalid_argument("Transform stage must not be null.");
+    auto entry       = std::make_unique<Stage>();
+    entry->transform = std::move(stage);
+    stages_.push_back(std::move(entry));
+    return *this;
+}
+
+int  TransformChain::fileno() const      { return -1; }
+bool TransformChain::is_opened() const   { return !closed_ && destination_->is_opened(); }
+bool TransformChain::is_readable() const { return false; }
+bool TransformChain::is_writable() const { return is_opened(); }
+
+Bytes::size_type TransformChain::write(const Bytes& buf, Bytes::size_type size) {
+    if (!is_opened())
+        throw std::runtime_error("Attempted to write to a closed stream.");
+    run(0, buf, size);
+    return size;
+}
+
+void TransformChain::close() {
+    if (closed_)
+        return;
+    closed_ = true;
+    /** What a stage held back still goes through the stages after it. */
+    for (std::size_t i = 0; i < stages_.size(); ++i) {
+        auto& stage = *stages_[i];
+        stage.buffer.clear();
+        stage.transform->finish(stage.buffer);
+        stage.bytes_out.fetch_add(stage.buffer.size(), std::memory_order_relaxed);
+        if (!stage.buffer.empty())
+            run(i + 1, stage.buffer, stage.buffer.size());
+    }
+}
+void TransformChain::release() { closed_ = true; }
+
+const std::shared_ptr<OStreamable>& TransformChain::destination() const { return destination_; }
+std::size_t                         TransformChain::size() const        { return stages_.size(); }
+
+TransformStats TransformChain::stats(std::size_t index) const {
+    auto& stage = *stages_.at(index);
+    TransformStats stats;
+    stats.bytes_in  = stage.bytes_in.load(std::memory_order_relaxed);
+    stats.bytes_out = stage.bytes_out.load(std::memory_order_relaxed);
+    stats.chunks    = stage.chunks.load(std::memory_order_relaxed);
+    stats.busy      = std::chrono::nanoseconds(stage.busy_ns.load(std::memory_order_relaxed));
+    return stats;
+}
+
+void TransformChain::run(std::size_t first, const Bytes& data, std::size_t size) {
+    const Bytes* input = &data;
+    for (std::size_t i = first; i < stages_.size() && size > 0; ++i) {
+        auto& stage = *stages_[i];
+        stage.buffer.clear();
+        auto start_time = std::chrono::steady_clock::now();
+        stage.transform->process(input->data(), size, stage.buffer);
+        stage.busy_ns.fetch_add((std::chrono::steady_clock::now() - start_time).count(), std::memory_order_relaxed);
+        stage.bytes_in.fetch_add(size, std::memory_order_relaxed);
+        stage.bytes_out.fetch_add(stage.buffer.size(), std::memory_order_relaxed);
+        stage.chunks.fetch_add(1, std::memory_order_relaxed);
+        input = &stage.buffer;
+        size  = stage.buffer.size();
+    }
+    if (size > 0)
+        destination_->write(*input, size);
+}
+
+} // namespace subprocess
@@ -1,6 +1,8 @@
 #include <unistd.h>
 
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "subprocess/exception.h"
 #include "subprocess/types.h"
@@ -8,33 +10,95 @@
 namespace subprocess {
 
 namespace types {
+
+namespace {
+
+/** Creates an unlinked file with close-on-exec set: a sealable memfd when `in_memory` is 
+ *  true and memfd is available, an `O_TMPFILE` in `directory` otherwise. */
+int open_anonymous_file(bool in_memory, const std::filesystem::path& directory) {
+    if (in_memory) {
+        int fd = ::memfd_create("subprocess", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd != -1)
+            return fd;
+        if (errno != ENOSYS)
+            throw OSError(errno, std::generic_category(), "Failed to create memory file");
+    }
+    int fd = ::open(directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        throw OSError(errno, std::generic_category(), "Failed to create temporary file", directory);
+    return fd;
+}
+
+/** Opens the socketpair of a standard stream: the end of the parent first, then the one of the child. */
+std::pair<std::shared_ptr<Socket>, std::shared_ptr<Socket>> open_socketpair(const socketpair_t& socketpair) {
+    auto sockets = Socket::pair(socketpair.type);
+    if (socketpair.buffer_size > 0) {
+        sockets.first->set_buffer_size(socketpair.buffer_size);
+        sockets.second->set_buffer_size(socketpair.buffer_size);
+    }
+    return sockets;
+}
+
+/** Opens a pipe with close-on-exec set into `reader` and `writer`, whose ends are released by `deleter`. */
+template <typename Deleter>
+void make_pipe(std::shared_ptr<File>& reader, std::shared_ptr<File>& writer, Deleter deleter) {
+    int pipe_fd[2];
+    if (::pipe2(pipe_fd, O_CLOEXEC) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to open pipe");
+    reader = { new File(pipe_fd[0]), deleter };
+    writer = { new File(pipe_fd[1]), deleter };
+}
+
+/** Appends `stage` to the TransformChain of an output stream (std_out_t or std_err_t), wrapping 
+ *  its destination in one first, and feeds it through a pipe. */
+template <typename Stream, typename Deleter>
+void add_transform(Stream& stream, std::shared_ptr<Transform> stage, Deleter deleter) {
+    if (stream.is_capture)
+        throw std::invalid_argument("Captured output cannot be transformed.");
+    if (!stream.destination)
+        throw std::invalid_argument("Transformed output needs a destination.");
+    auto chain = std::dynamic_pointer_cast<TransformChain>(stream.destination);
+    if (!chain) {
+        chain              = std::make_shared<TransformChain>(stream.destination);
+        stream.destination = chain;
+    }
+    chain->add(std::move(stage));
+    if (!stream.pipe_reader)
+        make_pipe(stream.pipe_reader, stream.pipe_writer, deleter);
+}
+
+} // namespace
+
 /* ===================================== bufsize ===================================== */
-bufsize_t::bufsize_t(ssize_t bufsize) : bufsize(bufsize) {}
+bufsize_t::bufsize_t(ssize_t bufsize, ssize_t pipe_size) : bufsize(bufsize), pipe_size(pipe_size) {}
+
+/* ===================================== socketpair ===================================== */
+socketpair_t::socketpair_t(int type, int buffer_size) : type(type), buffer_size(buffer_size) {
+    if (type != SOCK_STREAM && type != SOCK_SEQPACKET)
+        throw std::invalid_argument("Socketpair type must be SOCK_STREAM or SOCK_SEQPACKET.");
+    if (buffer_size < 0)
+        throw std::invalid_argument("Socket buffer size must not be negative.");
+}
 
 /* ===================================== std_in ===================================== */
-std_in_t::std_in_t(int fd)          : pipe_reader(nullptr), pipe_writer(nullptr), source(new File(fd)) {}
-std_in_t::std_in_t(FILE* fp)        : pipe_reader(nullptr), pipe_writer(nullptr), source(new File(fp)) {}
-std_in_t::std_in_t(IOOption option) : pipe_reader(nullptr), pipe_writer(nullptr), source(nullptr) {
+std_in_t::std_in_t(int fd)          : pipe_reader(nullptr), pipe_writer(nullptr), source(new File(fd)), non_blocking(false) {}
+std_in_t::std_in_t(FILE* fp)        : pipe_reader(nullptr), pipe_writer(nullptr), source(new File(fp)), non_blocking(false) {}
+std_in_t::std_in_t(IOOption option) : pipe_reader(nullptr), pipe_writer(nullptr), source(nullptr), non_blocking(false) {
     switch (option) {
         case IOOption::NONE: break;
         case IOOption::PIPE:
-            int pipe_fd[2];
-            if (::pipe(pipe_fd) == -1) 
-                throw OSError(errno, std::generic_category(), "Failed to open pipe");
-            pipe_reader = { new File(pipe_fd[0]), auto_close };
-            pipe_writer = { new File(pipe_fd[1]), auto_close };
+            make_pipe(pipe_reader, pipe_writer, auto_close);
+            break;
+        case IOOption::SOCKETPAIR:
+            *this = std_in_t(socketpair_t());
             break;
         default: throw std::invalid_argument("Invalid I/O option for standard input.");
     }
 }
-std_in_t::std_in_t(std::istream* stream) : pipe_reader(nullptr), pipe_writer(nullptr), source(new IStream(stream)) {
-    int pipe_fd[2];
-    if (::pipe(pipe_fd) == -1) 
-        throw OSError(errno, std::generic_category(), "Failed to open pipe");
-    pipe_reader = { new File(pipe_fd[0]), auto_close };
-    pipe_writer = { new File(pipe_fd[1]), auto_close };
+std_in_t::std_in_t(std::istream* stream) : pipe_reader(nullptr), pipe_writer(nullptr), source(new IStream(stream)), non_blocking(false) {
+    make_pipe(pipe_reader, pipe_writer, auto_close);
 }
-std_in_t::std_in_t(const std::filesystem::path& file) : pipe_reader(nullptr), pipe_writer(nullptr), source(nullptr) {
+std_in_t::std_in_t(const std::filesystem::path& file) : pipe_reader(nullptr), pipe_writer(nullptr), source(nullptr), non_blocking(false) {
     if (!std::filesystem::exists(file))
         throw std::invalid_argument("File does not exist: " + file.string());
 
@@ -45,18 +109,96 @@ std_in_t::std_in_t(const std::filesystem::path& file) : pipe_reader(nullptr), pi
     source = { new File(fp), auto_close };
 }
 
+std_in_t::std_in_t(const char* file) : std_in_t(std::filesystem::path(file)) {}
+std_in_t::std_in_t(const std::string& file) : std_in_t(std::filesystem::path(file)) {}
+std_in_t::std_in_t(const Bytes& data) : std_in_t(std::span<const char>(data.c_str(), data.size())) {}
+std_in_t::std_in_t(std::span<const char> data) : pipe_reader(nullptr), pipe_writer(nullptr), source(nullptr), non_blocking(false) {
+    int fd = open_anonymous_file(true, std::filesystem::temp_directory_path());
+    source = { new File(fd), auto_close };
+
+    size_t total_bytes = 0;
+    while (total_bytes < data.size()) {
+        ssize_t bytes_written = ::write(fd, data.data() + total_bytes, data.size() - total_bytes);
+        if (bytes_written == -1) {
+            if (errno == EINTR)
+                continue;
+            throw OSError(errno, std::generic_category(), "Failed to write input data");
+        }
+        total_bytes += bytes_written;
+    }
+    /** Fails with EINVAL for the O_TMPFILE fallback, which cannot be sealed. */
+    ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    /** The offset is shared with the child through dup2, which then reads from the start. */
+    if (::lseek(fd, 0, SEEK_SET) == -1)
+        throw OSError(errno, std::generic_category(), "Failed to rewind input data");
+}
+std_in_t::std_in_t(Generator::Producer producer) : pipe_reader(nullptr), pipe_writer(nullptr), source(nullptr), non_blocking(false) {
+    source = std::make_shared<Generator>(std::move(producer));
+    make_pipe(pipe_reader, pipe_writer, auto_close);
+}
+std_in_t::std_in_t(const socketpair_t& socketpair) : pipe_reader(nullptr), pipe_writer(nullptr), source(nullptr), non_blocking(false) {
+    auto [parent, child] = open_socketpair(socketpair);
+    /** Closing standard input must signal EOF to the child even if standard output shares the socket. */
+    parent->set_half_close(true);
+    pipe_reader = std::move(child);
+    pipe_writer = std::move(parent);
+}
+
+std_in_t& std_in_t::set_non_blocking(bool non_blocking) {
+    this->non_blocking = non_blocking;
+    return *this;
+}
+
+/* ===================================== capture ===================================== */
+capture_t::capture_t(std::size_t size_hint, std::size_t spill_threshold, const std::filesystem::path& directory) 
+    : size_hint(size_hint), spill_threshold(spill_threshold), directory(directory) {}
+
+int capture_t::open() const {
+    return open_anonymous_file(size_hint <= spill_threshold, directory);
+}
+
+/* ===================================== tail ===================================== */
+tail_t::tail_t(std::size_t max_bytes, std::size_t max_lines) : max_bytes(max_bytes), max_lines(max_lines) {}
+
+/* ===================================== tee ===================================== */
+tee_t::tee_t() : tee(std::make_shared<Tee>()) {}
+
+tee_t& tee_t::add(int fd, SinkPolicy policy, std::size_t limit) {
+    tee->add(std::make_shared<File>(fd), policy, limit);
+    return *this;
+}
+tee_t& tee_t::add(std::ostream* stream, SinkPolicy policy, std::size_t limit) {
+    tee->add(std::make_shared<OStream>(stream), policy, limit);
+    return *this;
+}
+tee_t& tee_t::add(const std::filesystem::path& file, SinkPolicy policy, std::size_t limit) {
+    int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd == -1)
+        throw OSError(errno, std::generic_category(), "Failed to open file", file);
+    std::shared_ptr<File> sink(new File(fd), [](File* stream) {
+        stream->close();
+        delete stream;
+    });
+    tee->add(std::move(sink), policy, limit);
+    return *this;
+}
+tee_t& tee_t::add(std::function<void(const Bytes&)> callback, SinkPolicy policy, std::size_t limit) {
+    tee->add(std::move(callback), policy, limit);
+    return *this;
+}
+tee_t& tee_t::add(std::shared_ptr<OStreamable> sink, SinkPolicy policy, std::size_t limit) {
+    tee->add(std::move(sink), policy, limit);
+    return *this;
+}
+
 /* ===================================== std_out ===================================== */
-std_out_t::std_out_t(int fd)          : pipe_reader(nullptr), pipe_writer(nullptr), destination(new File(fd)) {}
-std_out_t::std_out_t(FILE* fp)        : pipe_reader(nullptr), pipe_writer(nullptr), destination(new File(fp)) {}
-std_out_t::std_out_t(IOOption option) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr) {
+std_out_t::std_out_t(int fd)          : pipe_reader(nullptr), pipe_writer(nullptr), destination(new File(fd)), non_blocking(false), is_capture(false) {}
+std_out_t::std_out_t(FILE* fp)        : pipe_reader(nullptr), pipe_writer(nullptr), destination(new File(fp)), non_blocking(false), is_capture(false) {}
+std_out_t::std_out_t(IOOption option) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), non_blocking(false), is_capture(false) {
      switch (option) {
         case IOOption::NONE: { break; }
         case IOOption::PIPE: {
-            int pipe_fd[2];
-            if (::pipe(pipe_fd) == -1)
-                throw OSError(errno, std::generic_category(), "Failed to open pipe");
-            pipe_reader = { new File(pipe_fd[0]), auto_close };
-            pipe_writer = { new File(pipe_fd[1]), auto_close };
+            make_pipe(pipe_reader, pipe_writer, auto_close);
             break;
         }
         case IOOption::DEVNULL: {
@@ -66,17 +208,17 @@ std_out_t::std_out_t(IOOption option) : pipe_reader(nullptr), pipe_writer(nullpt
             destination = { new File(fd), auto_close };
             break;
         }
+        case IOOption::SOCKETPAIR: {
+            *this = std_out_t(socketpair_t());
+            break;
+        }
         default: { throw std::invalid_argument("Invalid I/O option for standard output."); }
     }
 }
-std_out_t::std_out_t(std::ostream* stream) : pipe_reader(nullptr), pipe_writer(nullptr), destination(new OStream(stream)) {
-    int pipe_fd[2];
-    if (::pipe(pipe_fd) == -1)
-        throw OSError(errno, std::generic_category(), "Failed to open pipe");
-    pipe_reader = { new File(pipe_fd[0]), auto_close };
-    pipe_writer = { new File(pipe_fd[1]), auto_close };
+std_out_t::std_out_t(std::ostream* stream) : pipe_reader(nullptr), pipe_writer(nullptr), destination(new OStream(stream)), non_blocking(false), is_capture(false) {
+    make_pipe(pipe_reader, pipe_writer, auto_close);
 }
-std_out_t::std_out_t(const std::filesystem::path& file) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr) {
+std_out_t::std_out_t(const std::filesystem::path& file) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), non_blocking(false), is_capture(false) {
     if (!std::filesystem::exists(file))
         throw std::invalid_argument("File does not exist: " + file.string());
 
@@ -87,18 +229,40 @@ std_out_t::std_out_t(const std::filesystem::path& file) : pipe_reader(nullptr),
     destination = { new File(fp), auto_close };
 }
 
+std_out_t& std_out_t::set_non_blocking(bool non_blocking) {
+    this->non_blocking = non_blocking;
+    return *this;
+}
+
+std_out_t& std_out_t::transform(std::shared_ptr<Transform> stage) {
+    add_transform(*this, std::move(stage), auto_close);
+    return *this;
+}
+
+std_out_t::std_out_t(const capture_t& capture) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), non_blocking(false), is_capture(true) {
+    destination = { new File(capture.open()), auto_close };
+}
+std_out_t::std_out_t(const tail_t& tail) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), non_blocking(false), is_capture(false) {
+    destination = std::make_shared<TailBuffer>(tail.max_bytes, tail.max_lines);
+    make_pipe(pipe_reader, pipe_writer, auto_close);
+}
+std_out_t::std_out_t(const tee_t& tee) : pipe_reader(nullptr), pipe_writer(nullptr), destination(tee.tee), non_blocking(false), is_capture(false) {
+    make_pipe(pipe_reader, pipe_writer, auto_close);
+}
+std_out_t::std_out_t(const socketpair_t& socketpair) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), non_blocking(false), is_capture(false) {
+    auto [parent, child] = open_socketpair(socketpair);
+    pipe_reader = std::move(parent);
+    pipe_writer = std::move(child);
+}
+
 /* ===================================== std_err ===================================== */
-std_err_t::std_err_t(int fd)          : pipe_reader(nullptr), pipe_writer(nullptr), destination(new File(fd)), is_std_out(false) {}
-std_err_t::std_err_t(FILE* fp)        : pipe_reader(nullptr), pipe_writer(nullptr), destination(new File(fp)), is_std_out(false) {}
-std_err_t::std_err_t(IOOption option) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), is_std_out(false) {
+std_err_t::std_err_t(int fd)          : pipe_reader(nullptr), pipe_writer(nullptr), destination(new File(fd)), is_std_out(false), non_blocking(false), is_capture(false) {}
+std_err_t::std_err_t(FILE* fp)        : pipe_reader(nullptr), pipe_writer(nullptr), destination(new File(fp)), is_std_out(false), non_blocking(false), is_capture(false) {}
+std_err_t::std_err_t(IOOption option) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), is_std_out(false), non_blocking(false), is_capture(false) {
      switch (option) {
         case IOOption::NONE: { break; }
         case IOOption::PIPE: {
-            int pipe_fd[2];
-            if (::pipe(pipe_fd) == -1)
-                throw OSError(errno, std::generic_category(), "Failed to open pipe");
-            pipe_reader = { new File(pipe_fd[0]), auto_close };
-            pipe_writer = { new File(pipe_fd[1]), auto_close };
+            make_pipe(pipe_reader, pipe_writer, auto_close);
             break;
         }
         case IOOption::STDOUT: {
@@ -115,8 +279,8 @@ std_err_t::std_err_t(IOOption option) : pipe_reader(nullptr), pipe_writer(nullpt
         default: { throw std::invalid_argument("Invalid I/O option for standard error."); }
     }
 }
-std_err_t::std_err_t(std::ostream* stream) : pipe_reader(nullptr), pipe_writer(nullptr), destination(new OStream(stream)), is_std_out(false) {}
-std_err_t::std_err_t(const std::filesystem::path& file) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), is_std_out(false) {
+std_err_t::std_err_t(std::ostream* stream) : pipe_reader(nullptr), pipe_writer(nullptr), destination(new OStream(stream)), is_std_out(false), non_blocking(false), is_capture(false) {}
+std_err_t::std_err_t(const std::filesystem::path& file) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), is_std_out(false), non_blocking(false), is_capture(false) {
     if (!std::filesystem::exists(file))
         throw std::invalid_argument("File does not exist: " + file.string());
 
@@ -127,9 +291,126 @@ std_err_t::std_err_t(const std::filesystem::path& file) : pipe_reader(nullptr),
     destination = { new File(fp), auto_close };
 }
 
+std_err_t& std_err_t::set_non_blocking(bool non_blocking) {
+    this->non_blocking = non_blocking;
+    return *this;
+}
+
+std_err_t& std_err_t::transform(std::shared_ptr<Transform> stage) {
+    add_transform(*this, std::move(stage), auto_close);
+    return *this;
+}
+
+std_err_t::std_err_t(const capture_t& capture) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), is_std_out(false), non_blocking(false), is_capture(true) {
+    destination = { new File(capture.open()), auto_close };
+}
+std_err_t::std_err_t(const tail_t& tail) : pipe_reader(nullptr), pipe_writer(nullptr), destination(nullptr), is_std_out(false), non_blocking(false), is_capture(false) {
+    destination = std::make_shared<TailBuffer>(tail.max_bytes, tail.max_lines);
+    make_pipe(pipe_reader, pipe_writer, auto_close);
+}
+std_err_t::std_err_t(const tee_t& tee) : pipe_reader(nullptr), pipe_writer(nullptr), destination(tee.tee), is_std_out(false), non_blocking(false), is_capture(false) {
+    make_pipe(pipe_reader, pipe_writer, auto_close);
+}
+
+/* ===================================== rlimit ===================================== */
+rlimit_t::rlimit_t(std::initializer_list<std::pair<int, ::rlim_t>> limits) {
+    for (auto [resource, limit] : limits)
+        set(resource, limit);
+}
+
+rlimit_t& rlimit_t::set(int resource, ::rlim_t limit) { return set(resource, limit, limit); }
+rlimit_t& rlimit_t::set(int resource, ::rlim_t soft, ::rlim_t hard) {
+    limits.emplace_back(resource, ::rlimit{soft, hard});
+    return *this;
+}
+
+/* ===================================== sched ===================================== */
+sched_t& sched_t::set_affinity(const std::vector<int>& cpus) {
+    ::cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+            throw std::invalid_argument("Invalid CPU index: " + std::to_string(cpu));
+        CPU_SET(cpu, &set);
+    }
+    affinity = set;
+    return *this;
+}
+sched_t& sched_t::set_policy(int policy) {
+    this->policy = policy;
+    return *this;
+}
+sched_t& sched_t::set_nice(int nice) {
+    this->nice = nice;
+    return *this;
+}
+sched_t& sched_t::set_ioprio(IOPrioClass ioprio_class, int level) {
+    if (level < 0 || level > 7)
+        throw std::invalid_argument("Invalid I/O priority level: " + std::to_string(level));
+    ioprio = (static_cast<int>(ioprio_class) << 13) | level;
+    return *this;
+}
+
+round_robin_t::round_robin_t(std::vector<int> cpus) : cpus_(std::move(cpus)), next_(0) {
+    if (cpus_.empty())
+        throw std::invalid_argument("Empty CPU set.");
+}
+
+sched_t round_robin_t::next(sched_t base) {
+    return base.set_affinity({ cpus_[next_.fetch_add(1, std::memory_order_relaxed) % cpus_.size()] });
+}
+
+/* ===================================== pass_fds ===================================== */
+pass_fds_t::pass_fds_t(std::initializer_list<std::pair<int, int>> mappings) {
+    for (auto [fd, target] : mappings)
+        add(fd, target);
+}
+
+pass_fds_t& pass_fds_t::add(int fd, int target) {
+    if (fd < 0)
+        throw std::invalid_argument("Passed file descriptor must not be negative.");
+    if (target <= STDERR_FILENO)
+        throw std::invalid_argument("Standard streams are set with std_in_t, std_out_t and std_err_t.");
+    for (auto& mapping : mappings) {
+        if (mapping.second == target)
+            throw std::invalid_argument("File descriptor " + std::to_string(target) + " is already mapped.");
+    }
+    mappings.emplace_back(fd, target);
+    return *this;
+}
+
+std::shared_ptr<File> pass_fds_t::pipe_from_child(int target) { return open_pipe(target, false); }
+std::shared_ptr<File> pass_fds_t::pipe_to_child(int target)   { return open_pipe(target, true);  }
+
+pass_fds_t& pass_fds_t::set_close_others(bool close_others) {
+    this->close_others = close_others;
+    return *this;
+}
+
+std::shared_ptr<File> pass_fds_t::open_pipe(int target, bool child_reads) {
+    std::shared_ptr<File> reader, writer;
+    make_pipe(reader, writer, auto_close);
+    auto& child_end = child_reads ? reader : writer;
+    add(child_end->fileno(), target);
+    child_ends.push_back(child_end);
+    return child_reads ? writer : reader;
+}
+
 /* ===================================== preexec_fn ===================================== */
 preexec_fn_t::preexec_fn_t(std::function<void()> preexec_fn) : preexec_fn(preexec_fn) {}
 
+/* ===================================== run ===================================== */
+input_t::input_t(const Bytes& data)       : data(data) {}
+input_t::input_t(Bytes&& data)            : data(std::move(data)) {}
+input_t::input_t(const std::string& data) : data(Bytes(data.begin(), data.end())) {}
+
+capture_output_t::capture_output_t(bool capture_output, Bytes::size_type size_hint) 
+    : capture_output(capture_output), size_hint(size_hint) {}
+
+check_t::check_t(bool check) : check(check) {}
+
+timeout_t::timeout_t(double timeout) : timeout(timeout) {}
+
 } // namespace types
 
 } // namespace subprocess
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "subprocess/async.h"
+#include "subprocess/popen.h"
+
+class AsyncTest : public ::testing::Test {
+protected:
+    std::string generate_input(size_t size) {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<int> dis(0, 25);
+
+        std::string input(size, '\0');
+        for (int i = 0; i < size; ++i) {
+            input[i] = dis(gen) + 'a';
+        }
+        return input;
+    }
+
+    subprocess::EventLoop loop;
+};
+
+TEST_F(AsyncTest, AsyncWaitTest) {
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--return", "7", "--delay", "100", "--io", "disable")
+    ));
+
+    auto returncode = loop.run_until_complete(p.async_wait());
+
+    ASSERT_TRUE(returncode.has_value());
+    ASSERT_EQ(returncode.value(), 7);
+}
+
+TEST_F(AsyncTest, AsyncReadTest) {
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+    ));
+
+    std::string s = "Hello World!";
+    auto std_in  = p.std_in().value();
+    auto std_out = p.std_out().value();
+    auto read = [](std::shared_ptr<subprocess::OStreamable> std_in,
+                   std::shared_ptr<subprocess::IStreamable> std_out,
+                   subprocess::Bytes input) -> subprocess::Task<subprocess::Bytes> {
+        co_await std_in->async_write(input, input.size());
+        std_in->close();
+        co_return co_await std_out->async_read(5);
+    };
+    auto output = loop.run_until_complete(read(std_in, std_out, subprocess::Bytes(s.begin(), s.end())));
+
+    ASSERT_EQ(output.size(), 5);
+    for (int i = 0; i < output.size(); ++i) {
+        EXPECT_EQ(s[i], output[i]) << i << "th element";
+    }
+    p.wait();
+}
+
+TEST_F(AsyncTest, AsyncCommunicateTest) {
+    /** Larger than the default pipe capacity, so that input and output must be interleaved. */
+    std::string s = generate_input(1 << 20);
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_err_t(subprocess::types::IOOption::PIPE)
+    ));
+
+    auto [std_out_data, std_err_data] = loop.run_until_complete(p.async_communicate(subprocess::Bytes(s.begin(), s.end())));
+
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    ASSERT_TRUE(std_out_data.has_value());
+    ASSERT_TRUE(std_err_data.has_value());
+    ASSERT_EQ(s.size(), std_out_data.value().size());
+    EXPECT_EQ(std_err_data.value().size(), 0);
+    for (int i = 0; i < s.size(); ++i) {
+        ASSERT_EQ(s[i], std_out_data.value()[i]) << i << "th element";
+    }
+}
+
+TEST_F(AsyncTest, ManyProcessesTest) {
+    constexpr int n = 64;
+    std::vector<std::unique_ptr<subprocess::Popen>> processes;
+    std::vector<int> returncodes(n, -1);
+    for (int i = 0; i < n; ++i) {
+        processes.emplace_back(std::make_unique<subprocess::Popen>(subprocess::PopenConfig(
+            subprocess::types::args_t("test/helpers/process", "--return", std::to_string(i % 256), "--delay", "50"),
+            subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+            subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+        )));
+        loop.spawn([](subprocess::Popen& p, int& returncode) -> subprocess::Task<> {
+            co_await p.async_communicate();
+            returncode = p.returncode().value();
+        }(*processes.back(), returncodes[i]));
+    }
+
+    loop.run();
+
+    for (int i = 0; i < n; ++i) {
+        EXPECT_EQ(returncodes[i], i % 256) << i << "th process";
+    }
+}
+
+TEST_F(AsyncTest, ExecutorTest) {
+    int resumed = 0;
+    loop.set_executor([&resumed](std::coroutine_handle<> handle) {
+        ++resumed;
+        handle.resume();
+    });
+
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--delay", "50", "--io", "disable")
+    ));
+    auto returncode = loop.run_until_complete(p.async_wait());
+
+    ASSERT_EQ(returncode.value(), EXIT_SUCCESS);
+    EXPECT_GE(resumed, 1);
+}
@@ -0,0 +1,64 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "subprocess/command.h"
+#include "subprocess/exception.h"
+
+namespace {
+
+std::string to_string(const subprocess::Bytes& bytes) {
+    return std::string(bytes.data(), bytes.size());
+}
+
+} // namespace
+
+TEST(CommandTemplateTest, SpawnTest) {
+    subprocess::CommandTemplate echo(subprocess::PopenConfig(
+        subprocess::types::args_t("echo", "-n", "{1}", "-", "{0}"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+    ));
+    EXPECT_EQ(echo.placeholders(), 2);
+    EXPECT_EQ(echo.executable().front(), '/');
+
+    for (int i = 0; i < 8; ++i) {
+        subprocess::Popen p = echo.spawn({std::to_string(i), "value"});
+        auto [std_out_data, std_err_data] = p.communicate(subprocess::Bytes());
+        EXPECT_EQ(p.returncode().value(), 0);
+        EXPECT_EQ(to_string(std_out_data.value()), "value - " + std::to_string(i));
+        EXPECT_FALSE(std_err_data.has_value());
+        EXPECT_EQ(p.args(), (std::vector<std::string>{"echo", "-n", "value", "-", std::to_string(i)}));
+    }
+}
+
+TEST(CommandTemplateTest, SharedDescriptorTest) {
+    subprocess::CommandTemplate process(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--return", "{0}", "--io", "disable"),
+        subprocess::types::std_out_t(subprocess::types::IOOption::DEVNULL),
+        subprocess::types::std_err_t(subprocess::types::IOOption::STDOUT)
+    ));
+    EXPECT_EQ(process.executable(), "test/helpers/process");
+    for (int i = 0; i < 4; ++i) {
+        subprocess::Popen p = process.spawn({std::to_string(i)});
+        EXPECT_FALSE(p.std_out().has_value());
+        EXPECT_EQ(p.wait().value(), i);
+    }
+}
+
+TEST(CommandTemplateTest, InvalidTest) {
+    subprocess::CommandTemplate echo(subprocess::PopenConfig(subprocess::types::args_t("echo", "{0}")));
+    EXPECT_THROW(echo.spawn(), std::invalid_argument);
+    EXPECT_THROW(echo.spawn({"a", "b"}), std::invalid_argument);
+    EXPECT_THROW(subprocess::CommandTemplate(subprocess::PopenConfig(subprocess::types::args_t("echo", "{2}"))), std::invalid_argument);
+    EXPECT_THROW(subprocess::CommandTemplate(subprocess::PopenConfig(subprocess::types::args_t("echo", "{99999999999999999999999}"))), std::invalid_argument);
+
+    EXPECT_THROW(subprocess::CommandTemplate(subprocess::PopenConfig(subprocess::types::args_t("no-such-program-xyz"))), subprocess::OSError);
+    EXPECT_THROW(subprocess::CommandTemplate(subprocess::PopenConfig(subprocess::types::args_t("./no/such/program"))), subprocess::OSError);
+    EXPECT_THROW(subprocess::CommandTemplate(subprocess::PopenConfig(subprocess::types::std_in_t(subprocess::types::IOOption::PIPE))), std::invalid_argument);
+    EXPECT_THROW(subprocess::CommandTemplate(subprocess::PopenConfig(
+        subprocess::types::args_t("echo"),
+        subprocess::types::std_out_t(subprocess::types::capture_t())
+    )), std::invalid_argument);
+}
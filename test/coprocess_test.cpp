@@ -0,0 +1,97 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "subprocess/coprocess.h"
+
+namespace {
+
+subprocess::Bytes to_bytes(const std::string& s) {
+    return subprocess::Bytes(s.begin(), s.end());
+}
+
+std::string to_string(const subprocess::Bytes& bytes) {
+    return std::string(bytes.data(), bytes.size());
+}
+
+} // namespace
+
+TEST(CoprocessTest, LengthPrefixedTest) {
+    /** cat answers every frame with itself. */
+    subprocess::Coprocess cat(subprocess::PopenConfig(subprocess::types::args_t("/bin/cat")));
+
+    EXPECT_EQ(to_string(cat.request(to_bytes("Hello World!"))), "Hello World!");
+    EXPECT_EQ(cat.request(subprocess::Bytes()).size(), 0);
+    std::string binary("a\0b\nc", 5);
+    EXPECT_EQ(to_string(cat.request(to_bytes(binary))), binary);
+    EXPECT_EQ(cat.close().value(), 0);
+    EXPECT_THROW(cat.send(to_bytes("closed")), std::runtime_error);
+}
+
+TEST(CoprocessTest, PipeliningTest) {
+    subprocess::Coprocess cat(subprocess::PopenConfig(subprocess::types::args_t("/bin/cat")), subprocess::Framing::NEWLINE, 4);
+
+    std::vector<std::future<subprocess::Bytes>> responses;
+    for (int i = 0; i < 1000; ++i) {
+        responses.push_back(cat.send(to_bytes("request " + std::to_string(i))));
+        EXPECT_LE(cat.in_flight(), 4);
+    }
+    for (int i = 0; i < 1000; ++i)
+        EXPECT_EQ(to_string(responses[i].get()), "request " + std::to_string(i));
+    EXPECT_THROW(cat.send(to_bytes("two\nlines")), std::invalid_argument);
+}
+
+TEST(CoprocessTest, ConcurrentSendersTest) {
+    subprocess::Coprocess cat(subprocess::PopenConfig(subprocess::types::args_t("/bin/cat")));
+
+    std::vector<std::thread> senders;
+    for (int t = 0; t < 4; ++t) {
+        senders.emplace_back([&cat, t] {
+            for (int i = 0; i < 100; ++i) {
+                std::string message = std::to_string(t) + ":" + std::string(i * 100, 'x');
+                EXPECT_EQ(to_string(cat.request(to_bytes(message))), message);
+            }
+        });
+    }
+    for (auto& sender : senders)
+        sender.join();
+}
+
+TEST(CoprocessTest, ExitTest) {
+    /** Exits without reading its stdin nor answering. */
+    subprocess::Coprocess worker(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--io", "disable", "--return", "3")
+    ));
+    ASSERT_EQ(worker.popen().wait(), 3);
+    EXPECT_THROW(worker.request(to_bytes("nobody listens")), std::runtime_error);
+    EXPECT_EQ(worker.close().value(), 3);
+}
+
+TEST(CoprocessTest, DestructorTimeoutTest) {
+    /** Ignores the EOF on its stdin: the destructor gives up waiting and kills it. */
+    auto start_time = std::chrono::steady_clock::now();
+    {
+        subprocess::Coprocess worker(subprocess::PopenConfig(
+            subprocess::types::args_t("test/helpers/process", "--io", "disable", "--delay", "60000")
+        ));
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    EXPECT_GE(elapsed, std::chrono::seconds(5));
+    EXPECT_LT(elapsed, std::chrono::seconds(30));
+}
+
+TEST(CoprocessTest, SocketpairTest) {
+    subprocess::Coprocess cat(
+        subprocess::PopenConfig(
+            subprocess::types::args_t("/bin/cat"),
+            subprocess::types::std_in_t(subprocess::types::IOOption::SOCKETPAIR)
+        ),
+        subprocess::Framing::NEWLINE
+    );
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ(to_string(cat.request(to_bytes("request " + std::to_string(i)))), "request " + std::to_string(i));
+    EXPECT_EQ(cat.close().value(), 0);
+}
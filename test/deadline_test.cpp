@@ -0,0 +1,104 @@
+#include <chrono>
+#include <csignal>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "subprocess/deadline.h"
+#include "subprocess/popen.h"
+
+namespace {
+
+std::unique_ptr<subprocess::Popen> sleeper(int delay_ms) {
+    return std::make_unique<subprocess::Popen>(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--delay", std::to_string(delay_ms), "--io", "disable")
+    ));
+}
+
+/** Ignores SIGTERM, so that only SIGKILL stops it. */
+std::unique_ptr<subprocess::Popen> stubborn_sleeper(int delay_ms) {
+    return std::make_unique<subprocess::Popen>(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--delay", std::to_string(delay_ms), "--io", "disable"),
+        subprocess::types::preexec_fn_t([] { ::signal(SIGTERM, SIG_IGN); })
+    ));
+}
+
+} // namespace
+
+TEST(DeadlineManagerTest, TerminateTest) {
+    subprocess::DeadlineManager deadlines(std::chrono::milliseconds(5));
+    auto p = sleeper(10000);
+    auto start_time = std::chrono::steady_clock::now();
+    auto id = deadlines.add(*p, std::chrono::milliseconds(100));
+
+    EXPECT_EQ(p->wait(), -SIGTERM);
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(100));
+    EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+
+    auto escalations = deadlines.take_escalations();
+    ASSERT_EQ(escalations.size(), 1);
+    EXPECT_EQ(escalations[0].id, id);
+    EXPECT_EQ(escalations[0].pid, p->pid());
+    EXPECT_EQ(escalations[0].signal, SIGTERM);
+    EXPECT_TRUE(deadlines.take_escalations().empty());
+}
+
+TEST(DeadlineManagerTest, KillTest) {
+    subprocess::DeadlineManager deadlines(std::chrono::milliseconds(5));
+    auto p = stubborn_sleeper(10000);
+    deadlines.add(p->pid(), std::chrono::milliseconds(50), std::chrono::milliseconds(50));
+
+    EXPECT_EQ(p->wait(), -SIGKILL);
+    auto escalations = deadlines.take_escalations();
+    ASSERT_EQ(escalations.size(), 2);
+    EXPECT_EQ(escalations[0].signal, SIGTERM);
+    EXPECT_EQ(escalations[1].signal, SIGKILL);
+    /** Both signals are sent on ticks of the same periodic timer, up to the wake-up latency of its thread. */
+    EXPECT_GE(escalations[1].time - escalations[0].time, std::chrono::milliseconds(45));
+    EXPECT_EQ(deadlines.size(), 0);
+}
+
+TEST(DeadlineManagerTest, CancelTest) {
+    subprocess::DeadlineManager deadlines(std::chrono::milliseconds(5));
+    auto p  = sleeper(200);
+    auto id = deadlines.add(*p, std::chrono::milliseconds(50));
+    EXPECT_TRUE(deadlines.cancel(id));
+    EXPECT_FALSE(deadlines.cancel(id));
+
+    EXPECT_EQ(p->wait(), 0);
+    EXPECT_TRUE(deadlines.take_escalations().empty());
+}
+
+TEST(DeadlineManagerTest, ExitedTest) {
+    subprocess::DeadlineManager deadlines(std::chrono::milliseconds(5));
+    auto p = sleeper(0);
+    p->wait();
+    /** The deadline of a reaped child expires without signaling anything. */
+    auto id = deadlines.add(*p, std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(deadlines.size(), 0);
+    EXPECT_FALSE(deadlines.cancel(id));
+    EXPECT_TRUE(deadlines.take_escalations().empty());
+}
+
+TEST(DeadlineManagerTest, ManyProcessesTest) {
+    /** Deadlines spanning more ticks than the wheel has slots. */
+    subprocess::DeadlineManager deadlines(std::chrono::milliseconds(1), 16);
+    std::vector<std::unique_ptr<subprocess::Popen>> processes;
+    for (int i = 0; i < 64; ++i)
+        processes.push_back(sleeper(i % 2 ? 10000 : 0));
+    /** The short ones are reaped before their deadline is added, so that their exit cannot race it. */
+    for (int i = 0; i < 64; i += 2)
+        EXPECT_EQ(processes[i]->wait(), 0) << i << "th process";
+    for (int i = 0; i < 64; ++i)
+        deadlines.add(*processes[i], std::chrono::milliseconds(20 + i));
+    for (int i = 1; i < 64; i += 2)
+        EXPECT_EQ(processes[i]->wait(), -SIGTERM) << i << "th process";
+    EXPECT_EQ(deadlines.take_escalations().size(), 32);
+    /** The terminated ones keep their deadline until the end of their grace period. */
+    EXPECT_EQ(deadlines.size(), 32);
+}
@@ -0,0 +1,114 @@
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "subprocess/exception.h"
+#include "subprocess/pool.h"
+
+namespace {
+
+subprocess::PopenConfig sleeper(int delay_ms, int returncode = 0) {
+    return subprocess::PopenConfig(subprocess::types::args_t(
+        "test/helpers/process", "--delay", std::to_string(delay_ms), "--return", std::to_string(returncode), "--io", "disable"
+    ));
+}
+
+} // namespace
+
+TEST(ProcessPoolTest, CompletedProcessTest) {
+    subprocess::ProcessPool pool(4);
+    std::vector<subprocess::ProcessPool::Job> jobs;
+    for (int i = 0; i < 16; ++i) {
+        jobs.push_back(pool.submit(
+            subprocess::PopenConfig(
+                subprocess::types::args_t("test/helpers/process"),
+                subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+                subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+            ),
+            subprocess::Bytes(i + 1, 'a' + i)
+        ));
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        auto result = jobs[i].result.get();
+        EXPECT_EQ(result.returncode, EXIT_SUCCESS);
+        EXPECT_EQ(result.args.front(), "test/helpers/process");
+        ASSERT_TRUE(result.std_out.has_value());
+        EXPECT_EQ(std::string(result.std_out->data(), result.std_out->size()), std::string(i + 1, 'a' + i));
+        EXPECT_FALSE(result.std_err.has_value());
+        EXPECT_TRUE(result.usage.has_value());
+    }
+}
+
+TEST(ProcessPoolTest, BoundedConcurrencyTest) {
+    subprocess::ProcessPool pool(2);
+    std::vector<subprocess::ProcessPool::Job> jobs;
+    auto start_time = std::chrono::steady_clock::now();
+    for (int i = 0; i < 6; ++i)
+        jobs.push_back(pool.submit(sleeper(100, i)));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(pool.running(), 2);
+    EXPECT_EQ(pool.queued(), 4);
+
+    for (int i = 0; i < 6; ++i)
+        EXPECT_EQ(jobs[i].result.get().returncode, i);
+    /** Three waves of two jobs. */
+    EXPECT_GE(std::chrono::steady_clock::now() - start_time, std::chrono::milliseconds(300));
+    EXPECT_EQ(pool.running(), 0);
+}
+
+TEST(ProcessPoolTest, PriorityTest) {
+    subprocess::ProcessPool pool(1);
+    auto blocker = pool.submit(sleeper(100));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    std::vector<subprocess::ProcessPool::Job> jobs;
+    for (int priority = 0; priority < 3; ++priority)
+        jobs.push_back(pool.submit(sleeper(100, priority), subprocess::Bytes(), priority));
+
+    blocker.result.get();
+    /** One job at a time: the highest priority job runs first, the lowest one last. */
+    EXPECT_EQ(jobs[2].result.get().returncode, 2);
+    EXPECT_EQ(jobs[0].result.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+    EXPECT_EQ(jobs[1].result.get().returncode, 1);
+    EXPECT_EQ(jobs[0].result.get().returncode, 0);
+}
+
+TEST(ProcessPoolTest, CancelTest) {
+    subprocess::ProcessPool pool(1);
+    auto running = pool.submit(sleeper(10000));
+    auto queued  = pool.submit(sleeper(0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_TRUE(pool.cancel(queued.id));
+    EXPECT_THROW(queued.result.get(), subprocess::CancelledError);
+
+    EXPECT_TRUE(pool.cancel(running.id, SIGKILL));
+    EXPECT_EQ(running.result.get().returncode, -SIGKILL);
+    EXPECT_FALSE(pool.cancel(running.id));
+}
+
+TEST(ProcessPoolTest, ShutdownTest) {
+    subprocess::ProcessPool pool(1);
+    auto running = pool.submit(sleeper(100));
+    auto queued  = pool.submit(sleeper(0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    pool.shutdown(true);
+    EXPECT_EQ(running.result.get().returncode, 0);
+    EXPECT_THROW(queued.result.get(), subprocess::CancelledError);
+    EXPECT_THROW(pool.submit(sleeper(0)), std::runtime_error);
+}
+
+TEST(ProcessPoolTest, SpawnErrorTest) {
+    subprocess::ProcessPool pool(2);
+    auto job = pool.submit(subprocess::PopenConfig(subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)));
+    EXPECT_THROW(job.result.get(), std::invalid_argument);
+    /** The pool keeps running jobs after a failed one. */
+    EXPECT_EQ(pool.submit(sleeper(0, 3)).result.get().returncode, 3);
+}
@@ -1,9 +1,18 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
+#include "subprocess/exception.h"
+#include "subprocess/io_uring.h"
 #include "subprocess/popen.h"
 
 class PopenTest : public ::testing::Test {
@@ -161,4 +170,574 @@ TEST_F(PopenTest, fstreamTest) {
     for (int i = 0; i < std::min(input.size(), output.size()); ++i) {
         EXPECT_EQ(input[i], output[i]) << i << "th element";
     }
-}
\ No newline at end of file
+}
+TEST_F(PopenTest, IoUringPipeTest) {
+    if (!subprocess::IoUring::is_supported())
+        GTEST_SKIP() << "io_uring is not supported by the kernel.";
+    subprocess::set_io_backend(subprocess::IOBackend::IO_URING);
+
+    /** Larger than the pipe capacity: only a multiplexed exchange completes without deadlock. */
+    generate_input(1 << 20);
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_err_t(subprocess::types::IOOption::PIPE)
+    ));
+
+    subprocess::Bytes input_bytes(input.begin(), input.end());
+    auto [std_out_data, std_err_data] = p.communicate(input_bytes, 10);
+    subprocess::set_io_backend(subprocess::IOBackend::BLOCKING);
+
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    ASSERT_TRUE(std_out_data.has_value());
+    ASSERT_TRUE(std_err_data.has_value());
+    ASSERT_EQ(input.size(), std_out_data.value().size());
+    for (int i = 0; i < input.size(); ++i) {
+        ASSERT_EQ(input[i], std_out_data.value()[i]) << i << "th element";
+    }
+}
+
+TEST_F(PopenTest, IoUringTimeoutTest) {
+    if (!subprocess::IoUring::is_supported())
+        GTEST_SKIP() << "io_uring is not supported by the kernel.";
+    subprocess::set_io_backend(subprocess::IOBackend::IO_URING);
+
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--delay", "10000"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+    ));
+
+    subprocess::Bytes input_bytes(input.begin(), input.end());
+    EXPECT_THROW(p.communicate(input_bytes, 0.1), subprocess::TimeoutExpired);
+    subprocess::set_io_backend(subprocess::IOBackend::BLOCKING);
+
+    p.kill();
+    p.wait();
+    ASSERT_EQ(p.returncode().value(), -SIGKILL);
+}
+
+TEST_F(PopenTest, NonBlockingReadTest) {
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--delay", "10000", "--io", "disable"),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE).set_non_blocking()
+    ));
+
+    auto std_out = p.std_out().value();
+    EXPECT_FALSE(std_out->read_some(16).has_value());
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto data       = std_out->read(16, start_time + std::chrono::milliseconds(100));
+    EXPECT_EQ(data.size(), 0);
+    EXPECT_GE(std::chrono::steady_clock::now() - start_time, std::chrono::milliseconds(100));
+
+    p.kill();
+    p.wait();
+    ASSERT_EQ(p.returncode().value(), -SIGKILL);
+}
+
+TEST_F(PopenTest, ReadSomeTest) {
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+    ));
+
+    auto std_in  = p.std_in().value();
+    auto std_out = p.std_out().value();
+    std_in->write(subprocess::Bytes(input.begin(), input.end()), input.size());
+    std_in->close();
+
+    /** Returns what is available instead of filling the whole buffer. */
+    std::string output;
+    while (auto data = std_out->read_some(1 << 16)) {
+        if (data->empty())
+            break;
+        output.append(data->c_str(), data->size());
+    }
+    p.wait();
+
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    ASSERT_EQ(input.size(), output.size());
+    for (int i = 0; i < input.size(); ++i) {
+        EXPECT_EQ(input[i], output[i]) << i << "th element";
+    }
+}
+
+TEST_F(PopenTest, MixedReadTest) {
+    /** The stdout pipe stays unbuffered, so stdio never reads ahead of read_some(). */
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/echo", "Hello World!"),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+    ));
+
+    p.wait();
+    auto std_out = std::dynamic_pointer_cast<subprocess::File>(p.std_out().value());
+    ASSERT_TRUE(std_out);
+    auto first   = std_out->read(5);
+    EXPECT_EQ(std::string(first.data(), first.size()), "Hello");
+    EXPECT_TRUE(std_out->read_buffered().empty());
+    std::string rest;
+    while (auto data = std_out->read_some(64)) {
+        if (data->empty())
+            break;
+        rest.append(data->data(), data->size());
+    }
+    EXPECT_EQ(rest, " World!\n");
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+}
+
+TEST_F(PopenTest, PipeSizeTest) {
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::bufsize_t(-1, 1 << 18)
+    ));
+
+    auto sizes = p.pipe_sizes();
+    ASSERT_TRUE(sizes[0].has_value());
+    ASSERT_TRUE(sizes[1].has_value());
+    EXPECT_FALSE(sizes[2].has_value());
+    EXPECT_EQ(sizes[0].value(), std::min(1 << 18, subprocess::File::max_pipe_size()));
+    EXPECT_EQ(sizes[1].value(), std::min(1 << 18, subprocess::File::max_pipe_size()));
+
+    p.communicate(subprocess::Bytes(input.begin(), input.end()));
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+}
+
+TEST_F(PopenTest, AdaptivePipeSizeTest) {
+    generate_input(1 << 20);
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::bufsize_t(-1, subprocess::types::bufsize_t::ADAPTIVE)
+    ));
+    int initial_size = p.pipe_sizes()[1].value();
+
+    auto std_in = p.std_in().value();
+    std::thread writer([&] {
+        std_in->write(subprocess::Bytes(input.begin(), input.end()), input.size());
+        std_in->close();
+    });
+
+    /** A slow reader keeps finding the pipe full, so that it is grown. */
+    auto std_out = p.std_out().value();
+    size_t total_bytes = 0;
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        auto data = std_out->read(1 << 16);
+        if (data.empty())
+            break;
+        total_bytes += data.size();
+    }
+    writer.join();
+    p.wait();
+
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    EXPECT_EQ(total_bytes, input.size());
+    if (initial_size < subprocess::File::max_pipe_size()) {
+        EXPECT_GT(p.pipe_sizes()[1].value(), initial_size);
+    }
+}
+
+TEST_F(PopenTest, CaptureTest) {
+    generate_input(1 << 20);
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_in_t(src),
+        subprocess::types::std_out_t(subprocess::types::capture_t())
+    ));
+
+    auto std_out_data = p.captured_std_out();
+
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    ASSERT_TRUE(std_out_data.has_value());
+    EXPECT_FALSE(p.captured_std_err().has_value());
+    ASSERT_EQ(input.size(), std_out_data->size());
+    for (int i = 0; i < input.size(); ++i) {
+        ASSERT_EQ(input[i], (*std_out_data)[i]) << i << "th element";
+    }
+}
+
+TEST_F(PopenTest, CaptureSpillTest) {
+    generate_input(1 << 16);
+    /** The size hint exceeds the threshold, so that the output is captured on disk. */
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--echo"),
+        subprocess::types::std_in_t(src),
+        subprocess::types::std_out_t(subprocess::types::capture_t(1 << 20, 1 << 10, "test")),
+        subprocess::types::std_err_t(subprocess::types::IOOption::STDOUT)
+    ));
+
+    auto std_out_data = p.captured_std_out();
+
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    ASSERT_TRUE(std_out_data.has_value());
+    /** stderr (the echoed arguments) shares the capture file. */
+    std::string captured(std_out_data->begin(), std_out_data->end());
+    EXPECT_EQ(captured.find("Arguments: "), 0);
+    EXPECT_NE(captured.find(input), std::string::npos);
+}
+
+TEST_F(PopenTest, MemfdInputTest) {
+    generate_input(1 << 20);
+    subprocess::Bytes input_bytes(input.begin(), input.end());
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_in_t(input_bytes),
+        subprocess::types::std_out_t(subprocess::types::capture_t())
+    ));
+
+    /** Neither side needs the parent: the child reads its input and writes its output on its own. */
+    auto std_out_data = p.captured_std_out();
+
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    ASSERT_FALSE(p.std_in().has_value());
+    ASSERT_EQ(input.size(), std_out_data->size());
+    for (int i = 0; i < input.size(); ++i) {
+        ASSERT_EQ(input[i], (*std_out_data)[i]) << i << "th element";
+    }
+}
+
+TEST_F(PopenTest, RlimitTest) {
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("test/helpers/process", "--delay", "200", "--io", "disable"),
+        subprocess::types::rlimit_t({{RLIMIT_NOFILE, 64}}).set(RLIMIT_CORE, 0, 0)
+    ));
+
+    /** Limits are applied before exec, so they are visible as soon as the program runs. */
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::ifstream limits_file("/proc/" + std::to_string(p.pid()) + "/limits");
+    std::string line, nofile, core;
+    while (std::getline(limits_file, line)) {
+        if (line.rfind("Max open files", 0) == 0)
+            nofile = line;
+        else if (line.rfind("Max core file size", 0) == 0)
+            core = line;
+    }
+    p.wait();
+
+    ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    EXPECT_NE(nofile.find(" 64 "), std::string::npos) << nofile;
+    EXPECT_NE(core.find(" 0 "), std::string::npos) << core;
+}
+
+TEST_F(PopenTest, SchedTest) {
+    ::cpu_set_t allowed;
+    ASSERT_EQ(::sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed))
+            cpus.push_back(cpu);
+    }
+    subprocess::types::round_robin_t placement(cpus);
+
+    for (int i = 0; i < 2; ++i) {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t("test/helpers/process", "--delay", "200", "--io", "disable"),
+            placement.next(subprocess::types::sched_t()
+                .set_policy(SCHED_BATCH)
+                .set_nice(10)
+                .set_ioprio(subprocess::types::IOPrioClass::BEST_EFFORT, 7))
+        ));
+
+        /** Attributes are applied before exec, so they are visible as soon as the program runs. */
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        ::cpu_set_t affinity;
+        ASSERT_EQ(::sched_getaffinity(p.pid(), sizeof(affinity), &affinity), 0);
+        EXPECT_EQ(CPU_COUNT(&affinity), 1);
+        EXPECT_TRUE(CPU_ISSET(cpus[i % cpus.size()], &affinity));
+        EXPECT_EQ(::sched_getscheduler(p.pid()), SCHED_BATCH);
+        EXPECT_EQ(::getpriority(PRIO_PROCESS, p.pid()), 10);
+        EXPECT_EQ(::syscall(SYS_ioprio_get, 1, p.pid()), (2 << 13) | 7);
+        p.wait();
+        ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+    }
+}
+
+TEST_F(PopenTest, RunTest) {
+    generate_input(1 << 20);
+    auto result = subprocess::run(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::input_t(input),
+        subprocess::types::capture_output_t(true, input.size())
+    );
+
+    EXPECT_EQ(result.returncode, EXIT_SUCCESS);
+    EXPECT_EQ(result.args.front(), "test/helpers/process");
+    ASSERT_TRUE(result.std_out.has_value());
+    ASSERT_TRUE(result.std_err.has_value());
+    EXPECT_EQ(std::string(result.std_out->data(), result.std_out->size()), input);
+    EXPECT_EQ(result.std_err->size(), 0);
+    EXPECT_TRUE(result.usage.has_value());
+
+    /** Without capture, output is inherited and nothing is returned. */
+    result = subprocess::run(subprocess::types::args_t("test/helpers/process", "--io", "disable", "--return", "3"));
+    EXPECT_EQ(result.returncode, 3);
+    EXPECT_FALSE(result.std_out.has_value());
+}
+
+TEST_F(PopenTest, RunCheckTest) {
+    try {
+        subprocess::run(
+            subprocess::types::args_t("test/helpers/process", "--return", "4"),
+            subprocess::types::input_t(std::string("partial output")),
+            subprocess::types::capture_output_t(true),
+            subprocess::types::check_t(true)
+        );
+        FAIL() << "CalledProcessError was not thrown";
+    } catch (const subprocess::CalledProcessError& e) {
+        EXPECT_EQ(e.returncode, 4);
+        ASSERT_TRUE(e.std_out.has_value());
+        EXPECT_EQ(std::string(e.std_out->data(), e.std_out->size()), "partial output");
+    }
+
+    EXPECT_THROW(subprocess::run(
+        subprocess::types::args_t("test/helpers/process"),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::capture_output_t(true)
+    ), std::invalid_argument);
+}
+
+TEST_F(PopenTest, RunTimeoutTest) {
+    auto start_time = std::chrono::steady_clock::now();
+    EXPECT_THROW(subprocess::run(
+        subprocess::types::args_t("test/helpers/process", "--delay", "10000", "--io", "disable"),
+        subprocess::types::capture_output_t(true),
+        subprocess::types::timeout_t(0.1)
+    ), subprocess::TimeoutExpired);
+    EXPECT_LT(std::chrono::steady_clock::now() - start_time, std::chrono::seconds(5));
+
+    /** A timeout of more than INT_MAX milliseconds is waited for in slices. */
+    auto result = subprocess::run(
+        subprocess::types::args_t("/bin/echo", "done"),
+        subprocess::types::capture_output_t(true),
+        subprocess::types::timeout_t(1e9)
+    );
+    EXPECT_EQ(result.returncode, 0);
+    EXPECT_EQ(std::string(result.std_out->data(), result.std_out->size()), "done\n");
+}
+
+TEST_F(PopenTest, ExecFailureTest) {
+    auto result = subprocess::run(
+        subprocess::types::args_t("test/helpers/no-such-program"),
+        subprocess::types::capture_output_t(true)
+    );
+    EXPECT_EQ(result.returncode, EXIT_FAILURE);
+    EXPECT_EQ(std::string(result.std_err->data(), result.std_err->size()), "Failed to execute a program: errno " + std::to_string(ENOENT) + "\n");
+}
+
+TEST_F(PopenTest, PreexecWaitsForParentTest) {
+    /** The constructor returns before the exec, so the child may wait on the parent until then. */
+    int gate[2];
+    ASSERT_EQ(::pipe(gate), 0);
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/true"),
+        subprocess::types::preexec_fn_t([&gate]() {
+            char byte;
+            [[maybe_unused]] ssize_t bytes_read = ::read(gate[0], &byte, 1);
+        })
+    ));
+    EXPECT_FALSE(p.stats().fork_to_exec.has_value());
+    ASSERT_EQ(::write(gate[1], "x", 1), 1);
+    EXPECT_EQ(p.wait().value(), 0);
+    EXPECT_TRUE(p.stats().fork_to_exec.has_value());
+    ::close(gate[0]);
+    ::close(gate[1]);
+}
+
+TEST_F(PopenTest, TailTest) {
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "seq 1 200000; seq 1 100000 >&2"),
+        subprocess::types::std_out_t(subprocess::types::tail_t(16)),
+        subprocess::types::std_err_t(subprocess::types::tail_t(1024, 3))
+    ));
+    EXPECT_FALSE(p.std_err().has_value());
+    EXPECT_EQ(p.wait().value(), 0);
+
+    auto std_out_tail = p.tail_std_out().value();
+    auto std_err_tail = p.tail_std_err().value();
+    EXPECT_EQ(std::string(std_out_tail->snapshot().data(), std_out_tail->snapshot().size()), "8\n199999\n200000\n");
+    EXPECT_EQ(std::string(std_err_tail->snapshot().data(), std_err_tail->snapshot().size()), "99998\n99999\n100000\n");
+    EXPECT_GT(std_err_tail->total(), 500000);
+}
+
+TEST_F(PopenTest, TeeTest) {
+    auto file = std::filesystem::temp_directory_path() / "popen_tee_test.txt";
+    std::ostringstream stream;
+    std::size_t        lines = 0;
+    subprocess::types::tee_t tee;
+    tee.add(file).add(&stream).add([&](const subprocess::Bytes& chunk) {
+        lines += std::count(chunk.data(), chunk.data() + chunk.size(), '\n');
+    }, subprocess::SinkPolicy::BUFFER, 1 << 20);
+
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "seq 1 50000"),
+        subprocess::types::std_out_t(tee)
+    ));
+    EXPECT_FALSE(p.std_out().has_value());
+    EXPECT_EQ(p.wait().value(), 0);
+
+    std::ifstream      content(file);
+    std::ostringstream file_data;
+    file_data << content.rdbuf();
+    EXPECT_EQ(file_data.str().size(), 288894);
+    EXPECT_EQ(file_data.str(), stream.str());
+    EXPECT_EQ(lines, 50000);
+    EXPECT_EQ(tee.tee->dropped(2), 0);
+    std::filesystem::remove(file);
+}
+
+TEST_F(PopenTest, GeneratorTest) {
+    /** 64 MiB are streamed, but at most one 64 KiB chunk exists at a time. */
+    std::size_t remaining = 1024;
+    std::ostringstream stream;
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "wc -c"),
+        subprocess::types::std_in_t([&]() -> std::optional<subprocess::Bytes> {
+            if (remaining == 0)
+                return std::nullopt;
+            --remaining;
+            return subprocess::Bytes(1 << 16, 'x');
+        }),
+        subprocess::types::std_out_t(&stream)
+    ));
+    EXPECT_EQ(p.wait().value(), 0);
+    EXPECT_EQ(std::stoull(stream.str()), 1024ull << 16);
+
+    /** The child reads only the first bytes: the endless producer stops when it exits. */
+    std::size_t calls = 0;
+    subprocess::Popen q(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "head -c 10 > /dev/null"),
+        subprocess::types::std_in_t([&]() -> std::optional<subprocess::Bytes> {
+            ++calls;
+            return subprocess::Bytes(4096, 'x');
+        })
+    ));
+    EXPECT_EQ(q.wait().value(), 0);
+    EXPECT_LT(calls, 64);
+}
+
+TEST_F(PopenTest, PipeIStreamTest) {
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "seq 1 100000"),
+        subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+    ));
+    subprocess::PipeIStream out(*p.std_out().value());
+    long sum = 0;
+    for (long value; out >> value;)
+        sum += value;
+    EXPECT_TRUE(out.eof());
+    EXPECT_EQ(sum, 5000050000);
+    EXPECT_EQ(p.wait().value(), 0);
+}
+
+static std::string read_string(subprocess::File& file) {
+    auto bytes = file.read_all();
+    return std::string(bytes.data(), bytes.size());
+}
+
+TEST_F(PopenTest, PassFdsTest) {
+    subprocess::types::pass_fds_t pass_fds;
+    auto from_child = pass_fds.pipe_from_child(3);
+    auto to_child   = pass_fds.pipe_to_child(4);
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "read line <&4; echo \"$line!\" >&3"),
+        std::move(pass_fds)
+    ));
+    std::string line = "hello\n";
+    to_child->write(subprocess::Bytes(line.begin(), line.end()), line.size());
+    to_child->close();
+    EXPECT_EQ(read_string(*from_child), "hello!\n");
+    EXPECT_EQ(p.wait().value(), 0);
+
+    EXPECT_THROW(subprocess::types::pass_fds_t({{0, 2}}), std::invalid_argument);
+    EXPECT_THROW(subprocess::types::pass_fds_t({{0, 3}, {1, 3}}), std::invalid_argument);
+}
+
+TEST_F(PopenTest, PassFdsOverlapTest) {
+    /** Each descriptor is passed to the number of the other one: neither may be overwritten first. */
+    int first[2], second[2];
+    ASSERT_EQ(::pipe(first), 0);
+    ASSERT_EQ(::pipe(second), 0);
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "echo first >&" + std::to_string(second[1]) + "; echo second >&" + std::to_string(first[1])),
+        subprocess::types::pass_fds_t({{first[1], second[1]}, {second[1], first[1]}})
+    ));
+    ::close(first[1]);
+    ::close(second[1]);
+    subprocess::File first_reader(first[0]), second_reader(second[0]);
+    EXPECT_EQ(read_string(first_reader), "first\n");
+    EXPECT_EQ(read_string(second_reader), "second\n");
+    first_reader.close();
+    second_reader.close();
+    EXPECT_EQ(p.wait().value(), 0);
+}
+
+TEST_F(PopenTest, PassFdsExecPipeTest) {
+    /** The exec pipe takes the lowest free descriptors: a target on its write end must not close it. */
+    int ready[2], gate[2], output[2], probe[2];
+    ASSERT_EQ(::pipe(ready), 0);
+    ASSERT_EQ(::pipe(gate), 0);
+    ASSERT_EQ(::pipe(output), 0);
+    ASSERT_EQ(::pipe(probe), 0);
+    ::close(probe[0]);
+    ::close(probe[1]);
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "echo passed >/proc/self/fd/" + std::to_string(probe[1])),
+        subprocess::types::pass_fds_t({{output[1], probe[1]}}),
+        subprocess::types::preexec_fn_t([&ready, &gate]() {
+            /** Past the duplications: the parent checks the exec pipe while the child waits. */
+            char byte = 'x';
+            [[maybe_unused]] ssize_t bytes_written = ::write(ready[1], &byte, 1);
+            [[maybe_unused]] ssize_t bytes_read    = ::read(gate[0], &byte, 1);
+        })
+    ));
+    char byte;
+    ASSERT_EQ(::read(ready[0], &byte, 1), 1);
+    EXPECT_FALSE(p.stats().fork_to_exec.has_value());
+    ASSERT_EQ(::write(gate[1], "x", 1), 1);
+    ::close(output[1]);
+    subprocess::File reader(output[0]);
+    EXPECT_EQ(read_string(reader), "passed\n");
+    reader.close();
+    EXPECT_EQ(p.wait().value(), 0);
+    EXPECT_TRUE(p.stats().fork_to_exec.has_value());
+    for (int fd : {ready[0], ready[1], gate[0], gate[1]})
+        ::close(fd);
+}
+
+TEST_F(PopenTest, PassFdsCloseOthersTest) {
+    /** A descriptor left inheritable by the parent reaches the child only if others are kept. */
+    int fd = ::open("/dev/null", O_RDONLY);
+    ASSERT_NE(fd, -1);
+    std::string check = "[ -e /proc/self/fd/" + std::to_string(fd) + " ] && [ -e /proc/self/fd/9 ]";
+    for (bool close_others : {true, false}) {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t("/bin/sh", "-c", check),
+            subprocess::types::pass_fds_t({{fd, 9}}).set_close_others(close_others)
+        ));
+        EXPECT_EQ(p.wait().value(), close_others ? 1 : 0);
+    }
+    ::close(fd);
+}
+
+TEST_F(PopenTest, SocketpairTest) {
+    /** Standard input and output share one socket: the child answers over the socket it reads. */
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "[ /proc/self/fd/0 -ef /proc/self/fd/1 ] && read line && echo \"$line!\""),
+        subprocess::types::std_in_t(subprocess::types::socketpair_t(SOCK_STREAM, 1 << 20)),
+        subprocess::types::std_out_t(subprocess::types::IOOption::SOCKETPAIR)
+    ));
+    auto socket = std::dynamic_pointer_cast<subprocess::Socket>(p.std_in().value());
+    ASSERT_TRUE(socket);
+    EXPECT_GE(socket->send_buffer_size(), 1 << 20);
+    std::string line = "hello\n";
+    auto [std_out_data, std_err_data] = p.communicate(subprocess::Bytes(line.begin(), line.end()));
+    ASSERT_TRUE(std_out_data.has_value());
+    EXPECT_EQ(std::string(std_out_data->data(), std_out_data->size()), "hello!\n");
+    EXPECT_EQ(p.returncode().value(), 0);
+}
@@ -0,0 +1,60 @@
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "subprocess/popen.h"
+#include "subprocess/stats.h"
+
+TEST(StatsTest, ProcessStatsTest) {
+    subprocess::StatsAggregator::global().reset();
+    subprocess::StatsAggregator::global().enable();
+
+    std::string s(4096, 'x');
+    {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t("test/helpers/process"),
+            subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+            subprocess::types::std_out_t(subprocess::types::IOOption::PIPE)
+        ));
+        EXPECT_FALSE(p.stats().wall_time.has_value());
+
+        auto [std_out_data, std_err_data] = p.communicate(subprocess::Bytes(s.begin(), s.end()));
+        auto stats = p.stats();
+
+        ASSERT_EQ(p.returncode().value(), EXIT_SUCCESS);
+        EXPECT_EQ(stats.std_in.bytes, s.size());
+        EXPECT_EQ(stats.std_out.bytes, s.size());
+        EXPECT_EQ(stats.std_err.bytes, 0);
+        EXPECT_GT(stats.std_in.io_calls, 0);
+        EXPECT_GT(stats.std_out.io_calls, 0);
+        ASSERT_TRUE(stats.first_output.has_value());
+        ASSERT_TRUE(stats.wall_time.has_value());
+        ASSERT_TRUE(stats.fork_to_exec.has_value());
+        EXPECT_GT(stats.fork_to_exec->count(), 0);
+        EXPECT_GE(stats.wall_time.value(), stats.fork_to_exec.value());
+    }
+
+    auto& aggregator = subprocess::StatsAggregator::global();
+    EXPECT_EQ(aggregator.processes(), 1);
+    EXPECT_EQ(aggregator.stream(1).bytes, s.size());
+    EXPECT_EQ(aggregator.wall_time().count(), 1);
+    EXPECT_NE(aggregator.to_json().find("\"processes\": 1"), std::string::npos);
+
+    /** Disabled, the aggregator is left untouched. */
+    aggregator.enable(false);
+    subprocess::Popen(subprocess::PopenConfig(subprocess::types::args_t("test/helpers/process", "--io", "disable"))).wait();
+    EXPECT_EQ(aggregator.processes(), 1);
+}
+
+TEST(StatsTest, HistogramTest) {
+    subprocess::Histogram histogram;
+    for (int i = 1; i <= 100; ++i)
+        histogram.record(std::chrono::microseconds(i));
+
+    EXPECT_EQ(histogram.count(), 100);
+    /** Quantiles are upper bounds of power-of-two buckets. */
+    EXPECT_GE(histogram.quantile(0.5), std::chrono::microseconds(50));
+    EXPECT_LT(histogram.quantile(0.5), std::chrono::microseconds(100));
+    EXPECT_EQ(histogram.quantile(1.0), std::chrono::microseconds(100));
+    EXPECT_NE(histogram.to_json().find("\"count\": 100"), std::string::npos);
+}
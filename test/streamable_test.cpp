@@ -1,9 +1,17 @@
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 #include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
+#include "subprocess/exception.h"
+#include "subprocess/io_uring.h"
 #include "subprocess/streamable.h"
 
 /* ===================================== File Test ===================================== */
@@ -92,6 +100,38 @@ TEST_F(StreamableFileTest, WriteTest) {
     }
 }
 
+TEST(StreamableFilePipeTest, MixedReadTest) {
+    /** Reads through the FILE* and reads of the descriptor interleave without losing data. */
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    ASSERT_EQ(::write(fds[1], "Hello World!", 12), 12);
+    ::close(fds[1]);
+    subprocess::File reader(fds[0]);
+    EXPECT_TRUE(reader.read_buffered().empty());
+    auto first = reader.read(5);
+    EXPECT_EQ(std::string(first.data(), first.size()), "Hello");
+    auto rest = reader.read_some(64).value();
+    EXPECT_EQ(std::string(rest.data(), rest.size()), " World!");
+    EXPECT_TRUE(reader.read_some(64)->empty());
+    reader.close();
+}
+
+TEST_F(StreamableFileTest, IoUringCommunicateTest) {
+    if (!subprocess::IoUring::is_supported())
+        GTEST_SKIP() << "io_uring is not supported by the kernel.";
+    subprocess::set_io_backend(subprocess::IOBackend::IO_URING);
+
+    size_t size_written = subprocess::communicate(in, out);
+    subprocess::set_io_backend(subprocess::IOBackend::BLOCKING);
+
+    EXPECT_EQ(input.size(), size_written);
+    size_t size_read = read_all();
+    ASSERT_EQ(size_written, size_read);
+    for (int i = 0; i < size_read; ++i) {
+        EXPECT_EQ(input[i], output[i]) << i << "th element";
+    }
+}
+
 /* ===================================== IOStream Test ===================================== */
 class StreamableIOStreamTest : public ::testing::Test {
 protected:
@@ -227,4 +267,333 @@ TEST_F(StreamableCommunicateTest, CommunicateAsyncTest) {
     for (int i = 0; i < size_written; ++i) {
         EXPECT_EQ(input[i], output[i]) << i << "th element";
     }
-}
\ No newline at end of file
+}
+/* ===================================== PipeStreambuf Test ===================================== */
+TEST(StreamablePipeStreambufTest, ReadTest) {
+    int pipe_fd[2];
+    ASSERT_EQ(::pipe(pipe_fd), 0);
+    std::string input = "first line\nsecond line\n";
+    input += std::string(1 << 18, 'x');
+    std::thread writer([&] {
+        subprocess::File out(pipe_fd[1]);
+        out.write(subprocess::Bytes(input.begin(), input.end()), input.size());
+        out.close();
+    });
+
+    subprocess::PipeIStream in(pipe_fd[0], 4096);
+    std::string line;
+    ASSERT_TRUE(std::getline(in, line));
+    EXPECT_EQ(line, "first line");
+    std::string word;
+    in >> word;
+    EXPECT_EQ(word, "second");
+    in.ignore(6);
+    /** Larger than the buffer: read directly into the destination. */
+    std::string rest(input.size(), '\0');
+    in.read(rest.data(), rest.size());
+    EXPECT_TRUE(in.eof());
+    EXPECT_EQ(in.gcount(), 1 << 18);
+    EXPECT_EQ(rest.substr(0, in.gcount()), std::string(1 << 18, 'x'));
+    writer.join();
+    ::close(pipe_fd[0]);
+}
+
+TEST(StreamablePipeStreambufTest, WriteTest) {
+    int pipe_fd[2];
+    ASSERT_EQ(::pipe(pipe_fd), 0);
+    std::string received;
+    std::thread reader([&] {
+        char buf[4096];
+        ssize_t size;
+        while ((size = ::read(pipe_fd[0], buf, sizeof(buf))) > 0)
+            received.append(buf, size);
+    });
+    {
+        subprocess::PipeOStream out(pipe_fd[1], 4096);
+        out << "answer: " << 42 << '\n';
+        std::string block(10000, 'y');
+        out.write(block.data(), block.size());
+        /** Flushed when the stream is destroyed. */
+    }
+    ::close(pipe_fd[1]);
+    reader.join();
+    EXPECT_EQ(received, "answer: 42\n" + std::string(10000, 'y'));
+    EXPECT_THROW(subprocess::PipeStreambuf(0, std::ios::in | std::ios::out), std::invalid_argument);
+}
+
+TEST(StreamablePipeStreambufTest, IOStreamTest) {
+    /** IStream and OStream go through the stream buffers, and OStream only flushes on close(). */
+    std::istringstream source(std::string(100000, 'z'));
+    subprocess::IStream in(&source);
+    auto data = in.read_all();
+    EXPECT_EQ(data.size(), 100000);
+    EXPECT_FALSE(in.is_readable());
+
+    std::ostringstream sink;
+    subprocess::OStream out(&sink);
+    out.write(data, 10);
+    EXPECT_EQ(sink.str(), std::string(10, 'z'));
+    out.close();
+    EXPECT_FALSE(out.is_opened());
+}
+
+/* ===================================== Generator Test ===================================== */
+TEST(StreamableGeneratorTest, ReadTest) {
+    std::vector<std::string> chunks = {"abc", "", "defgh", "ij"};
+    std::size_t next = 0;
+    subprocess::Generator generator([&]() -> std::optional<subprocess::Bytes> {
+        if (next == chunks.size())
+            return std::nullopt;
+        auto& chunk = chunks[next++];
+        return subprocess::Bytes(chunk.begin(), chunk.end());
+    });
+    EXPECT_EQ(generator.fileno(), -1);
+    EXPECT_TRUE(generator.is_readable());
+
+    auto some = generator.read_some(2).value();
+    EXPECT_EQ(std::string(some.data(), some.size()), "ab");
+    /** Empty chunks are skipped; a read never pulls more than it needs. */
+    auto part = generator.read(4);
+    EXPECT_EQ(std::string(part.data(), part.size()), "cdef");
+    EXPECT_EQ(next, 3);
+    auto rest = generator.read_all();
+    EXPECT_EQ(std::string(rest.data(), rest.size()), "ghij");
+    EXPECT_FALSE(generator.is_readable());
+    EXPECT_TRUE(generator.read_some(16)->empty());
+
+    generator.close();
+    EXPECT_THROW(generator.read(1), std::runtime_error);
+    EXPECT_THROW(subprocess::Generator(nullptr), std::invalid_argument);
+}
+
+TEST(StreamableGeneratorTest, BrokenPipeTest) {
+    int pipe_fd[2];
+    ASSERT_EQ(::pipe(pipe_fd), 0);
+    std::size_t calls = 0;
+    subprocess::Generator generator([&]() -> std::optional<subprocess::Bytes> {
+        ++calls;
+        return subprocess::Bytes(4096, 'x');
+    });
+    subprocess::File out(pipe_fd[1]);
+    std::thread reader([&] {
+        char buf[1024];
+        while (::read(pipe_fd[0], buf, sizeof(buf)) <= 0) {}
+        ::close(pipe_fd[0]);
+    });
+
+    /** The endless producer stops once the reader is gone, and the process gets no SIGPIPE. */
+    auto written = subprocess::communicate(generator, out);
+    reader.join();
+    out.close();
+    EXPECT_TRUE(generator.broken());
+    EXPECT_GE(written, 4096);
+    EXPECT_LT(calls, 64);
+}
+
+/* ===================================== TailBuffer Test ===================================== */
+TEST(StreamableTailBufferTest, BytesTest) {
+    subprocess::TailBuffer tail(8);
+    EXPECT_EQ(tail.snapshot().size(), 0);
+
+    std::string input = "0123456789abcdef";
+    tail.write(subprocess::Bytes(input.begin(), input.begin() + 5), 5);
+    EXPECT_EQ(std::string(tail.snapshot().data(), tail.snapshot().size()), "01234");
+    tail.write(subprocess::Bytes(input.begin() + 5, input.end()), 11);
+    EXPECT_EQ(std::string(tail.snapshot().data(), tail.snapshot().size()), "89abcdef");
+    EXPECT_EQ(tail.total(), 16);
+
+    tail.close();
+    EXPECT_FALSE(tail.is_opened());
+    EXPECT_THROW(tail.write(subprocess::Bytes(1, 'x'), 1), std::runtime_error);
+    EXPECT_THROW(subprocess::TailBuffer(0), std::invalid_argument);
+}
+
+TEST(StreamableTailBufferTest, LinesTest) {
+    subprocess::TailBuffer tail(16, 2);
+    std::string input = "zeroth\nfirst\nsecond\nthird\n";
+    tail.write(subprocess::Bytes(input.begin() + 7, input.begin() + 20), 13);
+    EXPECT_EQ(std::string(tail.snapshot().data(), tail.snapshot().size()), "first\nsecond\n");
+    /** Only "st\nsecond\nthird\n" fits: the partly overwritten "first" is dropped. */
+    tail.write(subprocess::Bytes(input.begin() + 20, input.end()), 6);
+    EXPECT_EQ(std::string(tail.snapshot().data(), tail.snapshot().size()), "second\nthird\n");
+    /** At most two lines, the last one unterminated. */
+    tail.write(subprocess::Bytes(input.begin(), input.begin() + 3), 3);
+    EXPECT_EQ(std::string(tail.snapshot().data(), tail.snapshot().size()), "third\nzer");
+}
+
+TEST(StreamableTailBufferTest, ConcurrentSnapshotTest) {
+    /** Each byte is the low byte of its position, so a snapshot is consistent if it counts up. */
+    subprocess::TailBuffer tail(251);
+    std::atomic<bool> done = false;
+    std::thread writer([&] {
+        subprocess::Bytes chunk(97);
+        for (std::uint64_t written = 0; written < (1 << 22); written += chunk.size()) {
+            for (std::size_t i = 0; i < chunk.size(); ++i)
+                chunk[i] = static_cast<char>(written + i);
+            tail.write(chunk, chunk.size());
+        }
+        done = true;
+    });
+    while (!done) {
+        auto snapshot = tail.snapshot();
+        for (std::size_t i = 1; i < snapshot.size(); ++i)
+            ASSERT_EQ(static_cast<char>(snapshot[i - 1] + 1), snapshot[i]);
+    }
+    writer.join();
+    EXPECT_EQ(tail.snapshot().size(), 251);
+}
+
+/* ===================================== Tee Test ===================================== */
+TEST(StreamableTeeTest, ForwardTest) {
+    auto first  = std::filesystem::temp_directory_path() / "streamable_tee_first.txt";
+    auto second = std::filesystem::temp_directory_path() / "streamable_tee_second.txt";
+    auto open_sink = [](const std::filesystem::path& path) {
+        return std::make_shared<subprocess::File>(std::fopen(path.c_str(), "w"));
+    };
+    auto first_sink  = open_sink(first);
+    auto second_sink = open_sink(second);
+
+    std::string callback_data;
+    subprocess::Tee tee;
+    tee.add(first_sink).add(second_sink).add([&](const subprocess::Bytes& chunk) {
+        callback_data.append(chunk.data(), chunk.size());
+    });
+    EXPECT_EQ(tee.size(), 3);
+
+    int pipe_fd[2];
+    ASSERT_EQ(::pipe(pipe_fd), 0);
+    std::string input;
+    for (int i = 0; i < 100000; ++i)
+        input += std::to_string(i) + "\n";
+    std::thread writer([&] {
+        subprocess::File out(pipe_fd[1]);
+        out.write(subprocess::Bytes(input.begin(), input.end()), input.size());
+        out.close();
+    });
+    subprocess::File in(pipe_fd[0]);
+    EXPECT_EQ(tee.forward(in), input.size());
+    writer.join();
+    in.close();
+    tee.close();
+    first_sink->close();
+    second_sink->close();
+
+    auto read_file = [](const std::filesystem::path& path) {
+        std::ifstream file(path);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+    EXPECT_EQ(read_file(first), input);
+    EXPECT_EQ(read_file(second), input);
+    EXPECT_EQ(callback_data, input);
+    std::filesystem::remove(first);
+    std::filesystem::remove(second);
+}
+
+TEST(StreamableTeeTest, ClosedSinkTest) {
+    /** Sinks whose reader is gone fail with EPIPE instead of killing the process with SIGPIPE. */
+    std::string input(4096, 'x');
+    auto source = [&input] {
+        int fds[2];
+        EXPECT_EQ(::pipe(fds), 0);
+        EXPECT_EQ(::write(fds[1], input.data(), input.size()), static_cast<ssize_t>(input.size()));
+        ::close(fds[1]);
+        return std::make_shared<subprocess::File>(fds[0]);
+    };
+    auto closed_sink = [] {
+        int fds[2];
+        EXPECT_EQ(::pipe(fds), 0);
+        ::close(fds[0]);
+        return std::make_shared<subprocess::File>(fds[1]);
+    };
+
+    std::size_t received = 0;
+    subprocess::Tee blocking;
+    blocking.add(closed_sink()).add([&](const subprocess::Bytes& chunk) { received += chunk.size(); });
+    auto in = source();
+    EXPECT_THROW(blocking.forward(*in), subprocess::OSError);
+    blocking.close();
+
+    /** A dropping sink fails alone and drops the rest of the stream. */
+    subprocess::Tee dropping;
+    dropping.add(closed_sink(), subprocess::SinkPolicy::DROP).add([&](const subprocess::Bytes& chunk) { received += chunk.size(); });
+    in = source();
+    EXPECT_EQ(dropping.forward(*in), input.size());
+    dropping.close();
+    EXPECT_EQ(dropping.dropped(0), input.size());
+}
+
+TEST(StreamableTeeTest, DropTest) {
+    std::atomic<std::size_t> received = 0;
+    std::size_t              blocking = 0;
+    subprocess::Tee tee;
+    tee.add([&](const subprocess::Bytes& chunk) { blocking += chunk.size(); });
+    tee.add([&](const subprocess::Bytes& chunk) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        received += chunk.size();
+    }, subprocess::SinkPolicy::DROP);
+
+    subprocess::Bytes chunk(1024, 'x');
+    for (int i = 0; i < 100; ++i)
+        tee.write(chunk, chunk.size());
+    tee.close();
+
+    /** The slow sink keeps the chunks it was idle for and drops the others. */
+    EXPECT_EQ(blocking, 100 * 1024);
+    EXPECT_EQ(tee.dropped(0), 0);
+    EXPECT_GT(tee.dropped(1), 0);
+    EXPECT_GT(received, 0);
+    EXPECT_EQ(received + tee.dropped(1), 100 * 1024);
+    EXPECT_THROW(tee.write(chunk, chunk.size()), std::runtime_error);
+}
+
+TEST(StreamableSocketTest, StreamTest) {
+    auto [left, right] = subprocess::Socket::pair();
+    EXPECT_EQ(left->type(), SOCK_STREAM);
+    left->set_buffer_size(1 << 20);
+    EXPECT_GE(left->send_buffer_size(), 1 << 20);
+
+    /** Both directions at once, and end-of-file through a duplicate left open. */
+    std::string ping = "ping", pong = "pong";
+    left->write(subprocess::Bytes(ping.begin(), ping.end()), ping.size());
+    right->write(subprocess::Bytes(pong.begin(), pong.end()), pong.size());
+    auto duplicate = left->duplicate();
+    duplicate->set_half_close(true);
+    duplicate->close();
+    auto received = right->read_all();
+    EXPECT_EQ(std::string(received.data(), received.size()), ping);
+    received = left->read(4);
+    EXPECT_EQ(std::string(received.data(), received.size()), pong);
+}
+
+TEST(StreamableSocketTest, MessageTest) {
+    auto [left, right] = subprocess::Socket::pair(SOCK_SEQPACKET);
+    std::string first = "first", second = "second";
+    left->write(subprocess::Bytes(first.begin(), first.end()), first.size());
+    left->write(subprocess::Bytes(second.begin(), second.end()), second.size());
+    auto message = right->receive_message();
+    ASSERT_TRUE(message.has_value());
+    EXPECT_EQ(std::string(message->data.data(), message->data.size()), first);
+    message = right->receive_message(3);
+    ASSERT_TRUE(message.has_value());
+    EXPECT_EQ(std::string(message->data.data(), message->data.size()), "sec");
+    EXPECT_TRUE(message->truncated);
+
+    /** A descriptor sent with a message is received as a new descriptor of the same file. */
+    int pipe_fd[2];
+    ASSERT_EQ(::pipe(pipe_fd), 0);
+    std::string fd = "fd";
+    left->send_message(subprocess::Bytes(fd.begin(), fd.end()), fd.size(), {pipe_fd[1]});
+    ::close(pipe_fd[1]);
+    message = right->receive_message();
+    ASSERT_TRUE(message.has_value());
+    ASSERT_EQ(message->fds.size(), 1);
+    EXPECT_EQ(::write(message->fds[0], "x", 1), 1);
+    ::close(message->fds[0]);
+    char byte;
+    EXPECT_EQ(::read(pipe_fd[0], &byte, 1), 1);
+    EXPECT_EQ(byte, 'x');
+    ::close(pipe_fd[0]);
+
+    left->close();
+    EXPECT_FALSE(right->receive_message().has_value());
+}
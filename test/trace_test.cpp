@@ -0,0 +1,46 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "subprocess/popen.h"
+#include "subprocess/trace.h"
+
+TEST(TraceTest, TracerTest) {
+    std::filesystem::path file = "test/trace.json";
+    auto& tracer = subprocess::trace::Tracer::global();
+    tracer.start(file);
+    ASSERT_TRUE(tracer.is_enabled());
+
+    auto start = subprocess::trace::Clock::now();
+    tracer.track_name(42, "child \"42\"");
+    tracer.complete("running", 42, start, start + std::chrono::milliseconds(1), "\"returncode\": 0");
+    tracer.instant("reaped", subprocess::trace::Tracer::current_track());
+    {
+        subprocess::Popen p(subprocess::PopenConfig(
+            subprocess::types::args_t("test/helpers/process", "--io", "disable")
+        ));
+        p.wait();
+    }
+    tracer.stop();
+    ASSERT_FALSE(tracer.is_enabled());
+
+    std::ifstream in(file);
+    std::stringstream content;
+    content << in.rdbuf();
+    std::string trace = content.str();
+    EXPECT_EQ(trace.find("{\"displayTimeUnit\": \"ns\", \"traceEvents\": ["), 0);
+    EXPECT_NE(trace.find("\"name\": \"child \\\"42\\\"\""), std::string::npos);
+    EXPECT_NE(trace.find("\"ph\": \"X\", \"name\": \"running\", \"pid\": "), std::string::npos);
+    EXPECT_NE(trace.find("\"name\": \"reaped\""), std::string::npos);
+#ifdef SUBPROCESS_ENABLE_TRACE
+    /** Library hooks: one track per child with its fork-exec slice, and the wait on the caller's track. */
+    EXPECT_NE(trace.find("\"name\": \"fork-exec\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\": \"wait\""), std::string::npos);
+#else
+    EXPECT_EQ(trace.find("\"name\": \"fork-exec\""), std::string::npos);
+#endif
+    std::filesystem::remove(file);
+}
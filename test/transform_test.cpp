@@ -0,0 +1,143 @@
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+#include "subprocess/popen.h"
+#include "subprocess/transform.h"
+
+namespace {
+
+/** Runs `transform` over `input` cut into chunks of `chunk_size` bytes, then finishes it. */
+std::string apply(subprocess::Transform& transform, const std::string& input, std::size_t chunk_size) {
+    subprocess::Bytes out;
+    for (std::size_t i = 0; i < input.size(); i += chunk_size)
+        transform.process(input.data() + i, std::min(chunk_size, input.size() - i), out);
+    transform.finish(out);
+    return std::string(out.data(), out.size());
+}
+
+} // namespace
+
+TEST(TransformTest, LineTest) {
+    std::string input = "first\nsecond\nthird";
+    for (std::size_t chunk_size : {1, 4, 64}) {
+        subprocess::LineTransform lines;
+        EXPECT_EQ(apply(lines, input, chunk_size), input);
+    }
+
+    subprocess::LineTransform lines;
+    subprocess::Bytes out;
+    lines.process("ab\ncd", 5, out);
+    EXPECT_EQ(std::string(out.data(), out.size()), "ab\n");
+    lines.process("e", 1, out);
+    EXPECT_EQ(std::string(out.data(), out.size()), "ab\n");
+    lines.process("\n", 1, out);
+    EXPECT_EQ(std::string(out.data(), out.size()), "ab\ncde\n");
+}
+
+TEST(TransformTest, LongLineTest) {
+    /** A line reaching the maximum length is passed in pieces instead of growing the stage. */
+    subprocess::LineTransform lines(8);
+    subprocess::Bytes out;
+    lines.process("0123", 4, out);
+    EXPECT_TRUE(out.empty());
+    lines.process("456789", 6, out);
+    EXPECT_EQ(std::string(out.data(), out.size()), "0123456789");
+    lines.process("ab\ncd", 5, out);
+    EXPECT_EQ(std::string(out.data(), out.size()), "0123456789ab\n");
+    EXPECT_THROW(subprocess::LineTransform(0), std::invalid_argument);
+
+    std::string input = "keep: " + std::string(20, 'x') + "\ndrop: " + std::string(20, 'y') + "\nkeep\n";
+    for (std::size_t chunk_size : {1, 7, 64}) {
+        subprocess::FilterTransform keep([](std::string_view line) { return line.starts_with("keep"); }, 8);
+        EXPECT_EQ(apply(keep, input, chunk_size), "keep: " + std::string(20, 'x') + "\nkeep\n") << chunk_size;
+    }
+}
+
+TEST(TransformTest, PrefixTest) {
+    for (std::size_t chunk_size : {1, 3, 64}) {
+        subprocess::PrefixTransform prefix("[job] ");
+        EXPECT_EQ(apply(prefix, "a\nbc\n\nd", chunk_size), "[job] a\n[job] bc\n[job] \n[job] d");
+    }
+}
+
+TEST(TransformTest, FilterTest) {
+    for (std::size_t chunk_size : {1, 5, 64}) {
+        subprocess::FilterTransform errors([](std::string_view line) { return line.starts_with("error"); });
+        EXPECT_EQ(apply(errors, "ok\nerror: a\nfine\nerror: b", chunk_size), "error: a\nerror: b");
+    }
+    EXPECT_THROW(subprocess::FilterTransform(nullptr), std::invalid_argument);
+}
+
+TEST(TransformTest, ChainTest) {
+    std::ostringstream stream;
+    auto destination = std::make_shared<subprocess::OStream>(&stream);
+    subprocess::TransformChain chain(destination);
+    chain.add(std::make_shared<subprocess::FilterTransform>([](std::string_view line) { return !line.empty(); }))
+         .add(std::make_shared<subprocess::PrefixTransform>("> "));
+    EXPECT_EQ(chain.size(), 2);
+    EXPECT_EQ(chain.fileno(), -1);
+
+    std::string input = "one\n\ntw";
+    chain.write(subprocess::Bytes(input.begin(), input.end()), input.size());
+    EXPECT_EQ(stream.str(), "> one\n");
+    input = "o\n";
+    chain.write(subprocess::Bytes(input.begin(), input.end()), input.size());
+    chain.close();
+    EXPECT_EQ(stream.str(), "> one\n> two\n");
+    EXPECT_TRUE(destination->is_opened());
+    EXPECT_THROW(chain.write(subprocess::Bytes(1, 'x'), 1), std::runtime_error);
+
+    auto filter = chain.stats(0);
+    auto prefix = chain.stats(1);
+    EXPECT_EQ(filter.bytes_in, 9);
+    EXPECT_EQ(filter.bytes_out, 8);
+    EXPECT_EQ(filter.chunks, 2);
+    EXPECT_EQ(prefix.bytes_in, 8);
+    EXPECT_EQ(prefix.bytes_out, 12);
+    EXPECT_THROW(subprocess::TransformChain(nullptr), std::invalid_argument);
+}
+
+TEST(TransformTest, PopenTest) {
+    std::ostringstream stream;
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "seq 1 100000"),
+        subprocess::types::std_out_t(&stream)
+            .transform(std::make_shared<subprocess::FilterTransform>([](std::string_view line) { return line.ends_with("000"); }))
+            .transform(std::make_shared<subprocess::PrefixTransform>("seq: "))
+    ));
+    EXPECT_EQ(p.wait().value(), 0);
+
+    std::string expected;
+    for (int i = 1000; i <= 100000; i += 1000)
+        expected += "seq: " + std::to_string(i) + "\n";
+    EXPECT_EQ(stream.str(), expected);
+
+    subprocess::types::std_out_t pipe(subprocess::types::IOOption::PIPE);
+    EXPECT_THROW(pipe.transform(std::make_shared<subprocess::LineTransform>()), std::invalid_argument);
+}
+
+#ifdef SUBPROCESS_ENABLE_ZLIB
+TEST(TransformTest, GzipTest) {
+    std::string input;
+    for (int i = 0; i < 100000; ++i)
+        input += "line " + std::to_string(i) + "\n";
+    subprocess::GzipTransform gzip(6);
+    std::string compressed = apply(gzip, input, 4096);
+    EXPECT_LT(compressed.size(), input.size() / 4);
+
+    /** Decompressed by gzip(1), which also checks the trailer. */
+    std::ostringstream stream;
+    subprocess::Popen p(subprocess::PopenConfig(
+        subprocess::types::args_t("/bin/sh", "-c", "gzip -dc"),
+        subprocess::types::std_in_t(subprocess::types::IOOption::PIPE),
+        subprocess::types::std_out_t(&stream)
+    ));
+    p.communicate(subprocess::Bytes(compressed.begin(), compressed.end()));
+    EXPECT_EQ(p.wait().value(), 0);
+    EXPECT_EQ(stream.str(), input);
+}
+#endif